@@ -0,0 +1,33 @@
+#version 450
+
+// NOTE: one thread per texel of a depth pyramid level, it keeps the farthest depth of the texels it covers in the
+// source; the source isn't always exactly twice the size (level 0 reads the full resolution depth buffer), so the
+// footprint is rounded outwards to stay conservative
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout (push_constant) uniform DepthReduceData
+{
+    uvec2 sourceSize;
+    uvec2 destinationSize;
+};
+
+layout (binding = 0) uniform sampler2D sourceImage;
+layout (binding = 1, r32f) uniform writeonly image2D destinationImage;
+
+void main()
+{
+    uvec2 position = gl_GlobalInvocationID.xy;
+    if (any(greaterThanEqual(position, destinationSize)))
+        return;
+
+    uvec2 begin = position * sourceSize / destinationSize;
+    uvec2 end = min(((position + 1) * sourceSize + destinationSize - 1) / destinationSize, sourceSize);
+
+    float depth = 0.0;
+
+    for (uint y = begin.y; y < end.y; y++)
+        for (uint x = begin.x; x < end.x; x++)
+            depth = max(depth, texelFetch(sourceImage, ivec2(x, y), 0).x);
+
+    imageStore(destinationImage, ivec2(position), vec4(depth));
+}
@@ -0,0 +1,179 @@
+#version 450
+
+// NOTE: one thread per object; objects whose bounding sphere touches the frustum (and isn't hidden behind the depth
+// pyramid in the late phase) are appended as an indexed draw of the LOD picked for their distance, drawn with
+// vkCmdDrawIndexedIndirectCount
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// NOTE: has to match DrawCullPhase in vkl_main.cpp
+#define DRAW_CULL_ALL 0
+#define DRAW_CULL_EARLY 1
+#define DRAW_CULL_LATE 2
+
+// NOTE: has to match MeshLod in vkl_main.cpp, except error is relative to the mesh's bounding sphere radius
+struct MeshLod
+{
+    uint firstIndex;
+    uint indexCount;
+    float error;
+};
+
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+// NOTE: the camera looks down -Z in view space; frustum holds the normalized side planes, (P00, 1) and (P11, 1),
+// and P22, P23 are the projection's depth terms; see selectLod in vkl_main.cpp for lodTarget
+layout (push_constant) uniform DrawCullData
+{
+    mat4 view;
+    vec4 frustum;
+
+    float P00, P11, P22, P23;
+    float znear, zfar;
+    float lodTarget;
+
+    uint objectCount;
+    uint phase;
+};
+
+// NOTE: world space center and radius
+layout (binding = 0) readonly buffer Bounds
+{
+    vec4 bounds[];
+};
+
+layout (binding = 1) readonly buffer Lods
+{
+    MeshLod lods[];
+};
+
+// NOTE: the late phase appends after the first objectCount commands
+layout (binding = 2) writeonly buffer Commands
+{
+    DrawCommand commands[];
+};
+
+// NOTE: the late phase counts in the second one
+layout (binding = 3) buffer CommandCounts
+{
+    uint commandCounts[2];
+};
+
+// NOTE: 1 for objects that passed the late phase last frame
+layout (binding = 4) buffer Visibility
+{
+    uint visibility[];
+};
+
+layout (binding = 5) uniform sampler2D depthPyramid;
+
+// NOTE: 2D polyhedral bounds of a clipped, perspective-projected 3D sphere (Mara and McGuire 2013), c is in view space
+// with Z flipped to point forward; returns the UV space rectangle, or false when the sphere touches the near plane
+bool projectSphere(vec3 c, float r, out vec4 aabb)
+{
+    if (c.z < r + znear)
+        return false;
+
+    vec2 cx = -c.xz;
+    vec2 vx = vec2(sqrt(dot(cx, cx) - r * r), r);
+    vec2 minx = mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
+    vec2 maxx = mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
+
+    vec2 cy = -c.yz;
+    vec2 vy = vec2(sqrt(dot(cy, cy) - r * r), r);
+    vec2 miny = mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
+    vec2 maxy = mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
+
+    aabb = vec4(minx.x / minx.y * P00, miny.x / miny.y * P11, maxx.x / maxx.y * P00, maxy.x / maxy.y * P11);
+
+    // NOTE: NDC Y points up (the viewport is flipped), texel rows go down
+    aabb = aabb.xwzy * vec4(0.5, -0.5, 0.5, -0.5) + vec4(0.5);
+
+    return true;
+}
+
+bool occluded(vec3 center, float radius)
+{
+    vec3 c = vec3(center.xy, -center.z);
+
+    vec4 aabb;
+    if (!projectSphere(c, radius, aabb))
+        return false;
+
+    aabb = clamp(aabb, vec4(0.0), vec4(1.0));
+
+    // NOTE: the level where the rectangle is at most one texel wide, so it covers at most 2x2 texels
+    vec2 pyramidSize = vec2(textureSize(depthPyramid, 0));
+    vec2 extent = (aabb.zw - aabb.xy) * pyramidSize;
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, textureQueryLevels(depthPyramid) - 1);
+
+    ivec2 levelSize = textureSize(depthPyramid, level);
+    ivec2 begin = clamp(ivec2(aabb.xy * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 end = clamp(ivec2(aabb.zw * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float depth = 0.0;
+
+    for (int y = begin.y; y <= end.y; y++)
+        for (int x = begin.x; x <= end.x; x++)
+            depth = max(depth, texelFetch(depthPyramid, ivec2(x, y), level).x);
+
+    // NOTE: depth of the sphere's closest point, the same mapping PerspectiveVk uses
+    float sphereDepth = -P22 + P23 / (c.z - radius);
+
+    return sphereDepth > depth;
+}
+
+void main()
+{
+    // NOTE: the dispatch is capped by maxComputeWorkGroupCount, so threads step over the remaining objects
+    for (uint i = gl_GlobalInvocationID.x; i < objectCount; i += gl_NumWorkGroups.x * gl_WorkGroupSize.x)
+    {
+        if ((phase == DRAW_CULL_EARLY) && (visibility[i] == 0))
+            continue;
+
+        vec4 sphere = bounds[i];
+
+        vec3 center = (view * vec4(sphere.xyz, 1.0)).xyz;
+        float radius = sphere.w;
+
+        bool visible = true;
+
+        visible = visible && (-center.z * frustum.y - abs(center.x) * frustum.x >= -radius);
+        visible = visible && (-center.z * frustum.w - abs(center.y) * frustum.z >= -radius);
+        visible = visible && (-center.z + radius >= znear) && (-center.z - radius <= zfar);
+
+        if (visible && (phase == DRAW_CULL_LATE))
+            visible = !occluded(center, radius);
+
+        // NOTE: objects drawn in the early phase are already in the depth buffer
+        if (visible && ((phase != DRAW_CULL_LATE) || (visibility[i] == 0)))
+        {
+            // NOTE: distance to the closest point of the sphere, the same selection as selectLod
+            float distance = max(length(center) - radius, znear);
+
+            uint lodIndex = 0;
+            while ((lodIndex + 1 < uint(lods.length())) && (lods[lodIndex + 1].error * radius <= lodTarget * distance))
+                lodIndex++;
+
+            MeshLod lod = lods[lodIndex];
+
+            uint countIndex = (phase == DRAW_CULL_LATE) ? 1 : 0;
+            uint commandIndex = countIndex * objectCount + atomicAdd(commandCounts[countIndex], 1);
+
+            commands[commandIndex].indexCount = lod.indexCount;
+            commands[commandIndex].instanceCount = 1;
+            commands[commandIndex].firstIndex = lod.firstIndex;
+            commands[commandIndex].vertexOffset = 0;
+            commands[commandIndex].firstInstance = i;
+        }
+
+        if (phase == DRAW_CULL_LATE)
+            visibility[i] = visible ? 1 : 0;
+    }
+}
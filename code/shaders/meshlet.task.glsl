@@ -0,0 +1,105 @@
+#version 450
+
+#extension GL_NV_mesh_shader: require
+
+// NOTE: one workgroup per MESH_TASK_GROUP_SIZE meshlets of one visible object; meshlets that pass the frustum and
+// the normal cone test (the same as meshletcull.comp) each get a mesh shader workgroup
+layout (local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+
+// NOTE: has to match Meshlet in vkl_main.cpp
+struct Meshlet
+{
+    vec4 sphere;
+    vec4 cone;
+
+    uint firstIndex;
+    uint triangleCount;
+    uint vertexCount;
+    uint vertexOffset;
+};
+
+struct MeshDraw
+{
+    mat4 model;
+};
+
+// NOTE: MeshShadingData, Globals followed by MeshletCullData
+layout (push_constant) uniform MeshShadingData
+{
+    mat4 viewProjection;
+
+    vec4 positionOffset;
+    vec4 positionScale;
+
+    vec4 frustum[6];
+    vec4 cameraPosition;
+
+    uint meshletCount;
+    uint objectCount;
+};
+
+layout (binding = 1) readonly buffer Draws
+{
+    MeshDraw draws[];
+};
+
+layout (binding = 2) readonly buffer Meshlets
+{
+    Meshlet meshlets[];
+};
+
+layout (binding = 5) readonly buffer Objects
+{
+    uint objects[];
+};
+
+taskNV out Task
+{
+    uint objectIndex;
+    uint meshletIndices[32];
+} OUT;
+
+shared uint visibleCount;
+
+void main()
+{
+    uint groupsPerObject = (meshletCount + 31) / 32;
+
+    uint objectIndex = objects[gl_WorkGroupID.x / groupsPerObject];
+    uint meshletIndex = (gl_WorkGroupID.x % groupsPerObject) * 32 + gl_LocalInvocationID.x;
+
+    if (gl_LocalInvocationID.x == 0)
+        visibleCount = 0;
+
+    barrier();
+
+    if (meshletIndex < meshletCount)
+    {
+        Meshlet meshlet = meshlets[meshletIndex];
+        mat4 model = draws[objectIndex].model;
+
+        // NOTE: rotation and uniform scale only, like the vertex shader assumes
+        vec3 center = (model * vec4(meshlet.sphere.xyz, 1.0)).xyz;
+        float radius = meshlet.sphere.w * length(model[0].xyz);
+        vec3 coneAxis = normalize(mat3(model) * meshlet.cone.xyz);
+
+        bool visible = true;
+
+        for (int p = 0; p < 6; p++)
+            visible = visible && (dot(frustum[p].xyz, center) + frustum[p].w > -radius);
+
+        vec3 view = center - cameraPosition.xyz;
+        visible = visible && (dot(view, coneAxis) < meshlet.cone.w * length(view) + radius);
+
+        if (visible)
+            OUT.meshletIndices[atomicAdd(visibleCount, 1)] = meshletIndex;
+    }
+
+    barrier();
+
+    if (gl_LocalInvocationID.x == 0)
+    {
+        OUT.objectIndex = objectIndex;
+        gl_TaskCountNV = visibleCount;
+    }
+}
@@ -0,0 +1,111 @@
+#version 450
+
+// NOTE: one thread per meshlet of every visible object; meshlets that pass the frustum and the normal cone test
+// are appended as indexed draws of their index range, drawn with vkCmdDrawIndexedIndirectCount
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// NOTE: has to match Meshlet in vkl_main.cpp
+struct Meshlet
+{
+    vec4 sphere;
+    vec4 cone;
+
+    uint firstIndex;
+    uint triangleCount;
+    uint vertexCount;
+    uint padding;
+};
+
+struct MeshDraw
+{
+    mat4 model;
+};
+
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+// NOTE: world space, planes point inside the frustum
+layout (push_constant) uniform MeshletCullData
+{
+    vec4 frustum[6];
+    vec4 cameraPosition;
+
+    uint meshletCount;
+    uint objectCount;
+    uint maxCommandCount;
+};
+
+layout (binding = 0) readonly buffer Meshlets
+{
+    Meshlet meshlets[];
+};
+
+layout (binding = 1) readonly buffer Draws
+{
+    MeshDraw draws[];
+};
+
+// NOTE: objects that passed CPU frustum culling this frame
+layout (binding = 2) readonly buffer Objects
+{
+    uint objects[];
+};
+
+layout (binding = 3) writeonly buffer Commands
+{
+    DrawCommand commands[];
+};
+
+layout (binding = 4) buffer CommandCount
+{
+    uint commandCount;
+};
+
+void main()
+{
+    uint meshletIndex = gl_GlobalInvocationID.x;
+    if (meshletIndex >= meshletCount)
+        return;
+
+    Meshlet meshlet = meshlets[meshletIndex];
+
+    // NOTE: the Y dimension is capped by maxComputeWorkGroupCount, so workgroups step over the remaining objects
+    for (uint i = gl_WorkGroupID.y; i < objectCount; i += gl_NumWorkGroups.y)
+    {
+        uint objectIndex = objects[i];
+        mat4 model = draws[objectIndex].model;
+
+        // NOTE: rotation and uniform scale only, like the vertex shader assumes
+        vec3 center = (model * vec4(meshlet.sphere.xyz, 1.0)).xyz;
+        float radius = meshlet.sphere.w * length(model[0].xyz);
+        vec3 coneAxis = normalize(mat3(model) * meshlet.cone.xyz);
+
+        bool visible = true;
+
+        for (int p = 0; p < 6; p++)
+            visible = visible && (dot(frustum[p].xyz, center) + frustum[p].w > -radius);
+
+        vec3 view = center - cameraPosition.xyz;
+        visible = visible && (dot(view, coneAxis) < meshlet.cone.w * length(view) + radius);
+
+        if (visible)
+        {
+            uint commandIndex = atomicAdd(commandCount, 1);
+
+            if (commandIndex < maxCommandCount)
+            {
+                commands[commandIndex].indexCount = meshlet.triangleCount * 3;
+                commands[commandIndex].instanceCount = 1;
+                commands[commandIndex].firstIndex = meshlet.firstIndex;
+                commands[commandIndex].vertexOffset = 0;
+                commands[commandIndex].firstInstance = objectIndex;
+            }
+        }
+    }
+}
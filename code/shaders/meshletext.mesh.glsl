@@ -0,0 +1,134 @@
+#version 450
+
+#extension GL_EXT_mesh_shader: require
+
+// NOTE: meshlet.mesh.glsl for VK_EXT_mesh_shader. One workgroup per meshlet that passed the task shader, vertices are
+// pulled the same way triangle.vert does
+layout (constant_id = 0) const bool PACKED_VERTICES = false;
+
+layout (local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+layout (triangles, max_vertices = 64, max_primitives = 124) out;
+
+// NOTE: has to match Meshlet in vkl_main.cpp
+struct Meshlet
+{
+    vec4 sphere;
+    vec4 cone;
+
+    uint firstIndex;
+    uint triangleCount;
+    uint vertexCount;
+    uint vertexOffset;
+};
+
+struct MeshDraw
+{
+    mat4 model;
+};
+
+// NOTE: MeshShadingData, only the Globals part is used here
+layout (push_constant) uniform MeshShadingData
+{
+    mat4 viewProjection;
+
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+layout (binding = 0) readonly buffer Vertices
+{
+    uint vertexData[];
+};
+
+layout (binding = 1) readonly buffer Draws
+{
+    MeshDraw draws[];
+};
+
+layout (binding = 2) readonly buffer Meshlets
+{
+    Meshlet meshlets[];
+};
+
+layout (binding = 3) readonly buffer MeshletVertices
+{
+    uint meshletVertices[];
+};
+
+// NOTE: 3 meshlet local 8 bit indices per word, indexed by the triangle index in the index buffer
+layout (binding = 4) readonly buffer MeshletTriangles
+{
+    uint meshletTriangles[];
+};
+
+struct Task
+{
+    uint objectIndex;
+    uint meshletIndices[32];
+};
+
+taskPayloadSharedEXT Task IN;
+
+layout (location = 0) out vec4 color[];
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+
+    n.x += (n.x >= 0.0) ? -t : t;
+    n.y += (n.y >= 0.0) ? -t : t;
+
+    return normalize(n);
+}
+
+void main()
+{
+    Meshlet meshlet = meshlets[IN.meshletIndices[gl_WorkGroupID.x]];
+    MeshDraw draw = draws[IN.objectIndex];
+
+    // NOTE: has to come before any output is written, the meshlet is the same for the whole workgroup
+    SetMeshOutputsEXT(meshlet.vertexCount, meshlet.triangleCount);
+
+    for (uint i = gl_LocalInvocationID.x; i < meshlet.vertexCount; i += 32)
+    {
+        uint vertexIndex = meshletVertices[meshlet.vertexOffset + i];
+
+        vec3 position;
+        vec3 normal;
+
+        if (PACKED_VERTICES)
+        {
+            uint base = vertexIndex * 3;
+            uint word0 = vertexData[base + 0];
+            uint word1 = vertexData[base + 1];
+
+            vec2 pxy = unpackUnorm2x16(word0);
+            float pz = unpackUnorm2x16(word1).x;
+
+            position = positionOffset.xyz + vec3(pxy, pz) * positionScale.xyz;
+            normal = decodeOctahedral(unpackSnorm4x8(word1).zw);
+        }
+        else
+        {
+            uint base = vertexIndex * 8;
+
+            position = vec3(uintBitsToFloat(vertexData[base + 0]), uintBitsToFloat(vertexData[base + 1]), uintBitsToFloat(vertexData[base + 2]));
+            normal = vec3(uintBitsToFloat(vertexData[base + 3]), uintBitsToFloat(vertexData[base + 4]), uintBitsToFloat(vertexData[base + 5]));
+        }
+
+        gl_MeshVerticesEXT[i].gl_Position = viewProjection * draw.model * vec4(position, 1.0);
+
+        normal = normalize(mat3(draw.model) * normal);
+        color[i] = vec4(normal * 0.5 + vec3(0.5), 1.0);
+    }
+
+    uint triangleOffset = meshlet.firstIndex / 3;
+
+    for (uint i = gl_LocalInvocationID.x; i < meshlet.triangleCount; i += 32)
+    {
+        uint triangle = meshletTriangles[triangleOffset + i];
+
+        gl_PrimitiveTriangleIndicesEXT[i] = uvec3(triangle & 0xff, (triangle >> 8) & 0xff, (triangle >> 16) & 0xff);
+    }
+}
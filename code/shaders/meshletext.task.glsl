@@ -0,0 +1,112 @@
+#version 450
+
+#extension GL_EXT_mesh_shader: require
+
+// NOTE: meshlet.task.glsl for VK_EXT_mesh_shader. One workgroup per MESH_TASK_GROUP_SIZE meshlets of one visible object;
+// meshlets that pass the frustum and the normal cone test (the same as meshletcull.comp) each get a mesh shader workgroup.
+// There is no first task in vkCmdDrawMeshTasksEXT, so large draws come as a 2D grid of workgroups
+layout (local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+
+// NOTE: has to match Meshlet in vkl_main.cpp
+struct Meshlet
+{
+    vec4 sphere;
+    vec4 cone;
+
+    uint firstIndex;
+    uint triangleCount;
+    uint vertexCount;
+    uint vertexOffset;
+};
+
+struct MeshDraw
+{
+    mat4 model;
+};
+
+// NOTE: MeshShadingData, Globals followed by MeshletCullData
+layout (push_constant) uniform MeshShadingData
+{
+    mat4 viewProjection;
+
+    vec4 positionOffset;
+    vec4 positionScale;
+
+    vec4 frustum[6];
+    vec4 cameraPosition;
+
+    uint meshletCount;
+    uint objectCount;
+};
+
+layout (binding = 1) readonly buffer Draws
+{
+    MeshDraw draws[];
+};
+
+layout (binding = 2) readonly buffer Meshlets
+{
+    Meshlet meshlets[];
+};
+
+layout (binding = 5) readonly buffer Objects
+{
+    uint objects[];
+};
+
+struct Task
+{
+    uint objectIndex;
+    uint meshletIndices[32];
+};
+
+taskPayloadSharedEXT Task OUT;
+
+shared uint visibleCount;
+
+void main()
+{
+    uint groupsPerObject = (meshletCount + 31) / 32;
+
+    // NOTE: the grid is rounded up to whole rows, the workgroups past the last task emit nothing
+    uint taskIndex = gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+    bool taskValid = taskIndex < objectCount * groupsPerObject;
+
+    uint objectIndex = taskValid ? objects[taskIndex / groupsPerObject] : 0;
+    uint meshletIndex = (taskIndex % groupsPerObject) * 32 + gl_LocalInvocationID.x;
+
+    if (gl_LocalInvocationID.x == 0)
+        visibleCount = 0;
+
+    barrier();
+
+    if (taskValid && (meshletIndex < meshletCount))
+    {
+        Meshlet meshlet = meshlets[meshletIndex];
+        mat4 model = draws[objectIndex].model;
+
+        // NOTE: rotation and uniform scale only, like the vertex shader assumes
+        vec3 center = (model * vec4(meshlet.sphere.xyz, 1.0)).xyz;
+        float radius = meshlet.sphere.w * length(model[0].xyz);
+        vec3 coneAxis = normalize(mat3(model) * meshlet.cone.xyz);
+
+        bool visible = true;
+
+        for (int p = 0; p < 6; p++)
+            visible = visible && (dot(frustum[p].xyz, center) + frustum[p].w > -radius);
+
+        vec3 view = center - cameraPosition.xyz;
+        visible = visible && (dot(view, coneAxis) < meshlet.cone.w * length(view) + radius);
+
+        if (visible)
+            OUT.meshletIndices[atomicAdd(visibleCount, 1)] = meshletIndex;
+    }
+
+    barrier();
+
+    if (gl_LocalInvocationID.x == 0)
+        OUT.objectIndex = objectIndex;
+
+    // NOTE: has to be reached by the whole workgroup, visibleCount is the same for all of it after the barrier
+    EmitMeshTasksEXT(visibleCount, 1, 1);
+}
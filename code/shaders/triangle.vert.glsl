@@ -1,27 +1,81 @@
 #version 450
 
-struct Vertex
+// NOTE: vertices are read as raw words, either Vertex or PackedVertex from vkl_main.cpp
+layout (constant_id = 0) const bool PACKED_VERTICES = false;
+
+struct MeshDraw
 {
-    float vx, vy, vz;
-    float nx, ny, nz;
-    float tu, tv;
+    mat4 model;
+};
+
+layout (push_constant) uniform Globals
+{
+    mat4 viewProjection;
+
+    vec4 positionOffset;
+    vec4 positionScale;
 };
 
 layout (binding = 0) readonly buffer Vertices
 {
-    Vertex vertices[];
+    uint vertexData[];
+};
+
+// NOTE: indexed with gl_InstanceIndex, every draw passes its object index as firstInstance
+layout (binding = 1) readonly buffer Draws
+{
+    MeshDraw draws[];
 };
 
 layout (location = 0) out vec4 color;
 
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+
+    n.x += (n.x >= 0.0) ? -t : t;
+    n.y += (n.y >= 0.0) ? -t : t;
+
+    return normalize(n);
+}
+
 void main()
 {
-    Vertex v = vertices[gl_VertexIndex];
-    vec3 position = vec3(v.vx, v.vy, v.vz);
-    vec3 normal = vec3(v.nx, v.ny, v.nz);
-    vec2 texcoord = vec2(v.tu, v.tv);
+    vec3 position;
+    vec3 normal;
+    vec2 texcoord;
+
+    if (PACKED_VERTICES)
+    {
+        // NOTE: 3 words - px py, pz nx ny, tu tv
+        uint base = uint(gl_VertexIndex) * 3;
+        uint word0 = vertexData[base + 0];
+        uint word1 = vertexData[base + 1];
+        uint word2 = vertexData[base + 2];
+
+        vec2 pxy = unpackUnorm2x16(word0);
+        float pz = unpackUnorm2x16(word1).x;
+
+        position = positionOffset.xyz + vec3(pxy, pz) * positionScale.xyz;
+        normal = decodeOctahedral(unpackSnorm4x8(word1).zw);
+        texcoord = unpackHalf2x16(word2);
+    }
+    else
+    {
+        uint base = uint(gl_VertexIndex) * 8;
+
+        position = vec3(uintBitsToFloat(vertexData[base + 0]), uintBitsToFloat(vertexData[base + 1]), uintBitsToFloat(vertexData[base + 2]));
+        normal = vec3(uintBitsToFloat(vertexData[base + 3]), uintBitsToFloat(vertexData[base + 4]), uintBitsToFloat(vertexData[base + 5]));
+        texcoord = vec2(uintBitsToFloat(vertexData[base + 6]), uintBitsToFloat(vertexData[base + 7]));
+    }
+
+    MeshDraw draw = draws[gl_InstanceIndex];
+
+    gl_Position = viewProjection * draw.model * vec4(position, 1.0);
 
-    gl_Position = vec4(position + vec3(0, 0, 0.5), 1.0);
+    // NOTE: objects are only rotated and uniformly scaled, so the model matrix works for normals too
+    normal = normalize(mat3(draw.model) * normal);
 
     color = vec4(normal * 0.5 + vec3(0.5), 1.0);
-}
\ No newline at end of file
+}
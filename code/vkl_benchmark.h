@@ -0,0 +1,329 @@
+#pragma once
+
+//
+// NOTE: Benchmark mode
+//
+// Runs a fixed number of warm-up frames followed by measured frames through the regular main loop.
+// Every measured frame records its CPU frame time, how long acquire/submit/present took on the calling thread
+// and the GPU time between the timestamps at the start and end of its command buffer, plus the CPU time of frustum culling
+// and of recording the command buffer.
+// The report is JSON, so runs of different builds can be compared by regression tracking. It starts with the
+// BenchmarkConfig of the run.
+// A compare run measures the vertex and the mesh shading render path back to back in one process, each with its own
+// warm-up, and reports their timings side by side.
+//
+
+#define BENCHMARK_HISTOGRAM_BINS 32
+
+enum BenchmarkSeries
+{
+    BENCHMARK_CPU_FRAME,
+    BENCHMARK_ACQUIRE,
+    BENCHMARK_SUBMIT,
+    BENCHMARK_PRESENT,
+    BENCHMARK_GPU_FRAME,
+    BENCHMARK_CULL,
+    BENCHMARK_RECORD,
+
+    BENCHMARK_SERIES_COUNT
+};
+
+static const char* benchmarkSeriesNames[BENCHMARK_SERIES_COUNT] = { "cpuFrame", "acquire", "submit", "present", "gpuFrame", "cull", "record" };
+
+struct Benchmark
+{
+    // NOTE: the submitted frame the warm-up starts at, non-zero for the later render paths of a compare run
+    uint32_t firstFrame;
+    uint32_t warmupFrames;
+    uint32_t measuredFrames;
+
+    // NOTE: one slot per measured frame, negative means no sample (e.g. no timestamp support, nothing to present)
+    std::vector<double> samples[BENCHMARK_SERIES_COUNT];
+
+    double measureTimeBegin;
+    double measureTimeEnd;
+};
+
+// NOTE: what the run was configured with, written ahead of the timings so reports of different runs can be told apart
+struct BenchmarkConfig
+{
+    const char* deviceName;
+    const char* renderPath;
+
+    uint32_t width, height;
+    uint32_t framesInFlight;
+    bool headless;
+
+    uint32_t recordThreads;
+    bool asyncCompute;
+};
+
+struct TimingSummary
+{
+    uint32_t count;
+    double min, avg, max;
+    double p50, p95, p99;
+};
+
+void createBenchmark(Benchmark& result, uint32_t warmupFrames, uint32_t measuredFrames, uint32_t firstFrame = 0)
+{
+    result.firstFrame = firstFrame;
+    result.warmupFrames = warmupFrames;
+    result.measuredFrames = measuredFrames;
+
+    for (uint32_t i = 0; i < BENCHMARK_SERIES_COUNT; i++)
+        result.samples[i].assign(measuredFrames, -1.0);
+
+    result.measureTimeBegin = 0.0;
+    result.measureTimeEnd = 0.0;
+}
+
+// NOTE: frameIndex is the 0-based index of the submitted frame, samples that land in the warm-up or outside the
+// benchmark's frames are dropped
+void recordBenchmarkSample(Benchmark& benchmark, BenchmarkSeries series, uint64_t frameIndex, double timeMs)
+{
+    uint64_t measureBegin = uint64_t(benchmark.firstFrame) + benchmark.warmupFrames;
+
+    if ((frameIndex < measureBegin) || (frameIndex >= measureBegin + benchmark.measuredFrames))
+        return;
+
+    benchmark.samples[series][size_t(frameIndex - measureBegin)] = timeMs;
+}
+
+// NOTE: every benchmark of a compare run sees every sample and keeps the ones of its own frames
+void recordBenchmarkSample(Benchmark* benchmarks, uint32_t benchmarkCount, BenchmarkSeries series, uint64_t frameIndex, double timeMs)
+{
+    for (uint32_t i = 0; i < benchmarkCount; i++)
+        recordBenchmarkSample(benchmarks[i], series, frameIndex, timeMs);
+}
+
+// NOTE: called at the start of every frame with the time the previous one ended
+void updateBenchmarkMeasureTime(Benchmark* benchmarks, uint32_t benchmarkCount, uint64_t frameIndex, double timeMs)
+{
+    for (uint32_t i = 0; i < benchmarkCount; i++)
+    {
+        uint64_t measureBegin = uint64_t(benchmarks[i].firstFrame) + benchmarks[i].warmupFrames;
+
+        if (frameIndex == measureBegin)
+            benchmarks[i].measureTimeBegin = timeMs;
+
+        if (frameIndex == measureBegin + benchmarks[i].measuredFrames)
+            benchmarks[i].measureTimeEnd = timeMs;
+    }
+}
+
+static void getValidSamples(std::vector<double>& result, const std::vector<double>& samples)
+{
+    result.clear();
+
+    for (size_t i = 0; i < samples.size(); i++)
+        if (samples[i] >= 0.0)
+            result.push_back(samples[i]);
+
+    std::sort(result.begin(), result.end());
+}
+
+// NOTE: nearest-rank percentile over sorted samples
+static double getPercentile(const std::vector<double>& sorted, double percentile)
+{
+    size_t rank = size_t(ceil(percentile / 100.0 * double(sorted.size())));
+    return sorted[std::max(rank, size_t(1)) - 1];
+}
+
+void summarizeSamples(TimingSummary& result, const std::vector<double>& sorted)
+{
+    result = {};
+    result.count = uint32_t(sorted.size());
+
+    if (sorted.empty())
+        return;
+
+    double sum = 0.0;
+    for (size_t i = 0; i < sorted.size(); i++)
+        sum += sorted[i];
+
+    result.min = sorted.front();
+    result.max = sorted.back();
+    result.avg = sum / double(sorted.size());
+    result.p50 = getPercentile(sorted, 50.0);
+    result.p95 = getPercentile(sorted, 95.0);
+    result.p99 = getPercentile(sorted, 99.0);
+}
+
+static void writeJsonString(FILE* file, const char* string)
+{
+    fputc('"', file);
+
+    for (const char* c = string; *c; c++)
+    {
+        if ((*c == '"') || (*c == '\\'))
+            fputc('\\', file);
+
+        if (uint8_t(*c) >= 0x20)
+            fputc(*c, file);
+    }
+
+    fputc('"', file);
+}
+
+// NOTE: equal width bins between the fastest and the slowest frame
+static void writeHistogram(FILE* file, const std::vector<double>& sorted)
+{
+    uint32_t counts[BENCHMARK_HISTOGRAM_BINS] = {};
+
+    double minTime = sorted.empty() ? 0.0 : sorted.front();
+    double maxTime = sorted.empty() ? 0.0 : sorted.back();
+    double binWidth = std::max((maxTime - minTime) / BENCHMARK_HISTOGRAM_BINS, 1e-6);
+
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        uint32_t bin = uint32_t((sorted[i] - minTime) / binWidth);
+        counts[std::min(bin, uint32_t(BENCHMARK_HISTOGRAM_BINS - 1))]++;
+    }
+
+    fprintf(file, "{ \"minMs\": %.4f, \"binWidthMs\": %.6f, \"counts\": [", minTime, binWidth);
+
+    for (uint32_t i = 0; i < BENCHMARK_HISTOGRAM_BINS; i++)
+        fprintf(file, "%s%u", i ? ", " : "", counts[i]);
+
+    fprintf(file, "] }");
+}
+
+void printBenchmarkSummary(const Benchmark& benchmark, const char* renderPath)
+{
+    std::vector<double> sorted;
+
+    printf("Benchmark: %u warm-up frames, %u measured frames, %s render path\n", benchmark.warmupFrames, benchmark.measuredFrames, renderPath);
+    printf("%-10s %8s %8s %8s %8s %8s %8s (ms)\n", "", "min", "avg", "p50", "p95", "p99", "max");
+
+    for (uint32_t i = 0; i < BENCHMARK_SERIES_COUNT; i++)
+    {
+        getValidSamples(sorted, benchmark.samples[i]);
+
+        TimingSummary summary;
+        summarizeSamples(summary, sorted);
+
+        if (summary.count == 0)
+            continue;
+
+        printf("%-10s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n", benchmarkSeriesNames[i],
+               summary.min, summary.avg, summary.p50, summary.p95, summary.p99, summary.max);
+    }
+}
+
+// NOTE: the ratio is the avg of the second render path over the avg of the first one, below 1 means it's faster
+void printBenchmarkComparison(const Benchmark& first, const char* firstPath, const Benchmark& second, const char* secondPath)
+{
+    std::vector<double> sorted;
+
+    printf("Benchmark: %u warm-up frames, %u measured frames per render path\n", first.warmupFrames, first.measuredFrames);
+    printf("%-10s %26s %26s\n", "", firstPath, secondPath);
+    printf("%-10s %8s %8s %8s %8s %8s %8s %8s (ms)\n", "", "avg", "p50", "p95", "avg", "p50", "p95", "ratio");
+
+    for (uint32_t i = 0; i < BENCHMARK_SERIES_COUNT; i++)
+    {
+        TimingSummary firstSummary;
+        getValidSamples(sorted, first.samples[i]);
+        summarizeSamples(firstSummary, sorted);
+
+        TimingSummary secondSummary;
+        getValidSamples(sorted, second.samples[i]);
+        summarizeSamples(secondSummary, sorted);
+
+        if ((firstSummary.count == 0) && (secondSummary.count == 0))
+            continue;
+
+        printf("%-10s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.2f\n", benchmarkSeriesNames[i],
+               firstSummary.avg, firstSummary.p50, firstSummary.p95, secondSummary.avg, secondSummary.p50, secondSummary.p95,
+               (firstSummary.avg > 0.0) ? secondSummary.avg / firstSummary.avg : 0.0);
+    }
+}
+
+static void writeBenchmarkConfig(FILE* file, const BenchmarkConfig& config)
+{
+    fprintf(file, "  \"device\": ");
+    writeJsonString(file, config.deviceName);
+    fprintf(file, ",\n");
+    fprintf(file, "  \"renderPath\": ");
+    writeJsonString(file, config.renderPath);
+    fprintf(file, ",\n");
+    fprintf(file, "  \"width\": %u,\n  \"height\": %u,\n", config.width, config.height);
+    fprintf(file, "  \"framesInFlight\": %u,\n  \"headless\": %s,\n", config.framesInFlight, config.headless ? "true" : "false");
+    fprintf(file, "  \"recordThreads\": %u,\n", config.recordThreads);
+    fprintf(file, "  \"asyncCompute\": %s,\n", config.asyncCompute ? "true" : "false");
+}
+
+// NOTE: indent is the nesting of the object the timings are written into
+static void writeBenchmarkTimings(FILE* file, const Benchmark& benchmark, const char* indent)
+{
+    // NOTE: the window can be closed before the warm-up is over
+    double measureTime = (benchmark.measureTimeBegin > 0.0) ? benchmark.measureTimeEnd - benchmark.measureTimeBegin : 0.0;
+
+    std::vector<double> sorted;
+
+    getValidSamples(sorted, benchmark.samples[BENCHMARK_CPU_FRAME]);
+    TimingSummary frameSummary;
+    summarizeSamples(frameSummary, sorted);
+
+    fprintf(file, "%s\"warmupFrames\": %u,\n%s\"measuredFrames\": %u,\n", indent, benchmark.warmupFrames, indent, benchmark.measuredFrames);
+    fprintf(file, "%s\"measureTimeMs\": %.3f,\n", indent, measureTime);
+    fprintf(file, "%s\"fps\": %.3f,\n", indent, (frameSummary.avg > 0.0) ? 1000.0 / frameSummary.avg : 0.0);
+    fprintf(file, "%s\"series\": {\n", indent);
+
+    for (uint32_t i = 0; i < BENCHMARK_SERIES_COUNT; i++)
+    {
+        getValidSamples(sorted, benchmark.samples[i]);
+
+        TimingSummary summary;
+        summarizeSamples(summary, sorted);
+
+        fprintf(file, "%s  \"%s\": { \"count\": %u, \"minMs\": %.4f, \"avgMs\": %.4f, \"p50Ms\": %.4f, \"p95Ms\": %.4f, \"p99Ms\": %.4f, \"maxMs\": %.4f, \"histogram\": ",
+                indent, benchmarkSeriesNames[i], summary.count, summary.min, summary.avg, summary.p50, summary.p95, summary.p99, summary.max);
+        writeHistogram(file, sorted);
+        fprintf(file, " }%s\n", (i + 1 < BENCHMARK_SERIES_COUNT) ? "," : "");
+    }
+
+    fprintf(file, "%s}\n", indent);
+}
+
+bool writeBenchmarkReport(const Benchmark& benchmark, const BenchmarkConfig& config, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "{\n");
+    writeBenchmarkConfig(file, config);
+    writeBenchmarkTimings(file, benchmark, "  ");
+    fprintf(file, "}\n");
+
+    return fclose(file) == 0;
+}
+
+// NOTE: the config is shared, the timings of each render path go into "paths" under the path's name
+static void writeBenchmarkPath(FILE* file, const Benchmark& benchmark, const char* renderPath, bool last)
+{
+    fprintf(file, "    ");
+    writeJsonString(file, renderPath);
+    fprintf(file, ": {\n");
+    writeBenchmarkTimings(file, benchmark, "      ");
+    fprintf(file, "    }%s\n", last ? "" : ",");
+}
+
+bool writeBenchmarkComparison(const Benchmark& first, const char* firstPath, const Benchmark& second, const char* secondPath,
+                              const BenchmarkConfig& config, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "{\n");
+    writeBenchmarkConfig(file, config);
+    fprintf(file, "  \"paths\": {\n");
+    writeBenchmarkPath(file, first, firstPath, false);
+    writeBenchmarkPath(file, second, secondPath, true);
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+
+    return fclose(file) == 0;
+}
@@ -0,0 +1,553 @@
+#pragma once
+
+//
+// NOTE: Job system
+//
+// A fixed set of workers, each with its own Chase-Lev work-stealing deque (Chase and Lev 2005, with the C11 memory
+// orderings of Le et al. 2013). A worker pushes and pops jobs at the bottom of its own deque without locks, idle
+// workers steal from the top of the others. Worker 0 is the thread that created the job system, it only runs jobs
+// while it waits for a counter. There are no fibers, so waiting runs other jobs on the waiting thread's stack.
+//
+// Jobs are a function pointer, a data pointer and a [begin, end) range. A job can decrement a JobCounter when it
+// finishes, and can be held back until another counter reaches zero, which is how dependencies are expressed.
+// parallelFor splits a range into jobs of groupSize and waits for them.
+//
+// Jobs can only be submitted from worker threads. Every job is a trace zone with its name (names have to outlive the
+// trace, like TRACE_ZONE), and every worker counts the jobs it ran, its steals and its busy time, see getJobStats.
+//
+
+#define JOB_QUEUE_SIZE 4096
+#define JOB_POOL_SIZE (2 * JOB_QUEUE_SIZE)
+#define JOB_IDLE_SPINS 256
+
+// NOTE: top bit of JobCounter::value, set while its waiters are being changed
+#define JOB_COUNTER_LOCKED 0x80000000u
+
+struct JobCounter;
+
+typedef void (*JobFunction)(void* data, uint32_t begin, uint32_t end);
+
+struct Job
+{
+    JobFunction function;
+    void* data;
+    uint32_t begin;
+    uint32_t end;
+
+    const char* name;
+
+    // NOTE: decremented once the job has run, can be null
+    JobCounter* counter;
+
+    // NOTE: next job waiting on the same counter
+    Job* next;
+
+    // NOTE: set while the slot holds a job that hasn't started yet, cleared by executeJob once it has read the job
+    std::atomic<bool> busy{ false };
+};
+
+// NOTE: counts the jobs that haven't finished yet. The lock bit lives in the same word, so the job that finishes
+// last unlocks and releases the counter with one atomic and never touches it again; whoever waits on a counter on the
+// stack can return as soon as it reads zero.
+struct JobCounter
+{
+    std::atomic<uint32_t> value{ 0 };
+
+    // NOTE: jobs held back until the count reaches zero, guarded by JOB_COUNTER_LOCKED
+    Job* waiters = 0;
+};
+
+struct JobQueue
+{
+    // NOTE: thieves take from the top, the owner pushes and pops at the bottom; they're a cache line apart so
+    // steals don't keep invalidating the owner's line
+    std::atomic<int64_t> top;
+    char padding[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom;
+
+    std::atomic<Job*> jobs[JOB_QUEUE_SIZE];
+};
+
+struct JobStats
+{
+    uint64_t jobCount;
+    uint64_t stealCount;
+    uint64_t failedStealCount;
+    uint64_t busyNs;
+};
+
+struct JobWorker
+{
+    JobQueue queue;
+
+    // NOTE: ring the worker allocates its jobs from, walked round robin; slots that are still busy are skipped, jobs
+    // held back by a counter or stolen by another worker can outlive any number of later submissions
+    Job jobs[JOB_POOL_SIZE];
+    uint32_t jobIndex;
+
+    uint32_t randomState;
+
+    // NOTE: JobStats, only written by the worker itself but read by getJobStats at any time
+    std::atomic<uint64_t> jobCount;
+    std::atomic<uint64_t> stealCount;
+    std::atomic<uint64_t> failedStealCount;
+    std::atomic<uint64_t> busyNs;
+};
+
+struct JobSystem
+{
+    std::vector<JobWorker*> workers;
+    std::vector<std::thread> threads;
+
+    // NOTE: idle workers sleep on wake once spinning didn't find anything
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<uint32_t> sleepingCount;
+
+    std::atomic<bool> quit;
+};
+
+static thread_local uint32_t jobWorkerIndex = ~0u;
+
+// NOTE: single writer, so a plain load and store is enough and cheaper than an atomic add
+inline void addJobStat(std::atomic<uint64_t>& stat, uint64_t value)
+{
+    stat.store(stat.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static bool pushJob(JobQueue& queue, Job* job)
+{
+    int64_t bottom = queue.bottom.load(std::memory_order_relaxed);
+    int64_t top = queue.top.load(std::memory_order_acquire);
+
+    if (bottom - top >= JOB_QUEUE_SIZE)
+        return false;
+
+    // NOTE: the release pairs with the acquire of bottom in stealJob, it publishes the job's contents
+    queue.jobs[bottom & (JOB_QUEUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+    queue.bottom.store(bottom + 1, std::memory_order_release);
+
+    return true;
+}
+
+static Job* popJob(JobQueue& queue)
+{
+    int64_t bottom = queue.bottom.load(std::memory_order_relaxed) - 1;
+    queue.bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = queue.top.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        queue.bottom.store(bottom + 1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    Job* job = queue.jobs[bottom & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+
+    // NOTE: the last job, race the thieves for it
+    if (top == bottom)
+    {
+        if (!queue.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = 0;
+
+        queue.bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+static Job* stealJob(JobQueue& queue)
+{
+    int64_t top = queue.top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = queue.bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom)
+        return 0;
+
+    Job* job = queue.jobs[top & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+
+    if (!queue.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return 0;
+
+    return job;
+}
+
+static void wakeJobWorkers(JobSystem& system)
+{
+    // NOTE: pairs with the fence in the idle path of jobWorkerMain, either the sleeper sees the new job or we see it
+    // sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (system.sleepingCount.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(system.mutex);
+        system.wake.notify_all();
+    }
+}
+
+static void executeJob(JobSystem& system, Job* job);
+
+static void submitJob(JobSystem& system, Job* job)
+{
+    assert(jobWorkerIndex < system.workers.size());
+    JobWorker& worker = *system.workers[jobWorkerIndex];
+
+    // NOTE: a full deque runs the job right away instead, which is always correct
+    if (!pushJob(worker.queue, job))
+    {
+        executeJob(system, job);
+        return;
+    }
+
+    wakeJobWorkers(system);
+}
+
+static void finishJobCounter(JobSystem& system, JobCounter* counter)
+{
+    uint32_t value = counter->value.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        // NOTE: not the last job, decrementing doesn't disturb whoever holds the lock
+        if ((value & ~JOB_COUNTER_LOCKED) > 1)
+        {
+            if (counter->value.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return;
+
+            continue;
+        }
+
+        if (value & JOB_COUNTER_LOCKED)
+        {
+            std::this_thread::yield();
+            value = counter->value.load(std::memory_order_relaxed);
+            continue;
+        }
+
+        // NOTE: the last job takes the count to zero and the lock at once
+        if (counter->value.compare_exchange_weak(value, JOB_COUNTER_LOCKED, std::memory_order_acq_rel, std::memory_order_relaxed))
+            break;
+    }
+
+    Job* waiters = counter->waiters;
+    counter->waiters = 0;
+
+    // NOTE: jobs added since count as well, only the lock bit goes
+    counter->value.fetch_and(~JOB_COUNTER_LOCKED, std::memory_order_release);
+
+    while (waiters)
+    {
+        Job* next = waiters->next;
+        submitJob(system, waiters);
+        waiters = next;
+    }
+}
+
+static void executeJob(JobSystem& system, Job* job)
+{
+    JobWorker& worker = *system.workers[jobWorkerIndex];
+
+    JobFunction function = job->function;
+    void* data = job->data;
+    uint32_t begin = job->begin;
+    uint32_t end = job->end;
+    const char* name = job->name;
+    JobCounter* counter = job->counter;
+
+    // NOTE: the release pairs with the acquire in allocateJob, the owner can refill the slot once we're done reading
+    job->busy.store(false, std::memory_order_release);
+
+    uint64_t beginNs = getTraceTimeNs();
+
+    function(data, begin, end);
+
+    uint64_t endNs = getTraceTimeNs();
+
+#if VKL_TRACE
+    writeTraceEvent(name, beginNs, endNs);
+#endif
+
+    addJobStat(worker.jobCount, 1);
+    addJobStat(worker.busyNs, endNs - beginNs);
+
+    if (counter)
+        finishJobCounter(system, counter);
+}
+
+static Job* findJob(JobSystem& system, uint32_t workerIndex)
+{
+    JobWorker& worker = *system.workers[workerIndex];
+
+    if (Job* job = popJob(worker.queue))
+        return job;
+
+    uint32_t workerCount = uint32_t(system.workers.size());
+    if (workerCount == 1)
+        return 0;
+
+    // NOTE: xorshift32, start at a random victim so thieves don't all go for the same deque
+    worker.randomState ^= worker.randomState << 13;
+    worker.randomState ^= worker.randomState >> 17;
+    worker.randomState ^= worker.randomState << 5;
+
+    uint32_t offset = worker.randomState % workerCount;
+
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        uint32_t victim = (offset + i) % workerCount;
+        if (victim == workerIndex)
+            continue;
+
+        if (Job* job = stealJob(system.workers[victim]->queue))
+        {
+            addJobStat(worker.stealCount, 1);
+            return job;
+        }
+
+        addJobStat(worker.failedStealCount, 1);
+    }
+
+    return 0;
+}
+
+static bool hasQueuedJobs(JobSystem& system)
+{
+    for (size_t i = 0; i < system.workers.size(); i++)
+    {
+        JobQueue& queue = system.workers[i]->queue;
+
+        if (queue.top.load(std::memory_order_relaxed) < queue.bottom.load(std::memory_order_relaxed))
+            return true;
+    }
+
+    return false;
+}
+
+static void jobWorkerMain(JobSystem* system, uint32_t workerIndex)
+{
+    jobWorkerIndex = workerIndex;
+
+    char name[32];
+    snprintf(name, sizeof(name), "worker %u", workerIndex);
+    setTraceThreadName(name);
+
+    uint32_t idleSpins = 0;
+
+    while (!system->quit.load(std::memory_order_relaxed))
+    {
+        if (Job* job = findJob(*system, workerIndex))
+        {
+            executeJob(*system, job);
+            idleSpins = 0;
+            continue;
+        }
+
+        if (++idleSpins < JOB_IDLE_SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(system->mutex);
+
+        system->sleepingCount.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!hasQueuedJobs(*system) && !system->quit.load(std::memory_order_relaxed))
+            system->wake.wait(lock);
+
+        system->sleepingCount.fetch_sub(1, std::memory_order_relaxed);
+        idleSpins = 0;
+    }
+}
+
+// NOTE: workerCount includes the calling thread, which becomes worker 0
+void createJobSystem(JobSystem& result, uint32_t workerCount)
+{
+    assert(workerCount > 0);
+
+    result.sleepingCount = 0;
+    result.quit = false;
+
+    result.workers.resize(workerCount);
+
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        JobWorker* worker = new JobWorker;
+        worker->queue.top = 0;
+        worker->queue.bottom = 0;
+        worker->jobIndex = 0;
+        worker->randomState = 0x9e3779b9 + i * 0x85ebca6b;
+        worker->jobCount = 0;
+        worker->stealCount = 0;
+        worker->failedStealCount = 0;
+        worker->busyNs = 0;
+
+        result.workers[i] = worker;
+    }
+
+    jobWorkerIndex = 0;
+
+    // NOTE: every worker exists before any thread starts, thieves walk the whole array
+    result.threads.resize(workerCount - 1);
+
+    for (uint32_t i = 1; i < workerCount; i++)
+        result.threads[i - 1] = std::thread(jobWorkerMain, &result, i);
+}
+
+// NOTE: every counter has to be waited on before this, queued jobs are dropped
+void destroyJobSystem(JobSystem& system)
+{
+    {
+        std::lock_guard<std::mutex> lock(system.mutex);
+        system.quit = true;
+    }
+
+    system.wake.notify_all();
+
+    for (size_t i = 0; i < system.threads.size(); i++)
+        system.threads[i].join();
+
+    for (size_t i = 0; i < system.workers.size(); i++)
+        delete system.workers[i];
+
+    system.threads.clear();
+    system.workers.clear();
+
+    jobWorkerIndex = ~0u;
+}
+
+static Job* allocateJob(JobSystem& system, JobFunction function, void* data, uint32_t begin, uint32_t end, const char* name, JobCounter* counter)
+{
+    assert(jobWorkerIndex < system.workers.size());
+    JobWorker& worker = *system.workers[jobWorkerIndex];
+
+    Job* job = 0;
+
+    // NOTE: almost always the next slot is free; with every slot taken the worker runs queued jobs until one frees up
+    while (!job)
+    {
+        for (uint32_t i = 0; (i < JOB_POOL_SIZE) && !job; i++)
+        {
+            Job* slot = &worker.jobs[worker.jobIndex++ % JOB_POOL_SIZE];
+
+            if (!slot->busy.load(std::memory_order_acquire))
+                job = slot;
+        }
+
+        if (job)
+            break;
+
+        if (Job* other = findJob(system, jobWorkerIndex))
+            executeJob(system, other);
+        else
+            std::this_thread::yield();
+    }
+
+    job->busy.store(true, std::memory_order_relaxed);
+    job->function = function;
+    job->data = data;
+    job->begin = begin;
+    job->end = end;
+    job->name = name;
+    job->counter = counter;
+    job->next = 0;
+
+    if (counter)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+
+    return job;
+}
+
+// NOTE: runs function(data, begin, end) on some worker; counter can be null
+void runJob(JobSystem& system, JobFunction function, void* data, uint32_t begin, uint32_t end, const char* name, JobCounter* counter)
+{
+    submitJob(system, allocateJob(system, function, data, begin, end, name, counter));
+}
+
+// NOTE: like runJob, but the job only starts once dependency has reached zero
+void runJobAfter(JobSystem& system, JobCounter* dependency, JobFunction function, void* data, uint32_t begin, uint32_t end,
+                 const char* name, JobCounter* counter)
+{
+    Job* job = allocateJob(system, function, data, begin, end, name, counter);
+
+    uint32_t value = dependency->value.load(std::memory_order_acquire);
+
+    // NOTE: the job that takes the count to zero empties the waiters under the lock, so either it sees this job or we
+    // see zero
+    while (value != 0)
+    {
+        if (value & JOB_COUNTER_LOCKED)
+        {
+            std::this_thread::yield();
+            value = dependency->value.load(std::memory_order_acquire);
+            continue;
+        }
+
+        if (dependency->value.compare_exchange_weak(value, value | JOB_COUNTER_LOCKED, std::memory_order_acquire, std::memory_order_acquire))
+        {
+            job->next = dependency->waiters;
+            dependency->waiters = job;
+
+            dependency->value.fetch_and(~JOB_COUNTER_LOCKED, std::memory_order_release);
+            return;
+        }
+    }
+
+    submitJob(system, job);
+}
+
+// NOTE: runs jobs on the calling thread until counter reaches zero
+void waitForCounter(JobSystem& system, JobCounter* counter)
+{
+    TRACE_ZONE("waitForCounter");
+
+    assert(jobWorkerIndex < system.workers.size());
+
+    while (counter->value.load(std::memory_order_acquire) != 0)
+    {
+        if (Job* job = findJob(system, jobWorkerIndex))
+            executeJob(system, job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+// NOTE: calls function(data, begin, end) for consecutive ranges of at most groupSize out of [0, count) and waits for
+// all of them; the calling thread works on them as well
+void parallelFor(JobSystem& system, uint32_t count, uint32_t groupSize, JobFunction function, void* data, const char* name)
+{
+    assert(groupSize > 0);
+
+    JobCounter counter;
+
+    for (uint32_t begin = 0; begin < count; begin += groupSize)
+        runJob(system, function, data, begin, std::min(begin + groupSize, count), name, &counter);
+
+    waitForCounter(system, &counter);
+}
+
+uint32_t getJobWorkerCount(const JobSystem& system)
+{
+    return uint32_t(system.workers.size());
+}
+
+// NOTE: totals of every worker since the job system was created, subtract two of them to measure a section
+JobStats getJobStats(const JobSystem& system)
+{
+    JobStats result = {};
+
+    for (size_t i = 0; i < system.workers.size(); i++)
+    {
+        const JobWorker& worker = *system.workers[i];
+
+        result.jobCount += worker.jobCount.load(std::memory_order_relaxed);
+        result.stealCount += worker.stealCount.load(std::memory_order_relaxed);
+        result.failedStealCount += worker.failedStealCount.load(std::memory_order_relaxed);
+        result.busyNs += worker.busyNs.load(std::memory_order_relaxed);
+    }
+
+    return result;
+}
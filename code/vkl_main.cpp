@@ -1,14 +1,32 @@
 #include <iostream>
 #include <assert.h>
+#include <string.h>
+#include <float.h>
 
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
-#include <GLFW/glfw3.h>
-#include <GLFW/glfw3native.h>
 #define VOLK_IMPLEMENTATION
 #include <volk.h>
 
+// NOTE: after volk so that GLFW sees the Vulkan types and declares glfwCreateWindowSurface
+#include <GLFW/glfw3.h>
+#ifdef _WIN32
+#include <GLFW/glfw3native.h>
+#endif
+
 #define FAST_OBJ_IMPLEMENTATION
 #include <fast_obj.h>
 #include <meshoptimizer.h>
@@ -25,7 +43,16 @@
 #define ARRAYSIZE(array) (sizeof(array) / sizeof((array)[0]))
 #endif
 
-VkInstance createInstance()
+#define MAX_FRAMES_IN_FLIGHT 4
+
+#include "vkl_memory.h"
+#include "vkl_benchmark.h"
+#include "vkl_profiler.h"
+#include "vkl_trace.h"
+#include "vkl_jobs.h"
+#include "vkl_microbench.h"
+
+VkInstance createInstance(bool headless)
 {
     // TODO: In real Vulkan application you should probably check if 1.2 is available via vkEnumerateInstanceVersion
     VkApplicationInfo appInfo = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
@@ -44,18 +71,27 @@ VkInstance createInstance()
     createInfo.enabledLayerCount = ARRAYSIZE(debugLayers);
 #endif
 
-    const char* extensions[] =
-    {
-        VK_KHR_SURFACE_EXTENSION_NAME,
+    std::vector<const char*> extensions;
 
+    // NOTE: headless instances don't need any window system integration, so they work without a display
+    if (!headless)
+    {
 #ifdef VK_USE_PLATFORM_WIN32_KHR
-        VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
+        extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+        extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+#else
+        uint32_t windowExtensionCount = 0;
+        const char** windowExtensions = glfwGetRequiredInstanceExtensions(&windowExtensionCount);
+        assert(windowExtensions);
+
+        extensions.insert(extensions.end(), windowExtensions, windowExtensions + windowExtensionCount);
 #endif
-        VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
-    };
+    }
 
-    createInfo.ppEnabledExtensionNames = extensions;
-    createInfo.enabledExtensionCount = ARRAYSIZE(extensions);
+    extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+
+    createInfo.ppEnabledExtensionNames = extensions.data();
+    createInfo.enabledExtensionCount = uint32_t(extensions.size());
 
     VkInstance instance = 0;
     VK_CHECK(vkCreateInstance(&createInfo, 0, &instance));
@@ -111,6 +147,48 @@ uint32_t getGraphicsFamilyIndex(VkPhysicalDevice physicalDevice)
     return VK_QUEUE_FAMILY_IGNORED;
 }
 
+// NOTE: a family that can only copy, which on discrete GPUs is backed by DMA engines that run next to the graphics
+// queue; VK_QUEUE_FAMILY_IGNORED when there is none (integrated GPUs usually only have the graphics family)
+uint32_t getTransferFamilyIndex(VkPhysicalDevice physicalDevice)
+{
+    uint32_t queueFamilyPropertyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, 0);
+
+    std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyPropertyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, queueFamilyProperties.data());
+
+    for (uint32_t i = 0; i < queueFamilyPropertyCount; i++)
+    {
+        VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            return i;
+    }
+
+    return VK_QUEUE_FAMILY_IGNORED;
+}
+
+// NOTE: a family that can dispatch but not draw, on most discrete GPUs its queues run compute work next to the graphics
+// queue (async compute); VK_QUEUE_FAMILY_IGNORED when there is none
+uint32_t getComputeFamilyIndex(VkPhysicalDevice physicalDevice)
+{
+    uint32_t queueFamilyPropertyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, 0);
+
+    std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyPropertyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, queueFamilyProperties.data());
+
+    for (uint32_t i = 0; i < queueFamilyPropertyCount; i++)
+    {
+        VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+            return i;
+    }
+
+    return VK_QUEUE_FAMILY_IGNORED;
+}
+
 bool supportsPresentation(VkPhysicalDevice physicalDevice, uint32_t familyIndex)
 {
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
@@ -120,7 +198,7 @@ bool supportsPresentation(VkPhysicalDevice physicalDevice, uint32_t familyIndex)
 #endif
 }
 
-VkPhysicalDevice pickPhysicalDevice(VkPhysicalDevice *physicalDevices, uint32_t physicalDeviceCount)
+VkPhysicalDevice pickPhysicalDevice(VkPhysicalDevice *physicalDevices, uint32_t physicalDeviceCount, bool headless)
 {
     VkPhysicalDevice discrete = 0;
     VkPhysicalDevice fallback = 0;
@@ -136,7 +214,7 @@ VkPhysicalDevice pickPhysicalDevice(VkPhysicalDevice *physicalDevices, uint32_t
         if (familyIndex == VK_QUEUE_FAMILY_IGNORED)
             continue;
 
-        if (!supportsPresentation(physicalDevices[i], familyIndex))
+        if (!headless && !supportsPresentation(physicalDevices[i], familyIndex))
             continue;
 
         if(!discrete && (props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU))
@@ -165,28 +243,162 @@ VkPhysicalDevice pickPhysicalDevice(VkPhysicalDevice *physicalDevices, uint32_t
     return result;
 }
 
-VkDevice createDevice(VkPhysicalDevice physicalDevice, uint32_t familyIndex)
+// NOTE: optional features, createDevice enables whatever is supported and the renderer picks its paths based on these
+struct DeviceFeatures
+{
+    // NOTE: multiDrawIndirect + drawIndirectFirstInstance + Vulkan 1.2 drawIndirectCount, for GPU generated draws
+    bool indirectCount;
+
+    // NOTE: mesh and task shaders, through VK_EXT_mesh_shader when the headers and the driver have it (meshShadingEXT)
+    // and VK_NV_mesh_shader otherwise; the EXT code only compiles in with headers (and volk) from 1.3.230 on
+    bool meshShading;
+    bool meshShadingEXT;
+
+    // NOTE: Vulkan 1.2 timeline semaphores, for synchronizing the graphics and the async compute queue
+    bool timelineSemaphores;
+};
+
+bool supportsDeviceExtension(VkPhysicalDevice physicalDevice, const char* name)
+{
+    uint32_t extensionCount = 0;
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, 0));
+
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, extensions.data()));
+
+    for (uint32_t i = 0; i < extensionCount; i++)
+        if (strcmp(extensions[i].extensionName, name) == 0)
+            return true;
+
+    return false;
+}
+
+void getDeviceFeatures(DeviceFeatures& result, VkPhysicalDevice physicalDevice)
+{
+    result = {};
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+    // NOTE: the 1.2 feature struct can't be chained for older devices
+    if (props.apiVersion < VK_API_VERSION_1_2)
+        return;
+
+    bool meshShaderExtension = supportsDeviceExtension(physicalDevice, VK_NV_MESH_SHADER_EXTENSION_NAME);
+
+    VkPhysicalDeviceMeshShaderFeaturesNV meshFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_NV };
+
+    VkPhysicalDeviceVulkan12Features features12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+    features12.pNext = meshShaderExtension ? &meshFeatures : 0;
+
+#if defined(VK_EXT_mesh_shader)
+    bool meshShaderExtensionEXT = supportsDeviceExtension(physicalDevice, VK_EXT_MESH_SHADER_EXTENSION_NAME);
+
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshFeaturesEXT = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+
+    if (meshShaderExtensionEXT)
+    {
+        meshFeaturesEXT.pNext = features12.pNext;
+        features12.pNext = &meshFeaturesEXT;
+    }
+#endif
+
+    VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+    features.pNext = &features12;
+
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    result.indirectCount = features.features.multiDrawIndirect && features.features.drawIndirectFirstInstance && features12.drawIndirectCount;
+    result.meshShading = meshShaderExtension && meshFeatures.taskShader && meshFeatures.meshShader;
+    result.timelineSemaphores = features12.timelineSemaphore;
+
+#if defined(VK_EXT_mesh_shader)
+    result.meshShadingEXT = meshShaderExtensionEXT && meshFeaturesEXT.taskShader && meshFeaturesEXT.meshShader;
+    result.meshShading = result.meshShading || result.meshShadingEXT;
+#endif
+}
+
+// NOTE: one queue of the graphics family, plus one of the transfer and the compute family unless they're
+// VK_QUEUE_FAMILY_IGNORED
+VkDevice createDevice(VkPhysicalDevice physicalDevice, uint32_t familyIndex, uint32_t transferFamilyIndex, uint32_t computeFamilyIndex,
+                      const DeviceFeatures& deviceFeatures, bool headless)
 {
     float queuePriorities[] = { 1.0f };
-    
-    VkDeviceQueueCreateInfo queueInfo = { VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
-    queueInfo.queueFamilyIndex = familyIndex;
-    queueInfo.queueCount = 1;
-    queueInfo.pQueuePriorities = queuePriorities;
 
-    const char* extensions[] = 
+    VkDeviceQueueCreateInfo queueInfos[3] = {};
+    uint32_t queueInfoCount = 0;
+
+    queueInfos[queueInfoCount].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfos[queueInfoCount].queueFamilyIndex = familyIndex;
+    queueInfos[queueInfoCount].queueCount = 1;
+    queueInfos[queueInfoCount].pQueuePriorities = queuePriorities;
+    queueInfoCount++;
+
+    if (transferFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
     {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-        VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME
-    };
+        queueInfos[queueInfoCount].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfos[queueInfoCount].queueFamilyIndex = transferFamilyIndex;
+        queueInfos[queueInfoCount].queueCount = 1;
+        queueInfos[queueInfoCount].pQueuePriorities = queuePriorities;
+        queueInfoCount++;
+    }
+
+    if (computeFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
+    {
+        queueInfos[queueInfoCount].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfos[queueInfoCount].queueFamilyIndex = computeFamilyIndex;
+        queueInfos[queueInfoCount].queueCount = 1;
+        queueInfos[queueInfoCount].pQueuePriorities = queuePriorities;
+        queueInfoCount++;
+    }
+
+    std::vector<const char*> extensions;
+    extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
+    if (!headless)
+        extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+    // NOTE: only one of the two mesh shader extensions is enabled, EXT when there is a choice
+    bool meshShadingNV = deviceFeatures.meshShading && !deviceFeatures.meshShadingEXT;
+
+    if (meshShadingNV)
+        extensions.push_back(VK_NV_MESH_SHADER_EXTENSION_NAME);
+
+    VkPhysicalDeviceMeshShaderFeaturesNV meshFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_NV };
+    meshFeatures.taskShader = meshShadingNV;
+    meshFeatures.meshShader = meshShadingNV;
+
+    VkPhysicalDeviceVulkan12Features features12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+    features12.drawIndirectCount = deviceFeatures.indirectCount;
+    features12.timelineSemaphore = deviceFeatures.timelineSemaphores;
+    features12.pNext = meshShadingNV ? &meshFeatures : 0;
+
+#if defined(VK_EXT_mesh_shader)
+    if (deviceFeatures.meshShadingEXT)
+        extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshFeaturesEXT = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+    meshFeaturesEXT.taskShader = deviceFeatures.meshShadingEXT;
+    meshFeaturesEXT.meshShader = deviceFeatures.meshShadingEXT;
+
+    if (deviceFeatures.meshShadingEXT)
+        features12.pNext = &meshFeaturesEXT;
+#endif
+
+    VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+    features.features.multiDrawIndirect = deviceFeatures.indirectCount;
+    features.features.drawIndirectFirstInstance = deviceFeatures.indirectCount;
+
+    // NOTE: all of them only get set for 1.2 devices
+    if (deviceFeatures.indirectCount || deviceFeatures.meshShading || deviceFeatures.timelineSemaphores)
+        features.pNext = &features12;
 
     VkDeviceCreateInfo createInfo = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
-    createInfo.queueCreateInfoCount = 1;
-    createInfo.pQueueCreateInfos = &queueInfo;
-    createInfo.enabledExtensionCount = 1;
-    createInfo.ppEnabledExtensionNames = extensions;
-    createInfo.enabledExtensionCount= ARRAYSIZE(extensions);
-    createInfo.ppEnabledExtensionNames = extensions;
+    createInfo.pNext = &features;
+    createInfo.queueCreateInfoCount = queueInfoCount;
+    createInfo.pQueueCreateInfos = queueInfos;
+    createInfo.enabledExtensionCount = uint32_t(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     VkDevice device = 0;
     VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, 0, &device));
@@ -204,7 +416,8 @@ VkSurfaceKHR createSurface(VkInstance instance, GLFWwindow* window)
     VkSurfaceKHR surface = 0;
     vkCreateWin32SurfaceKHR(instance, &createInfo, 0, &surface);
 #else
-#error Unsupported platform
+    VkSurfaceKHR surface = 0;
+    VK_CHECK(glfwCreateWindowSurface(instance, window, 0, &surface));
 #endif
 
     return surface;
@@ -229,6 +442,35 @@ VkFormat getSwapchainFormat(VkPhysicalDevice physicalDevice, VkSurfaceKHR surfac
     return formats[0].format;
 }
 
+VkFormat getDepthFormat(VkPhysicalDevice physicalDevice)
+{
+    // NOTE: D24S8 isn't available everywhere (AMD, most software rasterizers)
+    VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM };
+
+    for (uint32_t i = 0; i < ARRAYSIZE(candidates); i++)
+    {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, candidates[i], &props);
+
+        // NOTE: occlusion culling reads depth to build the depth pyramid
+        VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+        if ((props.optimalTilingFeatures & features) == features)
+            return candidates[i];
+    }
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+// NOTE: layout transitions of a combined depth/stencil image have to cover both aspects, views only sample depth
+VkImageAspectFlags getDepthAspectMask(VkFormat format)
+{
+    if ((format == VK_FORMAT_D16_UNORM_S8_UINT) || (format == VK_FORMAT_D24_UNORM_S8_UINT) || (format == VK_FORMAT_D32_SFLOAT_S8_UINT))
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+
+    return VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
 VkSwapchainKHR createSwapchain(VkDevice device, VkSurfaceKHR surface, VkSurfaceCapabilitiesKHR surfaceCaps, uint32_t familyIndex, VkFormat format, 
                                uint32_t width, uint32_t height, VkSwapchainKHR oldSwapchain = 0)
 {
@@ -268,6 +510,17 @@ VkSemaphore createSemaphore(VkDevice device)
     return semaphore;
 }
 
+VkFence createFence(VkDevice device)
+{
+    VkFenceCreateInfo createInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    createInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    VkFence fence = 0;
+    VK_CHECK(vkCreateFence(device, &createInfo, 0, &fence));
+
+    return fence;
+}
+
 VkCommandPool createCommandPool(VkDevice device, uint32_t familyIndex)
 {
     VkCommandPoolCreateInfo createInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
@@ -280,25 +533,27 @@ VkCommandPool createCommandPool(VkDevice device, uint32_t familyIndex)
     return commandPool;
 }
 
-VkRenderPass createRenderPass(VkDevice device, VkFormat format)
+// NOTE: loadContents continues rendering into attachments a previous pass left in the attachment layouts, e.g. the late
+// pass of occlusion culling; render passes only differing in load ops are compatible, so they share framebuffers
+VkRenderPass createRenderPass(VkDevice device, VkFormat format, VkFormat depthFormat, bool loadContents = false)
 {
     VkAttachmentDescription attachments[2] = {};
     attachments[0].format = format;
     attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-    attachments[1].format = VK_FORMAT_D24_UNORM_S8_UINT;
+    attachments[1].format = depthFormat;
     attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[1].loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[1].initialLayout = loadContents ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
     attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachments = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
@@ -310,11 +565,22 @@ VkRenderPass createRenderPass(VkDevice device, VkFormat format)
     subpass.pColorAttachments = &colorAttachments;
     subpass.pDepthStencilAttachment = &depthAttachments;
 
+    // NOTE: depth image is shared between frames in flight, so the next frame's clear has to wait for the previous frame's depth writes
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
     VkRenderPassCreateInfo createInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
     createInfo.attachmentCount = ARRAYSIZE(attachments);
     createInfo.pAttachments = attachments;
     createInfo.subpassCount = 1;
     createInfo.pSubpasses = &subpass;
+    createInfo.dependencyCount = 1;
+    createInfo.pDependencies = &dependency;
 
     VkRenderPass renderPass = 0;
     VK_CHECK(vkCreateRenderPass(device, &createInfo, 0, &renderPass));
@@ -322,14 +588,15 @@ VkRenderPass createRenderPass(VkDevice device, VkFormat format)
     return renderPass;
 }
 
-VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectMask)
+VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectMask, uint32_t baseMipLevel = 0, uint32_t levelCount = 1)
 {
     VkImageViewCreateInfo createInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
     createInfo.image = image;
     createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
     createInfo.format = format;
     createInfo.subresourceRange.aspectMask = aspectMask;
-    createInfo.subresourceRange.levelCount = 1;
+    createInfo.subresourceRange.baseMipLevel = baseMipLevel;
+    createInfo.subresourceRange.levelCount = levelCount;
     createInfo.subresourceRange.layerCount = 1;
 
     VkImageView view = 0;
@@ -358,6 +625,8 @@ VkFramebuffer createFramebuffer(VkDevice device, VkRenderPass renderPass, VkImag
 
 VkShaderModule loadShader(VkDevice device, const char *path)
 {
+    TRACE_ZONE("loadShader");
+
     FILE *file = fopen(path, "rb");
     assert(file);
 
@@ -384,160 +653,511 @@ VkShaderModule loadShader(VkDevice device, const char *path)
     return shaderModule;
 }
 
-VkPipelineLayout createPipelineLayout(VkDevice device)
+double getTimeMs()
 {
-    VkDescriptorSetLayoutBinding setBindings[1] = {};
-    setBindings[0].binding = 0;
-    setBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    setBindings[0].descriptorCount = 1;
-    setBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
 
-    VkDescriptorSetLayout setLayout = 0;
-    VkDescriptorSetLayoutCreateInfo setCreateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
-    setCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
-    setCreateInfo.bindingCount = ARRAYSIZE(setBindings);
-    setCreateInfo.pBindings = setBindings;
-    VK_CHECK(vkCreateDescriptorSetLayout(device, &setCreateInfo, 0, &setLayout));
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
 
-    VkPipelineLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
-    createInfo.setLayoutCount = 1;
-    createInfo.pSetLayouts = &setLayout;
+    // FNV-1a
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
 
-    VkPipelineLayout layout = 0;
-    VK_CHECK(vkCreatePipelineLayout(device, &createInfo, 0, &layout));
+    return hash;
+}
 
-    // TODO: is this safe? NOTE: IT IS NOT
-    // vkDestroyDescriptorSetLayout(device, setLayout, 0);
+bool readFile(std::vector<char>& result, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
 
-    return layout;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    result.resize(length > 0 ? size_t(length) : 0);
+    size_t rc = fread(result.data(), 1, result.size(), file);
+    fclose(file);
+
+    return rc == result.size();
 }
 
-VkPipeline createGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, VkRenderPass renderPass, VkShaderModule vs, VkShaderModule fs, VkPipelineLayout layout)
+// NOTE: writes into a temporary file first, so a crash mid-write never leaves a truncated file behind
+bool writeFileAtomic(const char* path, const void* data, size_t size)
 {
-    VkGraphicsPipelineCreateInfo createInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+    char tempPath[1024];
+    snprintf(tempPath, ARRAYSIZE(tempPath), "%s.tmp", path);
 
-    VkPipelineShaderStageCreateInfo stages[2] = {};
-    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    stages[0].module = vs;
-    stages[0].pName = "main";
-    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    stages[1].module = fs;
-    stages[1].pName = "main";
-
-    createInfo.stageCount = ARRAYSIZE(stages);
-    createInfo.pStages = stages;
+    FILE* file = fopen(tempPath, "wb");
+    if (!file)
+        return false;
 
-    VkPipelineVertexInputStateCreateInfo vertexInput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
-    createInfo.pVertexInputState = &vertexInput;
+    size_t rc = fwrite(data, 1, size, file);
+    bool written = (rc == size) && (fflush(file) == 0);
+    fclose(file);
 
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    createInfo.pInputAssemblyState = &inputAssembly;
+    if (!written)
+    {
+        remove(tempPath);
+        return false;
+    }
 
-    VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
-    viewportState.viewportCount = 1;
-    viewportState.scissorCount = 1;
-    createInfo.pViewportState = &viewportState;
+#ifdef _WIN32
+    return MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(tempPath, path) == 0;
+#endif
+}
 
-    VkPipelineRasterizationStateCreateInfo rasterizationState = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
-    rasterizationState.lineWidth = 1.0f;
-    createInfo.pRasterizationState = &rasterizationState;
+struct MappedFile
+{
+    void* data;
+    size_t size;
 
-    VkPipelineMultisampleStateCreateInfo multisampleState = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
-    multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    createInfo.pMultisampleState = &multisampleState;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
 
-    VkPipelineDepthStencilStateCreateInfo depthStencilTest = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
-    depthStencilTest.depthTestEnable = VK_TRUE;
-    depthStencilTest.depthWriteEnable = VK_TRUE;
-    depthStencilTest.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-    depthStencilTest.depthBoundsTestEnable = VK_FALSE;
-    depthStencilTest.stencilTestEnable = VK_FALSE;
-    depthStencilTest.minDepthBounds = 0.0f;
-    depthStencilTest.maxDepthBounds = 1.0f;
-    createInfo.pDepthStencilState = &depthStencilTest;
+bool mapFile(MappedFile& result, const char* path)
+{
+    result = {};
 
-    VkPipelineColorBlendAttachmentState colorAttachementState = {};
-    colorAttachementState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
 
-    VkPipelineColorBlendStateCreateInfo colorBlendState = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
-    colorBlendState.attachmentCount = 1;
-    colorBlendState.pAttachments = &colorAttachementState;
-    createInfo.pColorBlendState = &colorBlendState;
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(file, &size) || (size.QuadPart == 0))
+    {
+        CloseHandle(file);
+        return false;
+    }
 
-    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+    if (!data)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
 
-    VkPipelineDynamicStateCreateInfo dynamicState = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
-    dynamicState.dynamicStateCount = ARRAYSIZE(dynamicStates);
-    dynamicState.pDynamicStates = dynamicStates;
-    createInfo.pDynamicState = &dynamicState;
+    result.data = data;
+    result.size = size_t(size.QuadPart);
+    result.file = file;
+    result.mapping = mapping;
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
 
-    createInfo.layout = layout;
-    createInfo.renderPass = renderPass;
-    
-    VkPipeline pipeline = 0;
-    VK_CHECK(vkCreateGraphicsPipelines(device, pipelineCache, 1, &createInfo, 0, &pipeline));
+    struct stat info = {};
+    if ((fstat(file, &info) != 0) || (info.st_size == 0))
+    {
+        close(file);
+        return false;
+    }
 
-    return pipeline;
-}
+    void* data = mmap(0, size_t(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
 
-VkImageMemoryBarrier imageBarrier(VkImage image, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkImageLayout oldLayout, VkImageLayout newLayout)
-{
-    VkImageMemoryBarrier result = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+    if (data == MAP_FAILED)
+        return false;
 
-    result.srcAccessMask = srcAccessMask;
-    result.dstAccessMask = dstAccessMask;
-    result.oldLayout = oldLayout;
-    result.newLayout = newLayout;
-    result.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    result.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    result.image = image;
-    result.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    result.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-    result.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    result.data = data;
+    result.size = size_t(info.st_size);
+#endif
 
-    return result;
+    return true;
 }
 
-uint32_t selectMemoryType(const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t memoryTypeBits, VkMemoryPropertyFlags flags)
+void unmapFile(MappedFile& file)
 {
-    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
-        if (((memoryTypeBits & (1 << i)) != 0) && ((memoryProperties.memoryTypes[i].propertyFlags & flags) == flags))
-            return i;
+    if (!file.data)
+        return;
 
-    assert(!"No compatible memory type found!");
-    return UINT32_MAX;
-}
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle(file.mapping);
+    CloseHandle(file.file);
+#else
+    munmap(file.data, file.size);
+#endif
 
-struct Swapchain
-{
-    VkSwapchainKHR swapchain;
+    file = {};
+}
 
-    std::vector<VkImage> images;
-    std::vector<VkImageView> imageViews;
-    std::vector<VkFramebuffer> framebuffers;
+#define PIPELINE_CACHE_MAGIC 0x504c4b56 // 'VKLP'
 
-    uint32_t width, height;
-    uint32_t imageCount;
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t driverVersion;
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
 
-    VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
+// NOTE: layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE that every driver puts in front of its cache data
+struct PipelineCacheHeader
+{
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
 };
 
-void createSwapchain(Swapchain &result, VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t familyIndex, 
-                     VkFormat format, VkRenderPass renderPass, const VkPhysicalDeviceMemoryProperties& memoryProperties, VkSwapchainKHR oldSwapchain = 0)
+bool validatePipelineCacheData(const std::vector<char>& file, const VkPhysicalDeviceProperties& props)
 {
-    VkSurfaceCapabilitiesKHR surfaceCaps;
-    VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCaps));
+    if (file.size() < sizeof(PipelineCacheFileHeader) + sizeof(PipelineCacheHeader))
+        return false;
 
-    uint32_t width = surfaceCaps.currentExtent.width;
-    uint32_t height = surfaceCaps.currentExtent.height;
+    PipelineCacheFileHeader fileHeader;
+    memcpy(&fileHeader, file.data(), sizeof(fileHeader));
 
-    VkSwapchainKHR swapchain = createSwapchain(device, surface, surfaceCaps, familyIndex, format, width, height, oldSwapchain);
-    assert(swapchain);
+    if ((fileHeader.magic != PIPELINE_CACHE_MAGIC) || (fileHeader.driverVersion != props.driverVersion))
+        return false;
+
+    if (fileHeader.dataSize != file.size() - sizeof(fileHeader))
+        return false;
+
+    const char* data = file.data() + sizeof(fileHeader);
+    if (fileHeader.dataHash != hashBytes(data, fileHeader.dataSize))
+        return false;
+
+    PipelineCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    return (header.headerSize >= sizeof(header)) && (header.headerSize <= fileHeader.dataSize) &&
+           (header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+           (header.vendorID == props.vendorID) && (header.deviceID == props.deviceID) &&
+           (memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+}
+
+VkPipelineCache loadPipelineCache(VkDevice device, const VkPhysicalDeviceProperties& props, const char* path, bool* warm)
+{
+    TRACE_ZONE("loadPipelineCache");
+
+    std::vector<char> file;
+    bool valid = readFile(file, path) && validatePipelineCacheData(file, props);
+
+    if (!valid && !file.empty())
+        printf("Pipeline cache %s is stale or corrupted, discarding\n", path);
+
+    VkPipelineCacheCreateInfo createInfo = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    if (valid)
+    {
+        createInfo.initialDataSize = file.size() - sizeof(PipelineCacheFileHeader);
+        createInfo.pInitialData = file.data() + sizeof(PipelineCacheFileHeader);
+    }
+
+    VkPipelineCache pipelineCache = 0;
+    VK_CHECK(vkCreatePipelineCache(device, &createInfo, 0, &pipelineCache));
+
+    *warm = valid;
+    return pipelineCache;
+}
+
+bool savePipelineCache(VkDevice device, VkPipelineCache pipelineCache, const VkPhysicalDeviceProperties& props, const char* path)
+{
+    TRACE_ZONE("savePipelineCache");
+
+    size_t dataSize = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &dataSize, 0));
+
+    std::vector<char> file(sizeof(PipelineCacheFileHeader) + dataSize);
+    VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &dataSize, file.data() + sizeof(PipelineCacheFileHeader)));
+    file.resize(sizeof(PipelineCacheFileHeader) + dataSize);
+
+    PipelineCacheFileHeader fileHeader = {};
+    fileHeader.magic = PIPELINE_CACHE_MAGIC;
+    fileHeader.driverVersion = props.driverVersion;
+    fileHeader.dataSize = dataSize;
+    fileHeader.dataHash = hashBytes(file.data() + sizeof(PipelineCacheFileHeader), dataSize);
+    memcpy(file.data(), &fileHeader, sizeof(fileHeader));
+
+    return writeFileAtomic(path, file.data(), file.size());
+}
+
+// NOTE: bindings are consecutive starting at 0, one descriptor of the given type each, all visible to the given stages
+VkDescriptorSetLayout createSetLayout(VkDevice device, const VkDescriptorType* descriptorTypes, uint32_t bindingCount, VkShaderStageFlags stageFlags)
+{
+    std::vector<VkDescriptorSetLayoutBinding> setBindings(bindingCount);
+    for (uint32_t i = 0; i < bindingCount; i++)
+    {
+        setBindings[i] = {};
+        setBindings[i].binding = i;
+        setBindings[i].descriptorType = descriptorTypes[i];
+        setBindings[i].descriptorCount = 1;
+        setBindings[i].stageFlags = stageFlags;
+    }
+
+    VkDescriptorSetLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    createInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+    createInfo.bindingCount = bindingCount;
+    createInfo.pBindings = setBindings.data();
+
+    VkDescriptorSetLayout setLayout = 0;
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &createInfo, 0, &setLayout));
+
+    return setLayout;
+}
+
+VkDescriptorSetLayout createSetLayout(VkDevice device, uint32_t storageBufferCount, VkShaderStageFlags stageFlags)
+{
+    std::vector<VkDescriptorType> descriptorTypes(storageBufferCount, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+    return createSetLayout(device, descriptorTypes.data(), storageBufferCount, stageFlags);
+}
+
+// NOTE: the set layout is needed for pushing descriptors, so it has to outlive the pipeline layout
+VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout setLayout, VkShaderStageFlags pushConstantStages, uint32_t pushConstantSize)
+{
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = pushConstantStages;
+    pushConstantRange.size = pushConstantSize;
+
+    VkPipelineLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+    createInfo.setLayoutCount = 1;
+    createInfo.pSetLayouts = &setLayout;
+    createInfo.pushConstantRangeCount = pushConstantSize ? 1 : 0;
+    createInfo.pPushConstantRanges = &pushConstantRange;
+
+    VkPipelineLayout layout = 0;
+    VK_CHECK(vkCreatePipelineLayout(device, &createInfo, 0, &layout));
+
+    return layout;
+}
+
+VkPipelineShaderStageCreateInfo shaderStage(VkShaderStageFlagBits stage, VkShaderModule module, const VkSpecializationInfo* specialization = 0)
+{
+    VkPipelineShaderStageCreateInfo result = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+    result.stage = stage;
+    result.module = module;
+    result.pName = "main";
+    result.pSpecializationInfo = specialization;
+
+    return result;
+}
+
+// NOTE: vertex + fragment or task + mesh + fragment stages, mesh pipelines ignore the vertex input and input assembly state
+VkPipeline createGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, VkRenderPass renderPass, const VkPipelineShaderStageCreateInfo* stages,
+                                  uint32_t stageCount, VkPipelineLayout layout)
+{
+    TRACE_ZONE("createGraphicsPipeline");
+
+    VkGraphicsPipelineCreateInfo createInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+    createInfo.stageCount = stageCount;
+    createInfo.pStages = stages;
+
+    VkPipelineVertexInputStateCreateInfo vertexInput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+    createInfo.pVertexInputState = &vertexInput;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    createInfo.pInputAssemblyState = &inputAssembly;
+
+    VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+    createInfo.pViewportState = &viewportState;
+
+    // NOTE: loadMesh mirrors Z, which turns the counter-clockwise OBJ triangles clockwise; meshlet cone culling relies on this too
+    VkPipelineRasterizationStateCreateInfo rasterizationState = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+    rasterizationState.lineWidth = 1.0f;
+    rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizationState.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    createInfo.pRasterizationState = &rasterizationState;
+
+    VkPipelineMultisampleStateCreateInfo multisampleState = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+    multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    createInfo.pMultisampleState = &multisampleState;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilTest = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+    depthStencilTest.depthTestEnable = VK_TRUE;
+    depthStencilTest.depthWriteEnable = VK_TRUE;
+    depthStencilTest.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    depthStencilTest.depthBoundsTestEnable = VK_FALSE;
+    depthStencilTest.stencilTestEnable = VK_FALSE;
+    depthStencilTest.minDepthBounds = 0.0f;
+    depthStencilTest.maxDepthBounds = 1.0f;
+    createInfo.pDepthStencilState = &depthStencilTest;
+
+    VkPipelineColorBlendAttachmentState colorAttachementState = {};
+    colorAttachementState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendState = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+    colorBlendState.attachmentCount = 1;
+    colorBlendState.pAttachments = &colorAttachementState;
+    createInfo.pColorBlendState = &colorBlendState;
+
+    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicState = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+    dynamicState.dynamicStateCount = ARRAYSIZE(dynamicStates);
+    dynamicState.pDynamicStates = dynamicStates;
+    createInfo.pDynamicState = &dynamicState;
+
+    createInfo.layout = layout;
+    createInfo.renderPass = renderPass;
+    
+    VkPipeline pipeline = 0;
+    VK_CHECK(vkCreateGraphicsPipelines(device, pipelineCache, 1, &createInfo, 0, &pipeline));
+
+    return pipeline;
+}
+
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache, VkShaderModule cs, VkPipelineLayout layout)
+{
+    TRACE_ZONE("createComputePipeline");
+
+    VkComputePipelineCreateInfo createInfo = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+    createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    createInfo.stage.module = cs;
+    createInfo.stage.pName = "main";
+    createInfo.layout = layout;
+
+    VkPipeline pipeline = 0;
+    VK_CHECK(vkCreateComputePipelines(device, pipelineCache, 1, &createInfo, 0, &pipeline));
+
+    return pipeline;
+}
+
+VkImageMemoryBarrier imageBarrier(VkImage image, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkImageLayout oldLayout, VkImageLayout newLayout,
+                                  VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT)
+{
+    VkImageMemoryBarrier result = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+
+    result.srcAccessMask = srcAccessMask;
+    result.dstAccessMask = dstAccessMask;
+    result.oldLayout = oldLayout;
+    result.newLayout = newLayout;
+    result.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    result.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    result.image = image;
+    result.subresourceRange.aspectMask = aspectMask;
+    result.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    result.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+    return result;
+}
+
+struct Image
+{
+    VkImage image;
+    VkImageView imageView;
+    Allocation allocation;
+};
+
+// NOTE: the image view covers all mip levels
+void createImage(Image& result, VkDevice device, MemoryAllocator& allocator, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage)
+{
+    VkImageCreateInfo createInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+    createInfo.imageType = VK_IMAGE_TYPE_2D;
+    createInfo.format = format;
+    createInfo.extent.width = width;
+    createInfo.extent.height = height;
+    createInfo.extent.depth = 1;
+    createInfo.mipLevels = mipLevels;
+    createInfo.arrayLayers = 1;
+    createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    createInfo.usage = usage;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImage image = 0;
+    VK_CHECK(vkCreateImage(device, &createInfo, 0, &image));
+    assert(image);
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+    Allocation allocation = {};
+    allocateMemory(allocation, allocator, memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+
+    VK_CHECK(vkBindImageMemory(device, image, allocation.memory, allocation.offset));
+
+    VkImageAspectFlags aspectMask = (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+
+    VkImageView imageView = createImageView(device, image, format, aspectMask, 0, mipLevels);
+    assert(imageView);
+
+    result.image = image;
+    result.imageView = imageView;
+    result.allocation = allocation;
+}
+
+void destroyImage(const Image& image, VkDevice device, MemoryAllocator& allocator)
+{
+    vkDestroyImageView(device, image.imageView, 0);
+    vkDestroyImage(device, image.image, 0);
+    freeMemory(allocator, image.allocation);
+}
+
+// NOTE: nearest filtering, shaders only use texelFetch on it
+VkSampler createSampler(VkDevice device)
+{
+    VkSamplerCreateInfo createInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+    createInfo.magFilter = VK_FILTER_NEAREST;
+    createInfo.minFilter = VK_FILTER_NEAREST;
+    createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    createInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    VkSampler sampler = 0;
+    VK_CHECK(vkCreateSampler(device, &createInfo, 0, &sampler));
+
+    return sampler;
+}
+
+struct Swapchain
+{
+    VkSwapchainKHR swapchain;
+
+    std::vector<VkImage> images;
+    std::vector<VkImageView> imageViews;
+    std::vector<VkFramebuffer> framebuffers;
+
+    // NOTE: signaled by the frame's last submission and waited on by the present of the same image; the present has no
+    // fence, so the semaphore is only known to be free again once that image is acquired again, not when the frame
+    // slot comes around. Empty in headless mode, where nothing is presented
+    std::vector<VkSemaphore> releaseSemaphores;
+
+    // NOTE: only used in headless mode, where there is no VkSwapchainKHR to own the images
+    std::vector<Image> offscreenImages;
+
+    uint32_t width, height;
+    uint32_t imageCount;
+
+    Image depthImage;
+};
+
+void createSwapchain(Swapchain &result, VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t familyIndex, 
+                     VkFormat format, VkFormat depthFormat, VkRenderPass renderPass, MemoryAllocator& allocator, VkSwapchainKHR oldSwapchain = 0)
+{
+    TRACE_ZONE("createSwapchain");
+
+    VkSurfaceCapabilitiesKHR surfaceCaps;
+    VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCaps));
+
+    uint32_t width = surfaceCaps.currentExtent.width;
+    uint32_t height = surfaceCaps.currentExtent.height;
+
+    VkSwapchainKHR swapchain = createSwapchain(device, surface, surfaceCaps, familyIndex, format, width, height, oldSwapchain);
+    assert(swapchain);
     
     uint32_t imageCount = 0;
     VK_CHECK(vkGetSwapchainImagesKHR(device, swapchain, &imageCount, 0));
@@ -552,447 +1172,4149 @@ void createSwapchain(Swapchain &result, VkPhysicalDevice physicalDevice, VkDevic
         assert(imageViews[i]);
     }
 
-    VkImageCreateInfo depthImageCreateInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
-    depthImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-    depthImageCreateInfo.format = VK_FORMAT_D24_UNORM_S8_UINT;
-    depthImageCreateInfo.extent.width = surfaceCaps.currentExtent.width;
-    depthImageCreateInfo.extent.height = surfaceCaps.currentExtent.height;
-    depthImageCreateInfo.extent.depth = 1;
-    depthImageCreateInfo.mipLevels = 1;
-    depthImageCreateInfo.arrayLayers = 1;
-    depthImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-    depthImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    depthImageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-    depthImageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    depthImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    Image depthImage = {};
+    createImage(depthImage, device, allocator, width, height, 1, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+    std::vector<VkFramebuffer> framebuffers(imageCount);
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        framebuffers[i] = createFramebuffer(device, renderPass, imageViews[i], depthImage.imageView, width, height);
+        assert(framebuffers[i]);
+    }
+
+    std::vector<VkSemaphore> releaseSemaphores(imageCount);
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        releaseSemaphores[i] = createSemaphore(device);
+        assert(releaseSemaphores[i]);
+    }
+
+    result.swapchain = swapchain;
 
-    VkImage depthImage = 0;
-    VK_CHECK(vkCreateImage(device, &depthImageCreateInfo, 0, &depthImage));
-    assert(depthImage);
+    result.images = images;
+    result.imageViews = imageViews;
+    result.framebuffers = framebuffers;
+    result.releaseSemaphores = releaseSemaphores;
+    result.offscreenImages.clear();
 
-    VkMemoryRequirements depthImageMemoryRequirements;
-    vkGetImageMemoryRequirements(device, depthImage, &depthImageMemoryRequirements);
+    result.width = width; 
+    result.height = height;
+    result.imageCount = imageCount;
 
-    uint32_t memoryTypeIndex = selectMemoryType(memoryProperties, depthImageMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    assert(memoryTypeIndex != UINT32_MAX);
+    result.depthImage = depthImage;
+}
 
-    VkMemoryAllocateInfo depthImageAllocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-    depthImageAllocateInfo.allocationSize = depthImageMemoryRequirements.size;
-    depthImageAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+void createOffscreenSwapchain(Swapchain& result, VkDevice device, VkFormat format, VkFormat depthFormat, VkRenderPass renderPass, MemoryAllocator& allocator,
+                              uint32_t width, uint32_t height, uint32_t imageCount)
+{
+    std::vector<Image> offscreenImages(imageCount);
+    std::vector<VkImage> images(imageCount);
+    std::vector<VkImageView> imageViews(imageCount);
 
-    VkDeviceMemory depthImageMemory = 0;
-    VK_CHECK(vkAllocateMemory(device, &depthImageAllocateInfo, 0, &depthImageMemory));
-    assert(depthImageMemory);
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        createImage(offscreenImages[i], device, allocator, width, height, 1, format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 
-    VK_CHECK(vkBindImageMemory(device, depthImage, depthImageMemory, 0));
+        images[i] = offscreenImages[i].image;
+        imageViews[i] = offscreenImages[i].imageView;
+    }
 
-    VkImageView depthImageView = 0;
-    depthImageView = createImageView(device, depthImage, VK_FORMAT_D24_UNORM_S8_UINT, VK_IMAGE_ASPECT_DEPTH_BIT);
-    assert(depthImageView);
+    Image depthImage = {};
+    createImage(depthImage, device, allocator, width, height, 1, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 
     std::vector<VkFramebuffer> framebuffers(imageCount);
     for (uint32_t i = 0; i < imageCount; i++)
     {
-        framebuffers[i] = createFramebuffer(device, renderPass, imageViews[i], depthImageView, width, height);
+        framebuffers[i] = createFramebuffer(device, renderPass, imageViews[i], depthImage.imageView, width, height);
         assert(framebuffers[i]);
     }
 
-    result.swapchain = swapchain;
+    result.swapchain = 0;
+
+    result.images = images;
+    result.imageViews = imageViews;
+    result.framebuffers = framebuffers;
+    result.releaseSemaphores.clear();
+    result.offscreenImages = offscreenImages;
+
+    result.width = width;
+    result.height = height;
+    result.imageCount = imageCount;
+
+    result.depthImage = depthImage;
+}
+
+void destroySwapchain(VkDevice device, MemoryAllocator& allocator, const Swapchain& swapchain)
+{
+    for (uint32_t i = 0; i < swapchain.imageCount; i++)
+        vkDestroyFramebuffer(device, swapchain.framebuffers[i], 0);
+
+    for (size_t i = 0; i < swapchain.releaseSemaphores.size(); i++)
+        vkDestroySemaphore(device, swapchain.releaseSemaphores[i], 0);
+
+    if (swapchain.swapchain)
+    {
+        for (uint32_t i = 0; i < swapchain.imageCount; i++)
+            vkDestroyImageView(device, swapchain.imageViews[i], 0);
+
+        vkDestroySwapchainKHR(device, swapchain.swapchain, 0);
+    }
+
+    for (size_t i = 0; i < swapchain.offscreenImages.size(); i++)
+        destroyImage(swapchain.offscreenImages[i], device, allocator);
+
+    destroyImage(swapchain.depthImage, device, allocator);
+}
+
+void resizeSwapchainIfNecessary(Swapchain& result, VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface,
+                                uint32_t familyIndex, VkFormat format, VkFormat depthFormat, VkRenderPass renderPass, MemoryAllocator& allocator)
+{
+    VkSurfaceCapabilitiesKHR surfaceCaps;
+    VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCaps));
+
+    uint32_t newWidth = surfaceCaps.currentExtent.width;
+    uint32_t newHeight = surfaceCaps.currentExtent.height;
+
+    if((newWidth == result.width) && (newHeight == result.height))
+        return;
+
+    Swapchain old = result;
+
+    createSwapchain(result, physicalDevice, device, surface, familyIndex, format, depthFormat, renderPass, allocator, old.swapchain);
+
+    VK_CHECK(vkDeviceWaitIdle(device));
+
+    destroySwapchain(device, allocator, old);
+}
+
+struct Vertex
+{
+    float vx, vy, vz;
+    float nx, ny, nz;
+    float tu, tv;
+};
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// NOTE: a run of consecutive triangles of the index buffer, small enough for a mesh shader workgroup.
+// The normal cone uses front face normals (clockwise winding, see createGraphicsPipeline), coneCutoff is the sine
+// of the cone's half angle, or above 1 when the triangles face too many directions to ever be culled together.
+// vertexOffset is where the meshlet's unique vertices start in the array built by buildMeshletGeometry.
+// Has to match Meshlet in the shaders.
+struct Meshlet
+{
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;
+
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+    uint32_t vertexOffset;
+};
+
+#define MESH_MAX_LODS 8
+
+// NOTE: a range of the mesh's index buffer, LOD 0 is the full mesh at the start of it; error is an upper bound of how
+// far the LOD's surface deviates from LOD 0, in mesh space. Has to match MeshLod in the shaders.
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+struct Mesh
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshLod> lods;
+};
+
+enum MeshProcessingFlags
+{
+    MESH_DEDUPLICATE = 1 << 0,
+    MESH_OPTIMIZE_VERTEX_CACHE = 1 << 1,
+    MESH_OPTIMIZE_OVERDRAW = 1 << 2,
+    MESH_OPTIMIZE_VERTEX_FETCH = 1 << 3,
+    MESH_STATISTICS = 1 << 4,
+    MESH_MESHLETS = 1 << 5,
+    MESH_LODS = 1 << 6,
+
+    MESH_PROCESSING_FULL = MESH_DEDUPLICATE | MESH_OPTIMIZE_VERTEX_CACHE | MESH_OPTIMIZE_OVERDRAW | MESH_OPTIMIZE_VERTEX_FETCH,
+};
+
+void printMeshStatistics(const char* label, const Mesh& mesh)
+{
+    // NOTE: 16 entry FIFO is meshoptimizer's default model of post-transform cache
+    meshopt_VertexCacheStatistics vcache = meshopt_analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), 16, 0, 0);
+    meshopt_VertexFetchStatistics vfetch = meshopt_analyzeVertexFetch(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), sizeof(Vertex));
+    meshopt_OverdrawStatistics overdraw = meshopt_analyzeOverdraw(mesh.indices.data(), mesh.indices.size(), &mesh.vertices[0].vx, mesh.vertices.size(), sizeof(Vertex));
+
+    printf("%s: %d vertices, %d triangles; %u vertex shader invocations, ACMR %.3f, ATVR %.3f; overfetch %.3f; overdraw %.3f\n",
+           label, int(mesh.vertices.size()), int(mesh.indices.size() / 3), vcache.vertices_transformed, vcache.acmr, vcache.atvr, vfetch.overfetch, overdraw.overdraw);
+}
+
+void computeMeshletBounds(Meshlet& meshlet, const Mesh& mesh)
+{
+    const uint32_t* indices = &mesh.indices[meshlet.firstIndex];
+    uint32_t indexCount = meshlet.triangleCount * 3;
+
+    vec3 boundsMin = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        const Vertex& v = mesh.vertices[indices[i]];
+
+        boundsMin = vec3(std::min(boundsMin.x, v.vx), std::min(boundsMin.y, v.vy), std::min(boundsMin.z, v.vz));
+        boundsMax = vec3(std::max(boundsMax.x, v.vx), std::max(boundsMax.y, v.vy), std::max(boundsMax.z, v.vz));
+    }
+
+    vec3 center = (boundsMin + boundsMax) * 0.5f;
+    float radius = 0.0f;
+
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        const Vertex& v = mesh.vertices[indices[i]];
+        radius = std::max(radius, Length(vec3(v.vx, v.vy, v.vz) - center));
+    }
+
+    // NOTE: front faces are clockwise, so the front normal is (c - a) x (b - a)
+    std::vector<vec3> normals;
+    normals.reserve(meshlet.triangleCount);
+
+    vec3 normalSum = vec3(0.0f, 0.0f, 0.0f);
+
+    for (uint32_t i = 0; i < indexCount; i += 3)
+    {
+        const Vertex& a = mesh.vertices[indices[i + 0]];
+        const Vertex& b = mesh.vertices[indices[i + 1]];
+        const Vertex& c = mesh.vertices[indices[i + 2]];
+
+        vec3 normal = Cross(vec3(c.vx - a.vx, c.vy - a.vy, c.vz - a.vz), vec3(b.vx - a.vx, b.vy - a.vy, b.vz - a.vz));
+
+        float length = Length(normal);
+        if (length == 0.0f)
+            continue;
+
+        normals.push_back(normal * (1.0f / length));
+        normalSum += normals.back();
+    }
+
+    vec3 axis = (LengthSq(normalSum) > 0.0f) ? Normalize(normalSum) : vec3(0.0f, 0.0f, 1.0f);
+
+    float minDot = normals.empty() ? -1.0f : 1.0f;
+    for (size_t i = 0; i < normals.size(); i++)
+        minDot = std::min(minDot, Dot(axis, normals[i]));
+
+    meshlet.center[0] = center.x;
+    meshlet.center[1] = center.y;
+    meshlet.center[2] = center.z;
+    meshlet.radius = radius;
+
+    meshlet.coneAxis[0] = axis.x;
+    meshlet.coneAxis[1] = axis.y;
+    meshlet.coneAxis[2] = axis.z;
+    meshlet.coneCutoff = (minDot > 0.0f) ? sqrtf(1.0f - minDot * minDot) : 2.0f;
+}
+
+// NOTE: greedy in index buffer order, which after the vertex cache optimization is already spatially coherent;
+// the triangle order isn't changed, so every meshlet can be drawn as a range of the regular index buffer
+void buildMeshlets(Mesh& mesh)
+{
+    TRACE_ZONE("buildMeshlets");
+
+    std::vector<uint32_t> vertexMeshlet(mesh.vertices.size(), ~0u);
+
+    Meshlet meshlet = {};
+    mesh.meshlets.clear();
+
+    for (size_t i = 0; i < mesh.indices.size(); i += 3)
+    {
+        uint32_t a = mesh.indices[i + 0];
+        uint32_t b = mesh.indices[i + 1];
+        uint32_t c = mesh.indices[i + 2];
+
+        uint32_t meshletIndex = uint32_t(mesh.meshlets.size());
+
+        uint32_t newVertices = (vertexMeshlet[a] != meshletIndex) + (vertexMeshlet[b] != meshletIndex && b != a) +
+                               (vertexMeshlet[c] != meshletIndex && c != a && c != b);
+
+        if ((meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES) || (meshlet.triangleCount + 1 > MESHLET_MAX_TRIANGLES))
+        {
+            computeMeshletBounds(meshlet, mesh);
+            mesh.meshlets.push_back(meshlet);
+
+            meshlet = {};
+            meshlet.firstIndex = uint32_t(i);
+
+            meshletIndex++;
+            newVertices = 1 + (b != a) + (c != a && c != b);
+        }
+
+        vertexMeshlet[a] = vertexMeshlet[b] = vertexMeshlet[c] = meshletIndex;
+
+        meshlet.vertexCount += newVertices;
+        meshlet.triangleCount++;
+    }
+
+    if (meshlet.triangleCount)
+    {
+        computeMeshletBounds(meshlet, mesh);
+        mesh.meshlets.push_back(meshlet);
+    }
+
+    uint32_t vertexOffset = 0;
+    for (size_t i = 0; i < mesh.meshlets.size(); i++)
+    {
+        mesh.meshlets[i].vertexOffset = vertexOffset;
+        vertexOffset += mesh.meshlets[i].vertexCount;
+    }
+}
+
+// NOTE: mesh shader input - the unique vertices of every meshlet, and per triangle its 3 meshlet local indices
+// packed into the low 24 bits of a word, in index buffer order so meshlet triangles start at firstIndex / 3
+void buildMeshletGeometry(std::vector<uint32_t>& vertices, std::vector<uint32_t>& triangles, const Meshlet* meshlets, size_t meshletCount,
+                          const uint32_t* indices, size_t vertexCount)
+{
+    TRACE_ZONE("buildMeshletGeometry");
+
+    vertices.clear();
+    triangles.clear();
+
+    // NOTE: meshlet local index of every vertex, only valid for the meshlet in vertexMeshlet
+    std::vector<uint32_t> vertexMeshlet(vertexCount, ~0u);
+    std::vector<uint8_t> localIndex(vertexCount);
+
+    for (size_t i = 0; i < meshletCount; i++)
+    {
+        const Meshlet& meshlet = meshlets[i];
+        assert(vertices.size() == meshlet.vertexOffset);
+
+        for (uint32_t j = 0; j < meshlet.triangleCount * 3; j += 3)
+        {
+            uint32_t triangle = 0;
+
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t index = indices[meshlet.firstIndex + j + k];
+
+                if (vertexMeshlet[index] != i)
+                {
+                    vertexMeshlet[index] = uint32_t(i);
+                    localIndex[index] = uint8_t(vertices.size() - meshlet.vertexOffset);
+                    vertices.push_back(index);
+                }
+
+                triangle |= uint32_t(localIndex[index]) << (k * 8);
+            }
+
+            triangles.push_back(triangle);
+        }
+    }
+}
+
+// NOTE: every LOD is simplified from LOD 0 down to half the triangles of the previous one; meshopt_simplify stops at
+// the error limit (relative to the mesh extents) first if it has to, so the limit is doubled until the target is met
+// and the limit that got there is the LOD's error. LODs share the vertex buffer and are appended to the index buffer.
+void buildLods(Mesh& mesh)
+{
+    TRACE_ZONE("buildLods");
+
+    float extentMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float extentMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        const float* position = &mesh.vertices[i].vx;
+
+        for (int k = 0; k < 3; k++)
+        {
+            extentMin[k] = std::min(extentMin[k], position[k]);
+            extentMax[k] = std::max(extentMax[k], position[k]);
+        }
+    }
+
+    float extent = std::max(std::max(extentMax[0] - extentMin[0], extentMax[1] - extentMin[1]), extentMax[2] - extentMin[2]);
+
+    std::vector<uint32_t> sourceIndices = mesh.indices;
+    std::vector<uint32_t> lodIndices(sourceIndices.size());
+
+    mesh.lods.clear();
+
+    MeshLod lod = { 0, uint32_t(sourceIndices.size()), 0.0f };
+    mesh.lods.push_back(lod);
+
+    float targetError = 1e-3f;
+
+    while (mesh.lods.size() < MESH_MAX_LODS)
+    {
+        size_t previousIndexCount = mesh.lods.back().indexCount;
+        size_t targetIndexCount = (previousIndexCount / 2) / 3 * 3;
+
+        size_t lodIndexCount = previousIndexCount;
+
+        for (; targetError <= 1.0f; targetError *= 2.0f)
+        {
+            lodIndexCount = meshopt_simplify(lodIndices.data(), sourceIndices.data(), sourceIndices.size(), &mesh.vertices[0].vx, mesh.vertices.size(),
+                                             sizeof(Vertex), targetIndexCount, targetError);
+
+            // NOTE: a quarter of slack, a LOD that got close enough isn't worth doubling the error for
+            if (lodIndexCount <= targetIndexCount + targetIndexCount / 4)
+                break;
+        }
+
+        // NOTE: the mesh can't be simplified any further without collapsing entirely
+        if ((targetError > 1.0f) || (lodIndexCount == 0) || (lodIndexCount >= previousIndexCount))
+            break;
+
+        meshopt_optimizeVertexCache(lodIndices.data(), lodIndices.data(), lodIndexCount, mesh.vertices.size());
+
+        lod.firstIndex = uint32_t(mesh.indices.size());
+        lod.indexCount = uint32_t(lodIndexCount);
+        lod.error = targetError * extent;
+        mesh.lods.push_back(lod);
+
+        mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.begin() + lodIndexCount);
+    }
+}
+
+bool loadMesh(Mesh& result, const char* path, uint32_t processing)
+{
+    TRACE_ZONE("loadMesh");
+
+    fastObjMesh* file = fast_obj_read(path);
+    if (!file)
+        return false;
+
+    size_t index_count = 0;
+    for (uint32_t i = 0; i < file->face_count; i++)
+    {
+        assert((file->face_vertices[i] == 3) || ((file->face_vertices[i] == 4)));
+        index_count += 3*(file->face_vertices[i] - 2);
+    }
+
+    size_t vertex_offset = 0;
+    size_t index_offset = 0;
+    std::vector<Vertex> vertices(index_count);
+    for (uint32_t i = 0; i < file->face_count; i++)
+    {
+        for(uint32_t j = 0; j < file->face_vertices[i]; j++)
+        {
+            if (j >= 3)
+            {
+                vertices[vertex_offset] = vertices[vertex_offset - 3];
+                vertices[vertex_offset + 1] = vertices[vertex_offset - 1];
+                vertex_offset += 2;
+            }
+
+            Vertex& vertex = vertices[vertex_offset++];
+
+            int vIndex = file->indices[index_offset].p;
+            int nIndex = file->indices[index_offset].n;
+            int tIndex = file->indices[index_offset].t;
+
+            vertex.vx = file->positions[3 * vIndex];
+            vertex.vy = file->positions[3 * vIndex + 1];
+            vertex.vz = -file->positions[3 * vIndex + 2];
+
+            vertex.nx = nIndex < 0 ? 0.0f : file->normals[3 * nIndex];
+            vertex.ny = nIndex < 0 ? 0.0f : file->normals[3 * nIndex + 1];
+            vertex.nz = nIndex < 0 ? 1.0f : file->normals[3 * nIndex + 2];
+
+            vertex.tu = tIndex < 0 ? 0.0f : file->texcoords[2 * tIndex];
+            vertex.tv = tIndex < 0 ? 0.0f : file->texcoords[2 * tIndex + 1];
+            
+            index_offset++;
+        }
+    }
+
+    assert(vertex_offset == index_count);
+
+    fast_obj_destroy(file);
+
+    if (processing & MESH_DEDUPLICATE)
+    {
+        std::vector<uint32_t> remap(index_count);
+        size_t unique_vertices = meshopt_generateVertexRemap(remap.data(), 0, index_count, vertices.data(), index_count, sizeof(Vertex));
+
+        result.vertices.resize(unique_vertices);
+        result.indices.resize(index_count);
+
+        meshopt_remapVertexBuffer(result.vertices.data(), vertices.data(), index_count, sizeof(Vertex), remap.data());
+        meshopt_remapIndexBuffer(result.indices.data(), 0, index_count, remap.data());
+    }
+    else
+    {
+        result.vertices = vertices;
+        result.indices.resize(index_count);
+
+        for (size_t i = 0; i < index_count; i++)
+            result.indices[i] = (uint32_t)i;
+    }
+
+    if (processing & MESH_STATISTICS)
+        printMeshStatistics("Mesh before optimization", result);
+
+    // NOTE: overdraw optimization reorders clusters produced by the vertex cache optimization, so the order of these matters
+    if (processing & MESH_OPTIMIZE_VERTEX_CACHE)
+        meshopt_optimizeVertexCache(result.indices.data(), result.indices.data(), result.indices.size(), result.vertices.size());
+
+    if (processing & MESH_OPTIMIZE_OVERDRAW)
+        meshopt_optimizeOverdraw(result.indices.data(), result.indices.data(), result.indices.size(), &result.vertices[0].vx, result.vertices.size(), sizeof(Vertex), 1.05f);
+
+    if (processing & MESH_OPTIMIZE_VERTEX_FETCH)
+        meshopt_optimizeVertexFetch(result.vertices.data(), result.indices.data(), result.indices.size(), result.vertices.data(), result.vertices.size(), sizeof(Vertex));
+
+    if (processing & MESH_STATISTICS)
+        printMeshStatistics("Mesh after optimization", result);
+
+    // NOTE: has to see the final triangle order
+    if (processing & MESH_MESHLETS)
+    {
+        buildMeshlets(result);
+
+        if (processing & MESH_STATISTICS)
+        {
+            size_t meshletVertices = 0;
+            for (size_t i = 0; i < result.meshlets.size(); i++)
+                meshletVertices += result.meshlets[i].vertexCount;
+
+            printf("Meshlets: %d, %.1f triangles and %.1f vertices on average\n", int(result.meshlets.size()),
+                   double(result.indices.size() / 3) / double(result.meshlets.size()), double(meshletVertices) / double(result.meshlets.size()));
+        }
+    }
+
+    // NOTE: after meshlets, which only cover LOD 0
+    if (processing & MESH_LODS)
+    {
+        buildLods(result);
+
+        if (processing & MESH_STATISTICS)
+            for (size_t i = 0; i < result.lods.size(); i++)
+                printf("LOD %d: %d triangles, error %f\n", int(i), int(result.lods[i].indexCount / 3), result.lods[i].error);
+    }
+    else
+    {
+        MeshLod lod = { 0, uint32_t(result.indices.size()), 0.0f };
+        result.lods.assign(1, lod);
+    }
+
+    return true;
+}
+
+#define MESH_FILE_MAGIC 0x4d4c4b56 // 'VKLM'
+#define MESH_FILE_VERSION 4
+
+// NOTE: baked mesh container, all arrays follow the header and are 16-byte aligned
+struct MeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    // NOTE: cache key - hash of the source file and the processing flags it was baked with
+    uint64_t sourceHash;
+    uint32_t processing;
+
+    uint32_t vertexSize;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t meshletCount;
+    uint32_t lodCount;
+
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t meshletOffset;
+    uint64_t lodOffset;
+};
+
+bool validateMeshFile(const MappedFile& file, uint64_t sourceHash, uint32_t processing)
+{
+    if (file.size < sizeof(MeshFileHeader))
+        return false;
+
+    const MeshFileHeader& header = *static_cast<const MeshFileHeader*>(file.data);
+
+    if ((header.magic != MESH_FILE_MAGIC) || (header.version != MESH_FILE_VERSION))
+        return false;
+
+    if ((header.sourceHash != sourceHash) || (header.processing != processing) || (header.vertexSize != sizeof(Vertex)))
+        return false;
+
+    return (header.vertexOffset + uint64_t(header.vertexCount) * header.vertexSize <= file.size) &&
+           (header.indexOffset + uint64_t(header.indexCount) * sizeof(uint32_t) <= file.size) &&
+           (header.meshletOffset + uint64_t(header.meshletCount) * sizeof(Meshlet) <= file.size) &&
+           (header.lodOffset + uint64_t(header.lodCount) * sizeof(MeshLod) <= file.size) && (header.lodCount > 0) &&
+           (header.vertexOffset % 16 == 0) && (header.indexOffset % 16 == 0) && (header.meshletOffset % 16 == 0) && (header.lodOffset % 16 == 0);
+}
+
+bool bakeMesh(const Mesh& mesh, const char* path, uint64_t sourceHash, uint32_t processing)
+{
+    TRACE_ZONE("bakeMesh");
+
+    MeshFileHeader header = {};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.sourceHash = sourceHash;
+    header.processing = processing;
+    header.vertexSize = sizeof(Vertex);
+    header.vertexCount = uint32_t(mesh.vertices.size());
+    header.indexCount = uint32_t(mesh.indices.size());
+    header.meshletCount = uint32_t(mesh.meshlets.size());
+    header.lodCount = uint32_t(mesh.lods.size());
+
+    size_t vertexDataSize = mesh.vertices.size() * sizeof(Vertex);
+    size_t indexDataSize = mesh.indices.size() * sizeof(uint32_t);
+    size_t meshletDataSize = mesh.meshlets.size() * sizeof(Meshlet);
+    size_t lodDataSize = mesh.lods.size() * sizeof(MeshLod);
+
+    header.vertexOffset = (sizeof(header) + 15) & ~15;
+    header.indexOffset = (header.vertexOffset + vertexDataSize + 15) & ~15;
+    header.meshletOffset = (header.indexOffset + indexDataSize + 15) & ~15;
+    header.lodOffset = (header.meshletOffset + meshletDataSize + 15) & ~15;
+
+    std::vector<char> file(header.lodOffset + lodDataSize);
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + header.vertexOffset, mesh.vertices.data(), vertexDataSize);
+    memcpy(file.data() + header.indexOffset, mesh.indices.data(), indexDataSize);
+    memcpy(file.data() + header.meshletOffset, mesh.meshlets.data(), meshletDataSize);
+    memcpy(file.data() + header.lodOffset, mesh.lods.data(), lodDataSize);
+
+    return writeFileAtomic(path, file.data(), file.size());
+}
+
+// NOTE: maps the baked version of the mesh, baking it first if it's missing or was built from a different source/processing
+bool loadMeshCached(MappedFile& result, const char* path, uint32_t processing)
+{
+    TRACE_ZONE("loadMeshCached");
+
+    MappedFile source = {};
+    if (!mapFile(source, path))
+        return false;
+
+    uint64_t sourceHash = hashBytes(source.data, source.size);
+    unmapFile(source);
+
+    char bakedPath[1024];
+    snprintf(bakedPath, ARRAYSIZE(bakedPath), "%s.vklmesh", path);
+
+    uint32_t bakedProcessing = processing & ~MESH_STATISTICS;
+
+    if (mapFile(result, bakedPath))
+    {
+        if (validateMeshFile(result, sourceHash, bakedProcessing))
+            return true;
+
+        unmapFile(result);
+    }
+
+    double bakeTimeBegin = getTimeMs();
+
+    Mesh mesh;
+    if (!loadMesh(mesh, path, processing))
+        return false;
+
+    if (!bakeMesh(mesh, bakedPath, sourceHash, bakedProcessing))
+    {
+        printf("ERROR: Failed to write %s\n", bakedPath);
+        return false;
+    }
+
+    printf("Baked %s in %.2f ms\n", bakedPath, getTimeMs() - bakeTimeBegin);
+
+    return mapFile(result, bakedPath) && validateMeshFile(result, sourceHash, bakedProcessing);
+}
+
+// NOTE: bounding sphere around the AABB center, positions are the first 3 floats of every vertex
+void computeMeshBounds(vec3& center, float& radius, const char* vertices, size_t vertexCount, size_t vertexSize)
+{
+    vec3 boundsMin = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const float* position = reinterpret_cast<const float*>(vertices + i * vertexSize);
+
+        boundsMin = vec3(std::min(boundsMin.x, position[0]), std::min(boundsMin.y, position[1]), std::min(boundsMin.z, position[2]));
+        boundsMax = vec3(std::max(boundsMax.x, position[0]), std::max(boundsMax.y, position[1]), std::max(boundsMax.z, position[2]));
+    }
+
+    center = (boundsMin + boundsMax) * 0.5f;
+    radius = 0.0f;
+
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const float* position = reinterpret_cast<const float*>(vertices + i * vertexSize);
+        radius = std::max(radius, Length(vec3(position[0], position[1], position[2]) - center));
+    }
+}
+
+// NOTE: 12 byte vertex: positions as 16 bit unorm within the mesh AABB, octahedral normals as 2 x 8 bit snorm
+// and half float texture coordinates. The vertex shader decodes it from the same storage buffer binding when
+// the PACKED_VERTICES specialization constant is set.
+struct PackedVertex
+{
+    uint16_t px, py, pz;
+    int8_t nx, ny;
+    uint16_t tu, tv;
+};
+
+// NOTE: position = offset + unorm * scale, passed to the shader in push constants
+struct VertexQuantization
+{
+    vec3 offset;
+    vec3 scale;
+};
+
+// NOTE: maps the unit sphere onto the [-1, 1] square, the lower hemisphere is folded over the diagonals
+vec2 encodeOctahedral(vec3 n)
+{
+    float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    vec2 result = vec2(n.x / sum, n.y / sum);
+
+    if (n.z < 0.0f)
+    {
+        float x = result.x;
+        result.x = (1.0f - fabsf(result.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        result.y = (1.0f - fabsf(x)) * (result.y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    return result;
+}
+
+// NOTE: same as decodeOctahedral in triangle.vert.glsl
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+    float t = std::max(-n.z, 0.0f);
+
+    n.x += (n.x >= 0.0f) ? -t : t;
+    n.y += (n.y >= 0.0f) ? -t : t;
+
+    return Normalize(n);
+}
+
+float dequantizeHalf(uint16_t h)
+{
+    int exponent = (h >> 10) & 0x1f;
+    int mantissa = h & 0x3ff;
+
+    float magnitude = (exponent == 0) ? ldexpf(float(mantissa), -24) : ldexpf(float(mantissa | 0x400), exponent - 25);
+    return (h & 0x8000) ? -magnitude : magnitude;
+}
+
+void packVertices(std::vector<PackedVertex>& result, VertexQuantization& quantization, const Vertex* vertices, size_t vertexCount)
+{
+    TRACE_ZONE("packVertices");
+
+    vec3 boundsMin = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const Vertex& v = vertices[i];
+
+        boundsMin = vec3(std::min(boundsMin.x, v.vx), std::min(boundsMin.y, v.vy), std::min(boundsMin.z, v.vz));
+        boundsMax = vec3(std::max(boundsMax.x, v.vx), std::max(boundsMax.y, v.vy), std::max(boundsMax.z, v.vz));
+    }
+
+    // NOTE: a flat axis would divide by zero
+    vec3 extent = boundsMax - boundsMin;
+    extent = vec3(std::max(extent.x, FLT_MIN), std::max(extent.y, FLT_MIN), std::max(extent.z, FLT_MIN));
+
+    quantization.offset = boundsMin;
+    quantization.scale = extent;
+
+    result.resize(vertexCount);
+
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const Vertex& v = vertices[i];
+        PackedVertex& pv = result[i];
+
+        pv.px = uint16_t(meshopt_quantizeUnorm((v.vx - boundsMin.x) / extent.x, 16));
+        pv.py = uint16_t(meshopt_quantizeUnorm((v.vy - boundsMin.y) / extent.y, 16));
+        pv.pz = uint16_t(meshopt_quantizeUnorm((v.vz - boundsMin.z) / extent.z, 16));
+
+        vec3 normal = vec3(v.nx, v.ny, v.nz);
+        vec2 octahedral = (LengthSq(normal) > 0.0f) ? encodeOctahedral(normal) : vec2(0.0f, 0.0f);
+
+        pv.nx = int8_t(meshopt_quantizeSnorm(octahedral.x, 8));
+        pv.ny = int8_t(meshopt_quantizeSnorm(octahedral.y, 8));
+
+        pv.tu = meshopt_quantizeHalf(v.tu);
+        pv.tv = meshopt_quantizeHalf(v.tv);
+    }
+}
+
+// NOTE: decodes every packed vertex like the shader does and compares it to the source
+void printPackedVertexQuality(const char* label, const PackedVertex* packed, const VertexQuantization& quantization, const Vertex* vertices, size_t vertexCount)
+{
+    float maxPositionError = 0.0f;
+    float maxNormalError = 0.0f;
+    float maxTexcoordError = 0.0f;
+
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const Vertex& v = vertices[i];
+        const PackedVertex& pv = packed[i];
+
+        vec3 position = quantization.offset + vec3(pv.px / 65535.0f * quantization.scale.x, pv.py / 65535.0f * quantization.scale.y, pv.pz / 65535.0f * quantization.scale.z);
+        maxPositionError = std::max(maxPositionError, Length(position - vec3(v.vx, v.vy, v.vz)));
+
+        vec3 normal = vec3(v.nx, v.ny, v.nz);
+        if (LengthSq(normal) > 0.0f)
+        {
+            vec3 decoded = decodeOctahedral(vec2(std::max(pv.nx / 127.0f, -1.0f), std::max(pv.ny / 127.0f, -1.0f)));
+            float cosine = Clamp(Dot(decoded, Normalize(normal)), -1.0f, 1.0f);
+            maxNormalError = std::max(maxNormalError, acosf(cosine) * 180.0f / PI);
+        }
+
+        maxTexcoordError = std::max(maxTexcoordError, std::max(fabsf(dequantizeHalf(pv.tu) - v.tu), fabsf(dequantizeHalf(pv.tv) - v.tv)));
+    }
+
+    float extent = Length(quantization.scale);
+
+    printf("%s: %d -> %d bytes/vertex, max position error %.3g (%.4f%% of extent), max normal error %.3f deg, max uv error %.3g\n",
+           label, int(sizeof(Vertex)), int(sizeof(PackedVertex)), maxPositionError, maxPositionError / extent * 100.0f, maxNormalError, maxTexcoordError);
+}
+
+// NOTE: per object data read by the vertex shader through gl_InstanceIndex, has to match MeshDraw in the shaders
+struct MeshDraw
+{
+    mat4 model;
+};
+
+// NOTE: push constants, has to match Globals in the shaders
+struct Globals
+{
+    mat4 viewProjection;
+
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+// NOTE: static objects with world space bounding spheres in SoA layout for culling
+struct Scene
+{
+    std::vector<MeshDraw> draws;
+
+    std::vector<float> boundsData;
+    spheres_soa bounds;
+
+    vec3 center;
+    float radius;
+};
+
+static float randomUnit(uint32_t& state)
+{
+    // NOTE: xorshift32, the scene has to be the same every run for benchmarks to be comparable
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return float(state & 0xffffff) / float(0xffffff);
+}
+
+void createScene(Scene& result, uint32_t objectCount, vec3 meshCenter, float meshRadius)
+{
+    TRACE_ZONE("createScene");
+
+    // NOTE: about one object per (3 * radius)^3, a single object sits at the origin
+    float side = (objectCount > 1) ? cbrtf(float(objectCount)) * meshRadius * 3.0f : 0.0f;
+    uint32_t seed = 0x6b43a9b5;
+
+    result.draws.resize(objectCount);
+
+    for (uint32_t i = 0; i < objectCount; i++)
+    {
+        vec3 position = (vec3(randomUnit(seed), randomUnit(seed), randomUnit(seed)) - vec3(0.5f, 0.5f, 0.5f)) * side;
+        float angle = (objectCount > 1) ? randomUnit(seed) * 360.0f : 0.0f;
+        float scale = (objectCount > 1) ? 0.75f + randomUnit(seed) * 0.5f : 1.0f;
+
+        result.draws[i].model = Translation(position) * Rotation(angle, vec3(0.0f, 1.0f, 0.0f)) * Scaling(scale) * Translation(-meshCenter);
+    }
+
+    // NOTE: world bounds are computed once with the batched transform, objects don't move
+    std::vector<float> transforms(16 * size_t(objectCount));
+    for (uint32_t i = 0; i < objectCount; i++)
+        for (uint32_t e = 0; e < 16; e++)
+            transforms[e * size_t(objectCount) + i] = result.draws[i].model.E[e];
+
+    mat4_soa models;
+    for (uint32_t e = 0; e < 16; e++)
+        models.E[e] = &transforms[e * size_t(objectCount)];
+
+    result.boundsData.resize(4 * size_t(objectCount));
+    result.bounds.X = &result.boundsData[0];
+    result.bounds.Y = &result.boundsData[size_t(objectCount)];
+    result.bounds.Z = &result.boundsData[2 * size_t(objectCount)];
+    result.bounds.Radius = &result.boundsData[3 * size_t(objectCount)];
+
+    std::vector<float> localData(4 * size_t(objectCount));
+    spheres_soa localBounds = { &localData[0], &localData[size_t(objectCount)], &localData[2 * size_t(objectCount)], &localData[3 * size_t(objectCount)] };
+
+    for (uint32_t i = 0; i < objectCount; i++)
+    {
+        localBounds.X[i] = meshCenter.x;
+        localBounds.Y[i] = meshCenter.y;
+        localBounds.Z[i] = meshCenter.z;
+        localBounds.Radius[i] = meshRadius;
+    }
+
+    TransformSpheres(models, localBounds, result.bounds, objectCount);
+
+    result.center = vec3(0.0f, 0.0f, 0.0f);
+    result.radius = side * 0.5f * sqrtf(3.0f) + meshRadius * 1.25f;
+}
+
+// NOTE: CPU reference of meshletcull.comp. Instead of moving every meshlet to world space, the planes and the camera are
+// moved to object space once per object, which keeps distances comparable as long as the scale is uniform.
+// Visible meshlets of an object that follow each other in the index buffer are merged into one draw.
+// Returns the number of visible triangles.
+uint64_t cullMeshlets(std::vector<VkDrawIndexedIndirectCommand>& result, const Meshlet* meshlets, uint32_t meshletCount, const MeshDraw* draws,
+                      const uint32_t* objects, uint32_t objectCount, const plane* frustumPlanes, vec3 cameraPosition)
+{
+    result.clear();
+
+    uint64_t triangleCount = 0;
+
+    for (uint32_t i = 0; i < objectCount; i++)
+    {
+        uint32_t objectIndex = objects[i];
+        const mat4& model = draws[objectIndex].model;
+
+        // NOTE: a world plane P is model^T * P in object space, scaled by the object scale
+        mat4 modelTranspose = Transpose(model);
+
+        plane localPlanes[FRUSTUM_PLANE_COUNT];
+        for (uint32_t p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+            localPlanes[p] = NormalizePlane(modelTranspose * vec4(frustumPlanes[p].N, frustumPlanes[p].D));
+
+        vec4 localCamera = InverseAffine(model) * vec4(cameraPosition, 1.0f);
+        vec3 camera = vec3(localCamera.x, localCamera.y, localCamera.z);
+
+        for (uint32_t m = 0; m < meshletCount; m++)
+        {
+            const Meshlet& meshlet = meshlets[m];
+
+            vec3 center = vec3(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+            vec3 coneAxis = vec3(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+
+            bool visible = true;
+
+            for (uint32_t p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+                visible = visible && (SignedDistance(localPlanes[p], center) > -meshlet.radius);
+
+            vec3 view = center - camera;
+            visible = visible && (Dot(view, coneAxis) < meshlet.coneCutoff * Length(view) + meshlet.radius);
+
+            if (!visible)
+                continue;
+
+            triangleCount += meshlet.triangleCount;
+
+            VkDrawIndexedIndirectCommand* last = result.empty() ? 0 : &result.back();
+
+            if (last && (last->firstInstance == objectIndex) && (last->firstIndex + last->indexCount == meshlet.firstIndex))
+            {
+                last->indexCount += meshlet.triangleCount * 3;
+            }
+            else
+            {
+                VkDrawIndexedIndirectCommand command = {};
+                command.indexCount = meshlet.triangleCount * 3;
+                command.instanceCount = 1;
+                command.firstIndex = meshlet.firstIndex;
+                command.firstInstance = objectIndex;
+
+                result.push_back(command);
+            }
+        }
+    }
+
+    return triangleCount;
+}
+
+// NOTE: ALL is plain frustum culling; with occlusion culling EARLY draws the objects visible last frame and LATE tests
+// every object against the depth pyramid built from the early pass, drawing the ones that just became visible
+enum DrawCullPhase
+{
+    DRAW_CULL_ALL,
+    DRAW_CULL_EARLY,
+    DRAW_CULL_LATE,
+};
+
+// NOTE: push constants of drawcull.comp, has to match DrawCullData there; culling happens in view space so the
+// frustum only takes the symmetric side planes (x and z, y and z of their normals) and the near and far distances
+struct DrawCullData
+{
+    mat4 view;
+    vec4 frustum;
+
+    float P00, P11, P22, P23;
+    float znear, zfar;
+    float lodTarget;
+
+    uint32_t objectCount;
+    uint32_t phase;
+};
+
+// NOTE: the coarsest LOD whose error, seen from distance, stays below lodTarget (the screen space threshold divided by
+// the pixels a unit covers at distance 1); errorScale takes LOD errors to world space. Errors only grow with the LOD.
+uint32_t selectLod(const MeshLod* lods, uint32_t lodCount, float errorScale, float distance, float lodTarget)
+{
+    uint32_t result = 0;
+
+    while ((result + 1 < lodCount) && (lods[result + 1].error * errorScale <= lodTarget * distance))
+        result++;
+
+    return result;
+}
+
+enum MeshletCulling
+{
+    MESHLET_CULLING_NONE,
+    MESHLET_CULLING_CPU,
+    MESHLET_CULLING_GPU,
+};
+
+// NOTE: capacity of the indirect command buffer filled by meshletcull.comp, anything past it is dropped
+#define MESHLET_CULL_MAX_COMMANDS (1024 * 1024)
+
+// NOTE: push constants of meshletcull.comp, has to match MeshletCullData there
+struct MeshletCullData
+{
+    vec4 frustum[FRUSTUM_PLANE_COUNT];
+    vec4 cameraPosition;
+
+    uint32_t meshletCount;
+    uint32_t objectCount;
+    uint32_t maxCommandCount;
+    uint32_t padding;
+};
+
+// NOTE: push constants of the mesh shading pipeline, the mesh shader reads the globals and the task shader culls with the rest
+struct MeshShadingData
+{
+    Globals globals;
+    MeshletCullData cull;
+};
+
+// NOTE: task shader workgroup size, each workgroup culls this many meshlets of one object
+#define MESH_TASK_GROUP_SIZE 32
+
+struct Buffer
+{
+    VkBuffer buffer;
+    Allocation allocation;
+    void *data;
+    size_t size;
+};
+
+// NOTE: buffers are exclusive to one queue family at a time, unless they're shared concurrently between sharedFamilyCount
+// (distinct) families
+void createBuffer(Buffer &result, VkDevice device, MemoryAllocator& allocator, size_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags,
+                  const uint32_t* sharedFamilies = 0, uint32_t sharedFamilyCount = 0)
+{
+    VkMemoryPropertyFlags preferredFlags = 0;
+    if ((memoryFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && allocator.hostVisibleDeviceLocal)
+        preferredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    // NOTE: device local buffers can be filled by the staging ring
+    if (memoryFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+        usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    VkBufferCreateInfo createInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    createInfo.size = size;
+    createInfo.usage = usage;
+
+    if (sharedFamilyCount > 1)
+    {
+        createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = sharedFamilyCount;
+        createInfo.pQueueFamilyIndices = sharedFamilies;
+    }
+
+    VkBuffer buffer = 0;
+    VK_CHECK(vkCreateBuffer(device, &createInfo, 0, &buffer));
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+    Allocation allocation = {};
+    allocateMemory(allocation, allocator, memoryRequirements, memoryFlags, true, preferredFlags);
+    assert(allocation.data || !(memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT));
+
+    VK_CHECK(vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset));
+
+    result.buffer = buffer;
+    result.allocation = allocation;
+    result.size = size;
+    result.data = allocation.data;
+}
+
+void destroyBuffer(const Buffer& buffer, VkDevice device, MemoryAllocator& allocator)
+{
+    vkDestroyBuffer(device, buffer.buffer, 0);
+    freeMemory(allocator, buffer.allocation);
+}
+
+VkBufferMemoryBarrier bufferBarrier(VkBuffer buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+    VkBufferMemoryBarrier result = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+
+    result.srcAccessMask = srcAccessMask;
+    result.dstAccessMask = dstAccessMask;
+    result.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    result.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    result.buffer = buffer;
+    result.offset = 0;
+    result.size = VK_WHOLE_SIZE;
+
+    return result;
+}
+
+// NOTE: whole buffers to consecutive storage buffer bindings starting at 0, matching createSetLayout
+void pushStorageBuffers(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, const Buffer* const* buffers, uint32_t bufferCount)
+{
+    VkDescriptorBufferInfo bufferInfos[8] = {};
+    VkWriteDescriptorSet descriptors[8] = {};
+    assert(bufferCount <= ARRAYSIZE(descriptors));
+
+    for (uint32_t i = 0; i < bufferCount; i++)
+    {
+        bufferInfos[i].buffer = buffers[i]->buffer;
+        bufferInfos[i].offset = 0;
+        bufferInfos[i].range = buffers[i]->size;
+
+        descriptors[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptors[i].dstBinding = i;
+        descriptors[i].descriptorCount = 1;
+        descriptors[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptors[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkCmdPushDescriptorSetKHR(commandBuffer, bindPoint, layout, 0, bufferCount, descriptors);
+}
+
+// NOTE: hierarchical Z, every texel holds the farthest depth of its footprint in the level above; level 0 is the
+// depth buffer size rounded down to a power of two so every level halves exactly
+#define DEPTH_PYRAMID_MAX_LEVELS 16
+
+struct DepthPyramid
+{
+    Image image;
+    VkImageView levelViews[DEPTH_PYRAMID_MAX_LEVELS];
+
+    uint32_t width, height;
+    uint32_t levelCount;
+};
+
+uint32_t previousPow2(uint32_t v)
+{
+    uint32_t result = 1;
+
+    while (result * 2 <= v)
+        result *= 2;
+
+    return result;
+}
+
+void createDepthPyramid(DepthPyramid& result, VkDevice device, MemoryAllocator& allocator, uint32_t width, uint32_t height)
+{
+    result.width = previousPow2(width);
+    result.height = previousPow2(height);
+    result.levelCount = 1;
+
+    while ((result.width >> result.levelCount) || (result.height >> result.levelCount))
+        result.levelCount++;
+
+    assert(result.levelCount <= DEPTH_PYRAMID_MAX_LEVELS);
+
+    createImage(result.image, device, allocator, result.width, result.height, result.levelCount, VK_FORMAT_R32_SFLOAT,
+                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+    for (uint32_t i = 0; i < result.levelCount; i++)
+    {
+        result.levelViews[i] = createImageView(device, result.image.image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, i, 1);
+        assert(result.levelViews[i]);
+    }
+}
+
+void destroyDepthPyramid(const DepthPyramid& pyramid, VkDevice device, MemoryAllocator& allocator)
+{
+    for (uint32_t i = 0; i < pyramid.levelCount; i++)
+        vkDestroyImageView(device, pyramid.levelViews[i], 0);
+
+    destroyImage(pyramid.image, device, allocator);
+}
+
+// NOTE: push constants of depthreduce.comp, has to match DepthReduceData there
+struct DepthReduceData
+{
+    uint32_t sourceWidth, sourceHeight;
+    uint32_t destinationWidth, destinationHeight;
+};
+
+// NOTE: expects the depth image in SHADER_READ_ONLY_OPTIMAL and the pyramid in GENERAL, one dispatch per level with
+// the previous level as the source; leaves the pyramid ready for compute shader reads
+void buildDepthPyramid(VkCommandBuffer commandBuffer, const DepthPyramid& pyramid, VkImageView depthImageView, uint32_t depthWidth, uint32_t depthHeight,
+                       VkPipeline pipeline, VkPipelineLayout layout, VkSampler sampler)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    uint32_t sourceWidth = depthWidth;
+    uint32_t sourceHeight = depthHeight;
+
+    for (uint32_t i = 0; i < pyramid.levelCount; i++)
+    {
+        VkDescriptorImageInfo sourceInfo = {};
+        sourceInfo.sampler = sampler;
+        sourceInfo.imageView = (i == 0) ? depthImageView : pyramid.levelViews[i - 1];
+        sourceInfo.imageLayout = (i == 0) ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo destinationInfo = {};
+        destinationInfo.imageView = pyramid.levelViews[i];
+        destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet descriptors[2] = {};
+        descriptors[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptors[0].dstBinding = 0;
+        descriptors[0].descriptorCount = 1;
+        descriptors[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptors[0].pImageInfo = &sourceInfo;
+        descriptors[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptors[1].dstBinding = 1;
+        descriptors[1].descriptorCount = 1;
+        descriptors[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptors[1].pImageInfo = &destinationInfo;
+
+        vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, ARRAYSIZE(descriptors), descriptors);
+
+        DepthReduceData reduceData = {};
+        reduceData.sourceWidth = sourceWidth;
+        reduceData.sourceHeight = sourceHeight;
+        reduceData.destinationWidth = std::max(pyramid.width >> i, 1u);
+        reduceData.destinationHeight = std::max(pyramid.height >> i, 1u);
+
+        vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(reduceData), &reduceData);
+        vkCmdDispatch(commandBuffer, (reduceData.destinationWidth + 7) / 8, (reduceData.destinationHeight + 7) / 8, 1);
+
+        VkImageMemoryBarrier reduceBarrier = imageBarrier(pyramid.image.image, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                                                          VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, 0, 0, 0, 1, &reduceBarrier);
+
+        sourceWidth = reduceData.destinationWidth;
+        sourceHeight = reduceData.destinationHeight;
+    }
+}
+
+// NOTE: bounds, LODs, commands, command counts and visibility buffers followed by the depth pyramid, which has to be
+// in GENERAL even in phases that don't read it
+void dispatchDrawCull(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkPipelineLayout layout, const Buffer* const* buffers,
+                      const DepthPyramid& pyramid, VkSampler sampler, const DrawCullData& data, uint32_t groupCount)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    VkDescriptorBufferInfo bufferInfos[5] = {};
+    VkWriteDescriptorSet descriptors[6] = {};
+
+    for (uint32_t i = 0; i < ARRAYSIZE(bufferInfos); i++)
+    {
+        bufferInfos[i].buffer = buffers[i]->buffer;
+        bufferInfos[i].offset = 0;
+        bufferInfos[i].range = buffers[i]->size;
+
+        descriptors[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptors[i].dstBinding = i;
+        descriptors[i].descriptorCount = 1;
+        descriptors[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptors[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    VkDescriptorImageInfo pyramidInfo = {};
+    pyramidInfo.sampler = sampler;
+    pyramidInfo.imageView = pyramid.image.imageView;
+    pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    descriptors[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptors[5].dstBinding = 5;
+    descriptors[5].descriptorCount = 1;
+    descriptors[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptors[5].pImageInfo = &pyramidInfo;
+
+    vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, ARRAYSIZE(descriptors), descriptors);
+
+    vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(data), &data);
+    vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+}
+
+#define STAGING_RING_SEGMENTS 4
+
+// NOTE: host visible buffer split into segments, every segment is copied out by its own submission
+// so filling the next segment overlaps with the GPU copying the previous one
+struct StagingRing
+{
+    Buffer buffer;
+    VkDeviceSize segmentSize;
+
+    VkCommandPool commandPools[STAGING_RING_SEGMENTS];
+    VkCommandBuffer commandBuffers[STAGING_RING_SEGMENTS];
+    VkFence fences[STAGING_RING_SEGMENTS];
+
+    uint32_t segmentIndex;
+};
+
+void createStagingRing(StagingRing& result, VkDevice device, MemoryAllocator& allocator, uint32_t familyIndex, size_t size)
+{
+    createBuffer(result.buffer, device, allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    result.segmentSize = size / STAGING_RING_SEGMENTS;
+
+    for (uint32_t i = 0; i < STAGING_RING_SEGMENTS; i++)
+    {
+        result.commandPools[i] = createCommandPool(device, familyIndex);
+        assert(result.commandPools[i]);
+
+        VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        allocateInfo.commandPool = result.commandPools[i];
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &result.commandBuffers[i]));
+
+        result.fences[i] = createFence(device);
+        assert(result.fences[i]);
+    }
+
+    result.segmentIndex = 0;
+}
+
+void destroyStagingRing(StagingRing& ring, VkDevice device, MemoryAllocator& allocator)
+{
+    VK_CHECK(vkWaitForFences(device, STAGING_RING_SEGMENTS, ring.fences, VK_TRUE, UINT64_MAX));
+
+    for (uint32_t i = 0; i < STAGING_RING_SEGMENTS; i++)
+    {
+        vkDestroyFence(device, ring.fences[i], 0);
+        vkDestroyCommandPool(device, ring.commandPools[i], 0);
+    }
+
+    destroyBuffer(ring.buffer, device, allocator);
+}
+
+void uploadBuffer(StagingRing& ring, VkDevice device, VkQueue queue, const Buffer& buffer, VkDeviceSize offset, const void* data, size_t size)
+{
+    TRACE_ZONE("uploadBuffer");
+
+    assert(offset + size <= buffer.size);
+
+    // NOTE: UMA/ReBAR memory doesn't need a staging copy
+    if (buffer.data)
+    {
+        memcpy(static_cast<char*>(buffer.data) + offset, data, size);
+        return;
+    }
+
+    for (size_t chunkOffset = 0; chunkOffset < size; chunkOffset += ring.segmentSize)
+    {
+        size_t chunkSize = std::min(size - chunkOffset, size_t(ring.segmentSize));
+
+        uint32_t segment = ring.segmentIndex;
+        ring.segmentIndex = (ring.segmentIndex + 1) % STAGING_RING_SEGMENTS;
+
+        VK_CHECK(vkWaitForFences(device, 1, &ring.fences[segment], VK_TRUE, UINT64_MAX));
+        VK_CHECK(vkResetFences(device, 1, &ring.fences[segment]));
+
+        VkDeviceSize segmentOffset = segment * ring.segmentSize;
+        memcpy(static_cast<char*>(ring.buffer.data) + segmentOffset, static_cast<const char*>(data) + chunkOffset, chunkSize);
+
+        VK_CHECK(vkResetCommandPool(device, ring.commandPools[segment], 0));
+
+        VkCommandBuffer commandBuffer = ring.commandBuffers[segment];
+
+        VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+        VkBufferCopy region = { segmentOffset, offset + chunkOffset, chunkSize };
+        vkCmdCopyBuffer(commandBuffer, ring.buffer.buffer, buffer.buffer, 1, &region);
+
+        // NOTE: uploads are rare, so the consumer side of the barrier is kept broad
+        VkBufferMemoryBarrier copyBarrier = bufferBarrier(buffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, 0, 1, &copyBarrier, 0, 0);
+
+        VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+        VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, ring.fences[segment]));
+    }
+}
+
+// NOTE: geometry buffers of a mesh asset, in the order they're staged
+enum MeshAssetBuffer
+{
+    MESH_ASSET_VERTICES,
+    MESH_ASSET_INDICES,
+    MESH_ASSET_MESHLETS,
+    MESH_ASSET_MESHLET_VERTICES,
+    MESH_ASSET_MESHLET_TRIANGLES,
+
+    MESH_ASSET_BUFFER_COUNT
+};
+
+struct MeshAsset;
+
+// NOTE: called on the thread that calls updateAssetLoader once the asset's copies have completed on the GPU, or once
+// loading it failed
+typedef void (*MeshReadyCallback)(void* context, MeshAsset& asset);
+
+#define MESH_ASSET_PACKED_VERTICES (1 << 0)
+#define MESH_ASSET_MESHLET_GEOMETRY (1 << 1)
+#define MESH_ASSET_MESHLETS (1 << 2)
+
+struct MeshAsset
+{
+    const char* path;
+    uint32_t processing;
+    uint32_t flags;
+
+    MeshReadyCallback callback;
+    void* context;
+
+    // NOTE: written by the loader thread before the asset is staged
+    bool failed;
+
+    vec3 center;
+    float radius;
+    VertexQuantization vertexQuantization;
+    uint32_t vertexCount;
+
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+
+    // NOTE: where the data of every buffer sits in the loader's host ring; the asset covers [ringBegin, ringEnd) of the
+    // ring's running byte count
+    VkDeviceSize ringOffsets[MESH_ASSET_BUFFER_COUNT];
+    VkDeviceSize sizes[MESH_ASSET_BUFFER_COUNT];
+    VkDeviceSize ringBegin;
+    VkDeviceSize ringEnd;
+
+    double loadTime;
+
+    // NOTE: created on the main thread, buffers that weren't requested stay empty; the callback takes them over
+    Buffer buffers[MESH_ASSET_BUFFER_COUNT];
+
+    // NOTE: the copies, recorded for the transfer queue; with a dedicated transfer family the graphics queue acquires
+    // the buffers in a second submission that waits on copySemaphore, the fence signals once the last one is done
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkCommandPool acquirePool;
+    VkCommandBuffer acquireCommandBuffer;
+    VkSemaphore copySemaphore;
+    VkFence fence;
+};
+
+// NOTE: meshes are parsed, processed and copied into a host visible ring on a background thread, so the render loop
+// keeps presenting while they load. The main thread creates the device buffers (the allocator isn't thread safe),
+// submits the copies out of the ring to the transfer queue and hands the asset to its callback once their fence has
+// signaled. Ring space is freed in submission order, which is also the order the copies complete in.
+struct AssetLoader
+{
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable requestReady;
+    std::condition_variable ringFreed;
+    std::condition_variable assetStaged;
+    bool quit;
+
+    // NOTE: main thread -> loader thread, and back once the data is in the ring
+    std::vector<MeshAsset*> requests;
+    std::vector<MeshAsset*> staged;
+
+    // NOTE: main thread only, copies in flight in submission order
+    std::vector<MeshAsset*> uploads;
+    uint32_t pendingCount;
+
+    std::vector<MeshAsset*> assets;
+
+    Buffer ring;
+    VkDeviceSize ringHead;
+    VkDeviceSize ringTail;
+
+    // NOTE: the transfer family and queue are the graphics ones when the device has no dedicated transfer family;
+    // otherwise the buffers are exclusive to one family at a time, so the copies release them and the graphics queue
+    // acquires them before anything reads them (concurrent sharing would skip that, but can cost compression and
+    // bandwidth on every later access just to save one barrier per asset)
+    uint32_t familyIndex;
+    VkQueue queue;
+    uint32_t transferFamilyIndex;
+    VkQueue transferQueue;
+};
+
+// NOTE: reserves size contiguous bytes of the ring, waiting for copies to complete when it's full; never wraps an
+// allocation around the end of the ring
+static bool allocateAssetRing(AssetLoader& loader, VkDeviceSize size, VkDeviceSize* begin)
+{
+    VkDeviceSize ringSize = loader.ring.size;
+
+    if (size > ringSize)
+        return false;
+
+    std::unique_lock<std::mutex> lock(loader.mutex);
+
+    VkDeviceSize head = loader.ringHead;
+    if (head % ringSize + size > ringSize)
+        head += ringSize - head % ringSize;
+
+    while (!loader.quit && (head + size - loader.ringTail > ringSize))
+        loader.ringFreed.wait(lock);
+
+    if (loader.quit)
+        return false;
+
+    *begin = head;
+    loader.ringHead = head + size;
+
+    return true;
+}
+
+static void stageMeshAsset(AssetLoader& loader, MeshAsset& asset)
+{
+    TRACE_ZONE("stageMeshAsset");
+
+    double loadTimeBegin = getTimeMs();
+
+    MappedFile meshFile = {};
+    if (!loadMeshCached(meshFile, asset.path, asset.processing))
+    {
+        printf("ERROR: Failed to load %s\n", asset.path);
+        asset.failed = true;
+        return;
+    }
+
+    const MeshFileHeader& header = *static_cast<const MeshFileHeader*>(meshFile.data);
+    const char* meshData = static_cast<const char*>(meshFile.data);
+
+    assert(header.vertexSize == sizeof(Vertex));
+    const Vertex* vertices = reinterpret_cast<const Vertex*>(meshData + header.vertexOffset);
+    const uint32_t* indices = reinterpret_cast<const uint32_t*>(meshData + header.indexOffset);
+
+    computeMeshBounds(asset.center, asset.radius, meshData + header.vertexOffset, header.vertexCount, header.vertexSize);
+
+    asset.vertexCount = header.vertexCount;
+
+    const MeshLod* lodData = reinterpret_cast<const MeshLod*>(meshData + header.lodOffset);
+    asset.lods.assign(lodData, lodData + header.lodCount);
+
+    const Meshlet* meshletData = reinterpret_cast<const Meshlet*>(meshData + header.meshletOffset);
+    asset.meshlets.assign(meshletData, meshletData + header.meshletCount);
+
+    // NOTE: identity dequantization for full float vertices
+    asset.vertexQuantization = { vec3(0.0f, 0.0f, 0.0f), vec3(1.0f, 1.0f, 1.0f) };
+    std::vector<PackedVertex> packedVertexData;
+
+    if (asset.flags & MESH_ASSET_PACKED_VERTICES)
+    {
+        packVertices(packedVertexData, asset.vertexQuantization, vertices, header.vertexCount);
+        printPackedVertexQuality(asset.path, packedVertexData.data(), asset.vertexQuantization, vertices, header.vertexCount);
+    }
+
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletTriangles;
+
+    if (asset.flags & MESH_ASSET_MESHLET_GEOMETRY)
+        buildMeshletGeometry(meshletVertices, meshletTriangles, asset.meshlets.data(), asset.meshlets.size(), indices, header.vertexCount);
+
+    const void* sources[MESH_ASSET_BUFFER_COUNT] = {};
+
+    // NOTE: full float vertices go straight from the file mapping into the ring
+    sources[MESH_ASSET_VERTICES] = packedVertexData.empty() ? static_cast<const void*>(vertices) : static_cast<const void*>(packedVertexData.data());
+    asset.sizes[MESH_ASSET_VERTICES] = VkDeviceSize(header.vertexCount) * (packedVertexData.empty() ? sizeof(Vertex) : sizeof(PackedVertex));
+
+    sources[MESH_ASSET_INDICES] = indices;
+    asset.sizes[MESH_ASSET_INDICES] = VkDeviceSize(header.indexCount) * sizeof(uint32_t);
+
+    if (asset.flags & MESH_ASSET_MESHLETS)
+    {
+        sources[MESH_ASSET_MESHLETS] = asset.meshlets.data();
+        asset.sizes[MESH_ASSET_MESHLETS] = asset.meshlets.size() * sizeof(Meshlet);
+    }
+
+    sources[MESH_ASSET_MESHLET_VERTICES] = meshletVertices.data();
+    asset.sizes[MESH_ASSET_MESHLET_VERTICES] = meshletVertices.size() * sizeof(uint32_t);
+
+    sources[MESH_ASSET_MESHLET_TRIANGLES] = meshletTriangles.data();
+    asset.sizes[MESH_ASSET_MESHLET_TRIANGLES] = meshletTriangles.size() * sizeof(uint32_t);
+
+    // NOTE: 16 byte aligned copies, well within optimalBufferCopyOffsetAlignment everywhere
+    VkDeviceSize stagingSize = 0;
+    for (uint32_t i = 0; i < MESH_ASSET_BUFFER_COUNT; i++)
+    {
+        asset.ringOffsets[i] = stagingSize;
+        stagingSize += (asset.sizes[i] + 15) & ~VkDeviceSize(15);
+    }
+
+    if (!allocateAssetRing(loader, stagingSize, &asset.ringBegin))
+    {
+        printf("ERROR: %s needs %.1f MB of staging, the asset ring has %.1f MB\n", asset.path, double(stagingSize) / (1024 * 1024),
+               double(loader.ring.size) / (1024 * 1024));
+
+        unmapFile(meshFile);
+        asset.failed = true;
+        return;
+    }
+
+    asset.ringEnd = asset.ringBegin + stagingSize;
+
+    {
+        TRACE_ZONE("copyToAssetRing");
+
+        char* ringData = static_cast<char*>(loader.ring.data) + asset.ringBegin % loader.ring.size;
+
+        for (uint32_t i = 0; i < MESH_ASSET_BUFFER_COUNT; i++)
+        {
+            if (asset.sizes[i])
+                memcpy(ringData + asset.ringOffsets[i], sources[i], asset.sizes[i]);
+
+            asset.ringOffsets[i] += asset.ringBegin % loader.ring.size;
+        }
+    }
+
+    unmapFile(meshFile);
+
+    asset.loadTime = getTimeMs() - loadTimeBegin;
+}
+
+static void assetLoaderMain(AssetLoader* loader)
+{
+    setTraceThreadName("asset loader");
+
+    for (;;)
+    {
+        MeshAsset* asset = 0;
+
+        {
+            std::unique_lock<std::mutex> lock(loader->mutex);
+
+            while (!loader->quit && loader->requests.empty())
+                loader->requestReady.wait(lock);
+
+            if (loader->quit)
+                return;
+
+            asset = loader->requests.front();
+            loader->requests.erase(loader->requests.begin());
+        }
+
+        stageMeshAsset(*loader, *asset);
+
+        {
+            std::lock_guard<std::mutex> lock(loader->mutex);
+            loader->staged.push_back(asset);
+        }
+
+        loader->assetStaged.notify_one();
+    }
+}
+
+// NOTE: transferFamilyIndex can be VK_QUEUE_FAMILY_IGNORED, the copies then go through queue
+void createAssetLoader(AssetLoader& result, VkDevice device, MemoryAllocator& allocator, uint32_t familyIndex, VkQueue queue,
+                       uint32_t transferFamilyIndex, VkQueue transferQueue, size_t ringSize)
+{
+    createBuffer(result.ring, device, allocator, ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    result.ringHead = 0;
+    result.ringTail = 0;
+    result.quit = false;
+    result.pendingCount = 0;
+
+    result.familyIndex = familyIndex;
+    result.queue = queue;
+    result.transferFamilyIndex = (transferFamilyIndex != VK_QUEUE_FAMILY_IGNORED) ? transferFamilyIndex : familyIndex;
+    result.transferQueue = (transferFamilyIndex != VK_QUEUE_FAMILY_IGNORED) ? transferQueue : queue;
+
+    result.thread = std::thread(assetLoaderMain, &result);
+}
+
+static void destroyMeshAssetUpload(MeshAsset& asset, VkDevice device)
+{
+    vkDestroyFence(device, asset.fence, 0);
+    vkDestroyCommandPool(device, asset.commandPool, 0);
+
+    if (asset.acquirePool)
+    {
+        vkDestroySemaphore(device, asset.copySemaphore, 0);
+        vkDestroyCommandPool(device, asset.acquirePool, 0);
+    }
+
+    asset.fence = 0;
+    asset.commandPool = 0;
+    asset.commandBuffer = 0;
+    asset.acquirePool = 0;
+    asset.acquireCommandBuffer = 0;
+    asset.copySemaphore = 0;
+}
+
+// NOTE: the buffers of assets that were handed to their callback belong to whoever took them over
+void destroyAssetLoader(AssetLoader& loader, VkDevice device, MemoryAllocator& allocator)
+{
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        loader.quit = true;
+    }
+
+    loader.requestReady.notify_one();
+    loader.ringFreed.notify_one();
+
+    loader.thread.join();
+
+    for (size_t i = 0; i < loader.uploads.size(); i++)
+    {
+        MeshAsset& asset = *loader.uploads[i];
+
+        VK_CHECK(vkWaitForFences(device, 1, &asset.fence, VK_TRUE, UINT64_MAX));
+
+        destroyMeshAssetUpload(asset, device);
+
+        for (uint32_t j = 0; j < MESH_ASSET_BUFFER_COUNT; j++)
+            if (asset.buffers[j].buffer)
+                destroyBuffer(asset.buffers[j], device, allocator);
+    }
+
+    for (size_t i = 0; i < loader.assets.size(); i++)
+        delete loader.assets[i];
+
+    destroyBuffer(loader.ring, device, allocator);
+}
+
+// NOTE: path has to stay valid until the callback has run
+void requestMesh(AssetLoader& loader, const char* path, uint32_t processing, uint32_t flags, MeshReadyCallback callback, void* context)
+{
+    MeshAsset* asset = new MeshAsset();
+    asset->path = path;
+    asset->processing = processing;
+    asset->flags = flags;
+    asset->callback = callback;
+    asset->context = context;
+
+    loader.assets.push_back(asset);
+    loader.pendingCount++;
+
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        loader.requests.push_back(asset);
+    }
+
+    loader.requestReady.notify_one();
+}
+
+static VkCommandBuffer beginMeshAssetCommands(VkDevice device, VkCommandPool commandPool)
+{
+    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    allocateInfo.commandPool = commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer = 0;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer));
+
+    VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+    return commandBuffer;
+}
+
+static void submitMeshAsset(AssetLoader& loader, VkDevice device, MemoryAllocator& allocator, MeshAsset& asset)
+{
+    TRACE_ZONE("submitMeshAsset");
+
+    const VkBufferUsageFlags usages[MESH_ASSET_BUFFER_COUNT] =
+    {
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    };
+
+    bool ownershipTransfer = loader.transferFamilyIndex != loader.familyIndex;
+
+    asset.commandPool = createCommandPool(device, loader.transferFamilyIndex);
+    assert(asset.commandPool);
+
+    asset.commandBuffer = beginMeshAssetCommands(device, asset.commandPool);
+
+    // NOTE: with an ownership transfer the same barriers are both the release on the transfer queue and the acquire on
+    // the graphics queue; the release ignores dstAccessMask and the acquire ignores srcAccessMask
+    VkBufferMemoryBarrier copyBarriers[MESH_ASSET_BUFFER_COUNT];
+    uint32_t copyBarrierCount = 0;
+
+    for (uint32_t i = 0; i < MESH_ASSET_BUFFER_COUNT; i++)
+    {
+        if (asset.sizes[i] == 0)
+            continue;
+
+        createBuffer(asset.buffers[i], device, allocator, asset.sizes[i], usages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkBufferCopy region = { asset.ringOffsets[i], 0, asset.sizes[i] };
+        vkCmdCopyBuffer(asset.commandBuffer, loader.ring.buffer, asset.buffers[i].buffer, 1, &region);
+
+        VkBufferMemoryBarrier barrier = bufferBarrier(asset.buffers[i].buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT);
+
+        if (ownershipTransfer)
+        {
+            barrier.srcQueueFamilyIndex = loader.transferFamilyIndex;
+            barrier.dstQueueFamilyIndex = loader.familyIndex;
+        }
+
+        copyBarriers[copyBarrierCount++] = barrier;
+    }
+
+    asset.fence = createFence(device);
+    assert(asset.fence);
+    VK_CHECK(vkResetFences(device, 1, &asset.fence));
+
+    if (!ownershipTransfer)
+    {
+        // NOTE: the copies share the queue with rendering, so this makes them visible to every later frame's submission
+        vkCmdPipelineBarrier(asset.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, 0,
+                             copyBarrierCount, copyBarriers, 0, 0);
+
+        VK_CHECK(vkEndCommandBuffer(asset.commandBuffer));
+
+        VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &asset.commandBuffer;
+        VK_CHECK(vkQueueSubmit(loader.queue, 1, &submitInfo, asset.fence));
+
+        return;
+    }
+
+    vkCmdPipelineBarrier(asset.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, 0,
+                         copyBarrierCount, copyBarriers, 0, 0);
+
+    VK_CHECK(vkEndCommandBuffer(asset.commandBuffer));
+
+    asset.copySemaphore = createSemaphore(device);
+    assert(asset.copySemaphore);
+
+    VkSubmitInfo copySubmitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    copySubmitInfo.commandBufferCount = 1;
+    copySubmitInfo.pCommandBuffers = &asset.commandBuffer;
+    copySubmitInfo.signalSemaphoreCount = 1;
+    copySubmitInfo.pSignalSemaphores = &asset.copySemaphore;
+    VK_CHECK(vkQueueSubmit(loader.transferQueue, 1, &copySubmitInfo, 0));
+
+    asset.acquirePool = createCommandPool(device, loader.familyIndex);
+    assert(asset.acquirePool);
+
+    asset.acquireCommandBuffer = beginMeshAssetCommands(device, asset.acquirePool);
+
+    // NOTE: the semaphore wait and the acquire both cover every stage, so the chain holds whichever stage reads the
+    // buffers first; this runs once per asset, ahead of the frame that first draws it
+    vkCmdPipelineBarrier(asset.acquireCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, 0,
+                         copyBarrierCount, copyBarriers, 0, 0);
+
+    VK_CHECK(vkEndCommandBuffer(asset.acquireCommandBuffer));
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkSubmitInfo acquireSubmitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    acquireSubmitInfo.waitSemaphoreCount = 1;
+    acquireSubmitInfo.pWaitSemaphores = &asset.copySemaphore;
+    acquireSubmitInfo.pWaitDstStageMask = &waitStage;
+    acquireSubmitInfo.commandBufferCount = 1;
+    acquireSubmitInfo.pCommandBuffers = &asset.acquireCommandBuffer;
+    VK_CHECK(vkQueueSubmit(loader.queue, 1, &acquireSubmitInfo, asset.fence));
+}
+
+static void completeMeshAsset(AssetLoader& loader, MeshAsset& asset)
+{
+    loader.pendingCount--;
+
+    asset.callback(asset.context, asset);
+}
+
+// NOTE: submits the copies of newly staged assets and runs the callbacks of the ones that have landed; wait blocks until
+// every requested asset is done
+void updateAssetLoader(AssetLoader& loader, VkDevice device, MemoryAllocator& allocator, bool wait)
+{
+    TRACE_ZONE("updateAssetLoader");
+
+    std::vector<MeshAsset*> staged;
+
+    do
+    {
+        {
+            std::unique_lock<std::mutex> lock(loader.mutex);
+
+            while (wait && loader.staged.empty() && loader.uploads.empty() && (loader.pendingCount > 0))
+                loader.assetStaged.wait(lock);
+
+            staged.swap(loader.staged);
+        }
+
+        for (size_t i = 0; i < staged.size(); i++)
+        {
+            MeshAsset& asset = *staged[i];
+
+            if (asset.failed)
+            {
+                completeMeshAsset(loader, asset);
+                continue;
+            }
+
+            submitMeshAsset(loader, device, allocator, asset);
+            loader.uploads.push_back(&asset);
+        }
+
+        staged.clear();
+
+        // NOTE: copies complete in submission order, so only the front can free ring space
+        while (!loader.uploads.empty())
+        {
+            MeshAsset& asset = *loader.uploads.front();
+
+            if (wait)
+            {
+                VK_CHECK(vkWaitForFences(device, 1, &asset.fence, VK_TRUE, UINT64_MAX));
+            }
+            else if (vkGetFenceStatus(device, asset.fence) != VK_SUCCESS)
+            {
+                break;
+            }
+
+            destroyMeshAssetUpload(asset, device);
+
+            loader.uploads.erase(loader.uploads.begin());
+
+            {
+                std::lock_guard<std::mutex> lock(loader.mutex);
+                loader.ringTail = asset.ringEnd;
+            }
+
+            loader.ringFreed.notify_one();
+
+            completeMeshAsset(loader, asset);
+        }
+    }
+    while (wait && (loader.pendingCount > 0));
+}
+
+#define MAX_RECORD_THREADS 16
+
+struct Frame
+{
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+
+    // NOTE: with async compute the frame is submitted in two parts, split after the late cull, so the next frame's
+    // early cull can run on the compute queue while this one draws its late pass
+    VkCommandBuffer lateCommandBuffer;
+
+    // NOTE: the frame's work on the async compute queue, only created when there is one
+    VkCommandPool computePool;
+    VkCommandBuffer computeCommandBuffer;
+
+    // NOTE: one transient pool per draw list slice, each slice is one job, so no two threads ever use the same pool at
+    // the same time (pools aren't thread safe)
+    VkCommandPool recordPools[MAX_RECORD_THREADS];
+    VkCommandBuffer recordCommandBuffers[MAX_RECORD_THREADS];
+
+    VkFence fence;
+    VkSemaphore acquireSemaphore;
+
+    uint64_t submitIndex;
+};
+
+void createFrame(Frame& result, VkDevice device, uint32_t familyIndex, uint32_t computeFamilyIndex, uint32_t recordThreadCount)
+{
+    result.commandPool = createCommandPool(device, familyIndex);
+    assert(result.commandPool);
+
+    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    allocateInfo.commandPool = result.commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+
+    result.commandBuffer = 0;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &result.commandBuffer));
+
+    result.lateCommandBuffer = 0;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &result.lateCommandBuffer));
+
+    result.computePool = 0;
+    result.computeCommandBuffer = 0;
+
+    if (computeFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
+    {
+        result.computePool = createCommandPool(device, computeFamilyIndex);
+        assert(result.computePool);
+
+        VkCommandBufferAllocateInfo computeAllocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        computeAllocateInfo.commandPool = result.computePool;
+        computeAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        computeAllocateInfo.commandBufferCount = 1;
+
+        VK_CHECK(vkAllocateCommandBuffers(device, &computeAllocateInfo, &result.computeCommandBuffer));
+    }
+
+    assert(recordThreadCount <= MAX_RECORD_THREADS);
+
+    for (uint32_t i = 0; i < recordThreadCount; i++)
+    {
+        result.recordPools[i] = createCommandPool(device, familyIndex);
+        assert(result.recordPools[i]);
+
+        VkCommandBufferAllocateInfo recordAllocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        recordAllocateInfo.commandPool = result.recordPools[i];
+        recordAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        recordAllocateInfo.commandBufferCount = 1;
+
+        result.recordCommandBuffers[i] = 0;
+        VK_CHECK(vkAllocateCommandBuffers(device, &recordAllocateInfo, &result.recordCommandBuffers[i]));
+    }
+
+    result.fence = createFence(device);
+    assert(result.fence);
+
+    result.acquireSemaphore = createSemaphore(device);
+    assert(result.acquireSemaphore);
+
+    result.submitIndex = 0;
+}
+
+void destroyFrame(VkDevice device, const Frame& frame)
+{
+    vkDestroyCommandPool(device, frame.commandPool, 0);
+
+    if (frame.computePool)
+        vkDestroyCommandPool(device, frame.computePool, 0);
+
+    for (uint32_t i = 0; i < MAX_RECORD_THREADS; i++)
+        if (frame.recordPools[i])
+            vkDestroyCommandPool(device, frame.recordPools[i], 0);
+
+    vkDestroyFence(device, frame.fence, 0);
+    vkDestroySemaphore(device, frame.acquireSemaphore, 0);
+}
+
+// NOTE: compute passes that only depend on earlier submissions run on the compute only queue, where they overlap with
+// whatever the graphics queue is still busy with. Each queue signals its own timeline semaphore with a value that
+// grows with every submission, so either side can wait for exactly the submission it depends on without a semaphore
+// per frame. Buffers both queues touch are shared concurrently; they're written every frame, and ownership transfers
+// would cost a release and an acquire barrier each way every frame.
+struct AsyncCompute
+{
+    uint32_t familyIndex;
+    VkQueue queue;
+
+    VkSemaphore computeTimeline;
+    uint64_t computeValue;
+
+    VkSemaphore graphicsTimeline;
+    uint64_t graphicsValue;
+};
+
+VkSemaphore createTimelineSemaphore(VkDevice device)
+{
+    VkSemaphoreTypeCreateInfo typeInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo createInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+    createInfo.pNext = &typeInfo;
+
+    VkSemaphore semaphore = 0;
+    VK_CHECK(vkCreateSemaphore(device, &createInfo, 0, &semaphore));
+
+    return semaphore;
+}
+
+void createAsyncCompute(AsyncCompute& result, VkDevice device, uint32_t familyIndex, VkQueue queue)
+{
+    result.familyIndex = familyIndex;
+    result.queue = queue;
+
+    result.computeTimeline = createTimelineSemaphore(device);
+    assert(result.computeTimeline);
+    result.computeValue = 0;
+
+    result.graphicsTimeline = createTimelineSemaphore(device);
+    assert(result.graphicsTimeline);
+    result.graphicsValue = 0;
+}
+
+void destroyAsyncCompute(AsyncCompute& compute, VkDevice device)
+{
+    vkDestroySemaphore(device, compute.computeTimeline, 0);
+    vkDestroySemaphore(device, compute.graphicsTimeline, 0);
+}
+
+// NOTE: waits for graphicsValue on the graphics timeline first (0 doesn't wait), the command buffer only holds compute
+// passes so nothing is lost by waiting at every stage; returns the compute timeline value that signals once it's done
+uint64_t submitAsyncCompute(AsyncCompute& compute, VkCommandBuffer commandBuffer, uint64_t graphicsValue)
+{
+    uint64_t computeValue = ++compute.computeValue;
+    VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+    timelineInfo.waitSemaphoreValueCount = (graphicsValue > 0) ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &graphicsValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &computeValue;
+
+    VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = (graphicsValue > 0) ? 1 : 0;
+    submitInfo.pWaitSemaphores = &compute.graphicsTimeline;
+    submitInfo.pWaitDstStageMask = &waitStageMask;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &compute.computeTimeline;
+
+    VK_CHECK(vkQueueSubmit(compute.queue, 1, &submitInfo, 0));
+
+    return computeValue;
+}
+
+// NOTE: everything needed to record a CPU built list of indexed draws from scratch, so slices of it can be recorded
+// into separate command buffers
+struct DrawList
+{
+    VkPipeline pipeline;
+    VkPipelineLayout layout;
+
+    const Buffer* const* buffers;
+    uint32_t bufferCount;
+
+    const void* pushConstants;
+    uint32_t pushConstantSize;
+
+    VkBuffer indexBuffer;
+
+    VkViewport viewport;
+    VkRect2D scissor;
+
+    const VkDrawIndexedIndirectCommand* commands;
+    uint32_t commandCount;
+};
+
+void recordDrawList(VkCommandBuffer commandBuffer, const DrawList& drawList, uint32_t begin, uint32_t end)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawList.pipeline);
+    pushStorageBuffers(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawList.layout, drawList.buffers, drawList.bufferCount);
+    vkCmdPushConstants(commandBuffer, drawList.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, drawList.pushConstantSize, drawList.pushConstants);
+
+    vkCmdSetViewport(commandBuffer, 0, 1, &drawList.viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &drawList.scissor);
+
+    vkCmdBindIndexBuffer(commandBuffer, drawList.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+    // NOTE: firstInstance carries the object index to gl_InstanceIndex
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const VkDrawIndexedIndirectCommand& command = drawList.commands[i];
+        vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+    }
+}
+
+struct RecordJobData
+{
+    VkDevice device;
+    const DrawList* drawList;
+    const VkCommandBufferInheritanceInfo* inheritance;
+    const Frame* frame;
+
+    uint32_t sliceCount;
+};
+
+// NOTE: records slice begin of the draw list into the secondary command buffer of the same index; each slice has its
+// own pool, so it doesn't matter which worker picks it up
+static void recordDrawListJob(void* data, uint32_t begin, uint32_t end)
+{
+    const RecordJobData& job = *(const RecordJobData*)data;
+    const DrawList& drawList = *job.drawList;
+
+    for (uint32_t slice = begin; slice < end; slice++)
+    {
+        uint32_t first = uint32_t(uint64_t(drawList.commandCount) * slice / job.sliceCount);
+        uint32_t last = uint32_t(uint64_t(drawList.commandCount) * (slice + 1) / job.sliceCount);
+
+        VkCommandBuffer commandBuffer = job.frame->recordCommandBuffers[slice];
+
+        VK_CHECK(vkResetCommandPool(job.device, job.frame->recordPools[slice], 0));
+
+        VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = job.inheritance;
+        VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+        recordDrawList(commandBuffer, drawList, first, last);
+
+        VK_CHECK(vkEndCommandBuffer(commandBuffer));
+    }
+}
+
+// NOTE: records the draw list into the first sliceCount secondary command buffers of the frame, ready for
+// vkCmdExecuteCommands once this returns
+void recordDrawListParallel(JobSystem& jobSystem, VkDevice device, const DrawList& drawList, const VkCommandBufferInheritanceInfo& inheritance,
+                            const Frame& frame, uint32_t sliceCount)
+{
+    TRACE_ZONE("recordDrawListParallel");
+
+    RecordJobData data = { device, &drawList, &inheritance, &frame, sliceCount };
+    parallelFor(jobSystem, sliceCount, 1, recordDrawListJob, &data, "recordDrawList");
+}
+
+#define RECORD_SWEEP_REPEATS 16
+
+// NOTE: scaling of parallel recording, the CPU time of recordDrawListParallel for every thread count up to
+// maxThreadCount at 10k to 100k draws, as one table; nothing is submitted, so the buffers only have to be valid handles
+// and every draw is one triangle with the object index in firstInstance like the real draw list
+void runRecordSweep(VkDevice device, uint32_t familyIndex, MemoryAllocator& allocator, VkRenderPass renderPass, VkPipeline pipeline, VkPipelineLayout layout,
+                    uint32_t maxThreadCount)
+{
+    const uint32_t objectCounts[] = { 10000, 25000, 50000, 75000, 100000 };
+    const uint32_t objectCountCount = ARRAYSIZE(objectCounts);
+
+    std::vector<VkDrawIndexedIndirectCommand> commands(objectCounts[objectCountCount - 1]);
+    for (uint32_t i = 0; i < commands.size(); i++)
+    {
+        VkDrawIndexedIndirectCommand command = { 3, 1, 0, 0, i };
+        commands[i] = command;
+    }
+
+    Buffer vb = {};
+    Buffer db = {};
+    Buffer ib = {};
+    createBuffer(vb, device, allocator, 1024, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    createBuffer(db, device, allocator, 1024, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    createBuffer(ib, device, allocator, 1024, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    Frame frame = {};
+    createFrame(frame, device, familyIndex, VK_QUEUE_FAMILY_IGNORED, maxThreadCount);
+
+    Globals globals = {};
+    const Buffer* buffers[] = { &vb, &db };
+
+    DrawList drawList = {};
+    drawList.pipeline = pipeline;
+    drawList.layout = layout;
+    drawList.buffers = buffers;
+    drawList.bufferCount = ARRAYSIZE(buffers);
+    drawList.pushConstants = &globals;
+    drawList.pushConstantSize = sizeof(globals);
+    drawList.indexBuffer = ib.buffer;
+    drawList.viewport = { 0, 0, 1, 1, 0, 1 };
+    drawList.scissor = { {0, 0}, {1, 1} };
+    drawList.commands = commands.data();
+
+    // NOTE: the framebuffer doesn't have to be known up front
+    VkCommandBufferInheritanceInfo inheritance = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+    inheritance.renderPass = renderPass;
+    inheritance.subpass = 0;
+
+    // NOTE: median record time in ms, objectCountCount per thread count
+    std::vector<double> results(maxThreadCount * objectCountCount);
+    std::vector<double> times(RECORD_SWEEP_REPEATS);
+
+    for (uint32_t threadCount = 1; threadCount <= maxThreadCount; threadCount++)
+    {
+        JobSystem jobSystem;
+        createJobSystem(jobSystem, threadCount);
+
+        for (uint32_t i = 0; i < objectCountCount; i++)
+        {
+            drawList.commandCount = objectCounts[i];
+
+            // NOTE: the first run grows the pools, it isn't measured
+            recordDrawListParallel(jobSystem, device, drawList, inheritance, frame, threadCount);
+
+            for (uint32_t repeat = 0; repeat < RECORD_SWEEP_REPEATS; repeat++)
+            {
+                double recordTimeBegin = getTimeMs();
+                recordDrawListParallel(jobSystem, device, drawList, inheritance, frame, threadCount);
+                times[repeat] = getTimeMs() - recordTimeBegin;
+            }
+
+            std::sort(times.begin(), times.end());
+            results[(threadCount - 1) * objectCountCount + i] = times[RECORD_SWEEP_REPEATS / 2];
+        }
+
+        destroyJobSystem(jobSystem);
+    }
+
+    printf("Record sweep: CPU time of recording the draw list into secondary command buffers, median of %u runs in ms per draw count\n", RECORD_SWEEP_REPEATS);
+    printf("%-8s", "threads");
+
+    for (uint32_t i = 0; i < objectCountCount; i++)
+        printf(" %9u", objectCounts[i]);
+
+    printf("\n");
+
+    for (uint32_t threadCount = 1; threadCount <= maxThreadCount; threadCount++)
+    {
+        printf("%-8u", threadCount);
+
+        for (uint32_t i = 0; i < objectCountCount; i++)
+            printf(" %9.3f", results[(threadCount - 1) * objectCountCount + i]);
+
+        printf("\n");
+    }
+
+    destroyFrame(device, frame);
+
+    destroyBuffer(vb, device, allocator);
+    destroyBuffer(db, device, allocator);
+    destroyBuffer(ib, device, allocator);
+}
+
+// NOTE: image has to be a 4 byte per pixel color image in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+void readbackImage(std::vector<uint8_t>& result, VkDevice device, VkQueue queue, uint32_t familyIndex, MemoryAllocator& allocator,
+                   VkImage image, uint32_t width, uint32_t height)
+{
+    TRACE_ZONE("readbackImage");
+
+    Buffer readback = {};
+    createBuffer(readback, device, allocator, size_t(width) * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VkCommandPool commandPool = createCommandPool(device, familyIndex);
+    assert(commandPool);
+
+    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    allocateInfo.commandPool = commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer = 0;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer));
+
+    VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = width;
+    region.imageExtent.height = height;
+    region.imageExtent.depth = 1;
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &region);
+
+    VkBufferMemoryBarrier readbackBarrier = bufferBarrier(readback.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, 0, 1, &readbackBarrier, 0, 0);
+
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    // NOTE: one-off at the end of a run, not worth a fence
+    VK_CHECK(vkQueueWaitIdle(queue));
+
+    const uint8_t* data = static_cast<const uint8_t*>(readback.data);
+    result.assign(data, data + readback.size);
+
+    vkDestroyCommandPool(device, commandPool, 0);
+    destroyBuffer(readback, device, allocator);
+}
+
+bool writePPM(const char* path, const uint8_t* pixels, uint32_t width, uint32_t height, VkFormat format)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    bool bgra = (format == VK_FORMAT_B8G8R8A8_UNORM) || (format == VK_FORMAT_B8G8R8A8_SRGB);
+
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+    std::vector<uint8_t> row(width * 3);
+    bool written = true;
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const uint8_t* pixel = pixels + (size_t(y) * width + x) * 4;
+
+            row[x * 3 + 0] = pixel[bgra ? 2 : 0];
+            row[x * 3 + 1] = pixel[1];
+            row[x * 3 + 2] = pixel[bgra ? 0 : 2];
+        }
+
+        written = written && (fwrite(row.data(), 1, row.size(), file) == row.size());
+    }
+
+    return (fclose(file) == 0) && written;
+}
+
+// NOTE: context is the MeshAsset* the render loop picks the mesh up from
+static void onMeshReady(void* context, MeshAsset& asset)
+{
+    *static_cast<MeshAsset**>(context) = &asset;
+}
+
+int main(int argc, const char** argv)
+{
+    uint32_t framesInFlight = 2;
+    uint32_t meshProcessing = MESH_PROCESSING_FULL;
+
+    // NOTE: the overdraw analysis costs more than most of the processing, so the statistics are only printed with -meshstats
+    bool meshStatistics = false;
+
+    // NOTE: headless renders offscreen without a window, surface or swapchain, e.g. on a render farm with lavapipe
+    bool headless = false;
+    uint32_t headlessWidth = 1024;
+    uint32_t headlessHeight = 768;
+    uint64_t frameLimit = 0;
+    const char* outputPath = 0;
+
+    // NOTE: in benchmark mode -frames is the number of measured frames, run after -warmup frames
+    const char* benchmarkPath = 0;
+    uint32_t warmupFrames = 60;
+
+    const char* gpuProfilePath = 0;
+
+    // NOTE: the trace is written at exit when -trace is passed, and whenever F9 is pressed in the window
+    const char* tracePath = "trace.json";
+    bool traceOnExit = false;
+
+    bool microbench = false;
+
+    // NOTE: -recordsweep measures parallel recording for 1 to -threads threads (all hardware threads by default)
+    // against 10k to 100k draws, without a window, and exits
+    bool recordSweep = false;
+
+    uint32_t objectCount = 1;
+    bool packedVertices = false;
+
+    // NOTE: meshlet culling needs the mesh baked with meshlets, the GPU path falls back to the CPU one without indirect count
+    MeshletCulling meshletCulling = MESHLET_CULLING_NONE;
+
+    // NOTE: mesh shading replaces the vertex pipeline (and meshlet culling, it culls in the task shader); it's opt-in
+    // with -meshshading on and falls back to the vertex pipeline on devices that don't have it; -meshshading compare
+    // benchmarks the vertex pipeline and then mesh shading on the same scene in one run
+    bool meshShadingRequested = false;
+    bool comparePaths = false;
+
+    // NOTE: object frustum culling in drawcull.comp, the CPU only records one indirect draw; the meshlet paths need the
+    // visible object list on the CPU, so they keep culling objects there
+    bool gpuCulling = false;
+
+    // NOTE: two phase occlusion culling against a depth pyramid on top of GPU object culling, -occlusion off leaves
+    // plain frustum culling for comparison
+    bool occlusionCulling = true;
+
+    // NOTE: screen space error in pixels a LOD is allowed to have, -lod off always draws LOD 0; the meshlet paths
+    // only have meshlets for LOD 0, so they ignore LODs
+    float lodThreshold = 1.0f;
+    bool lodRequested = false;
+
+    // NOTE: job system workers (the main thread included) recording slices of the CPU built draw list into secondary
+    // command buffers, 0 records everything inline on the main thread
+    uint32_t recordThreadCount = 0;
+
+    // NOTE: mesh uploads go to a dedicated transfer queue when the device has one, -transfer off keeps them on the
+    // graphics queue for comparison
+    bool transferQueueAllowed = true;
+
+    // NOTE: GPU object culling goes to a compute only queue when the device has one (and timeline semaphores), where the
+    // next frame's cull overlaps with the current frame's drawing; -asynccompute off keeps it on the graphics queue
+    bool asyncComputeAllowed = true;
+    const char* gpuTracePath = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-inflight") == 0) && (i + 1 < argc))
+            framesInFlight = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "-headless") == 0)
+            headless = true;
+        else if ((strcmp(argv[i], "-size") == 0) && (i + 2 < argc))
+        {
+            headlessWidth = uint32_t(atoi(argv[++i]));
+            headlessHeight = uint32_t(atoi(argv[++i]));
+        }
+        else if ((strcmp(argv[i], "-frames") == 0) && (i + 1 < argc))
+            frameLimit = uint64_t(atoll(argv[++i]));
+        else if ((strcmp(argv[i], "-output") == 0) && (i + 1 < argc))
+            outputPath = argv[++i];
+        else if ((strcmp(argv[i], "-benchmark") == 0) && (i + 1 < argc))
+            benchmarkPath = argv[++i];
+        else if ((strcmp(argv[i], "-warmup") == 0) && (i + 1 < argc))
+            warmupFrames = uint32_t(atoi(argv[++i]));
+        else if ((strcmp(argv[i], "-gpuprofile") == 0) && (i + 1 < argc))
+            gpuProfilePath = argv[++i];
+        else if (strcmp(argv[i], "-microbench") == 0)
+            microbench = true;
+        else if (strcmp(argv[i], "-recordsweep") == 0)
+            recordSweep = true;
+        else if ((strcmp(argv[i], "-objects") == 0) && (i + 1 < argc))
+            objectCount = std::max(1, atoi(argv[++i]));
+        else if ((strcmp(argv[i], "-vertices") == 0) && (i + 1 < argc))
+        {
+            const char* mode = argv[++i];
+
+            if (strcmp(mode, "packed") == 0)
+                packedVertices = true;
+            else if (strcmp(mode, "float") == 0)
+                packedVertices = false;
+            else
+            {
+                printf("ERROR: Unknown -vertices mode %s, expected float or packed\n", mode);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "-meshlets") == 0) && (i + 1 < argc))
+        {
+            const char* mode = argv[++i];
+
+            if (strcmp(mode, "gpu") == 0)
+                meshletCulling = MESHLET_CULLING_GPU;
+            else if (strcmp(mode, "cpu") == 0)
+                meshletCulling = MESHLET_CULLING_CPU;
+            else if (strcmp(mode, "off") == 0)
+                meshletCulling = MESHLET_CULLING_NONE;
+            else
+            {
+                printf("ERROR: Unknown -meshlets mode %s, expected off, cpu or gpu\n", mode);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "-meshshading") == 0) && (i + 1 < argc))
+        {
+            const char* mode = argv[++i];
+
+            if (strcmp(mode, "on") == 0)
+                meshShadingRequested = true;
+            else if (strcmp(mode, "off") == 0)
+                meshShadingRequested = false;
+            else if (strcmp(mode, "compare") == 0)
+                meshShadingRequested = comparePaths = true;
+            else
+            {
+                printf("ERROR: Unknown -meshshading mode %s, expected on, off or compare\n", mode);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "-culling") == 0) && (i + 1 < argc))
+        {
+            const char* mode = argv[++i];
+
+            if (strcmp(mode, "gpu") == 0)
+                gpuCulling = true;
+            else if (strcmp(mode, "cpu") == 0)
+                gpuCulling = false;
+            else
+            {
+                printf("ERROR: Unknown -culling mode %s, expected cpu or gpu\n", mode);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "-occlusion") == 0) && (i + 1 < argc))
+            occlusionCulling = strcmp(argv[++i], "off") != 0;
+        else if ((strcmp(argv[i], "-threads") == 0) && (i + 1 < argc))
+            recordThreadCount = std::min(uint32_t(atoi(argv[++i])), uint32_t(MAX_RECORD_THREADS));
+        else if ((strcmp(argv[i], "-transfer") == 0) && (i + 1 < argc))
+            transferQueueAllowed = strcmp(argv[++i], "off") != 0;
+        else if ((strcmp(argv[i], "-asynccompute") == 0) && (i + 1 < argc))
+            asyncComputeAllowed = strcmp(argv[++i], "off") != 0;
+        else if ((strcmp(argv[i], "-gputrace") == 0) && (i + 1 < argc))
+            gpuTracePath = argv[++i];
+        else if ((strcmp(argv[i], "-lod") == 0) && (i + 1 < argc))
+        {
+            const char* mode = argv[++i];
+            lodThreshold = (strcmp(mode, "off") == 0) ? 0.0f : float(atof(mode));
+            lodRequested = lodThreshold > 0.0f;
+        }
+        else if ((strcmp(argv[i], "-trace") == 0) && (i + 1 < argc))
+        {
+            tracePath = argv[++i];
+            traceOnExit = true;
+        }
+        else if ((strcmp(argv[i], "-meshopt") == 0) && (i + 1 < argc))
+        {
+            const char* mode = argv[++i];
+
+            if (strcmp(mode, "none") == 0)
+                meshProcessing = 0;
+            else if (strcmp(mode, "index") == 0)
+                meshProcessing = MESH_DEDUPLICATE;
+            else if (strcmp(mode, "full") == 0)
+                meshProcessing = MESH_PROCESSING_FULL;
+            else
+            {
+                printf("ERROR: Unknown -meshopt mode %s, expected none, index or full\n", mode);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-meshstats") == 0)
+            meshStatistics = true;
+    }
+
+    if (meshStatistics)
+        meshProcessing |= MESH_STATISTICS;
+
+    // NOTE: the sweep brings its own job systems and pools, the renderer itself is set up headless and never runs a frame
+    uint32_t sweepThreadCount = 0;
+
+    if (recordSweep)
+    {
+        if (benchmarkPath)
+        {
+            printf("ERROR: -recordsweep doesn't render any frames, it can't be combined with -benchmark\n");
+            return 1;
+        }
+
+        sweepThreadCount = (recordThreadCount > 0) ? recordThreadCount : std::min(std::max(1u, std::thread::hardware_concurrency()), uint32_t(MAX_RECORD_THREADS));
+        recordThreadCount = 0;
+        headless = true;
+    }
+
+    if (comparePaths && !benchmarkPath)
+    {
+        printf("ERROR: -meshshading compare is a benchmark, it needs -benchmark\n");
+        return 1;
+    }
+
+    // NOTE: the meshlet paths cull objects on the CPU, only have meshlets for LOD 0 and record on the main thread; asking
+    // for one of them together with something they can't do is an error instead of quietly dropping one of the two
+    const char* meshletOption = comparePaths ? "-meshshading compare" : meshShadingRequested ? "-meshshading on" : (meshletCulling == MESHLET_CULLING_GPU) ? "-meshlets gpu" : "-meshlets cpu";
+    bool meshletRendering = meshShadingRequested || (meshletCulling != MESHLET_CULLING_NONE);
+
+    if (meshShadingRequested && (meshletCulling != MESHLET_CULLING_NONE))
+    {
+        printf("ERROR: %s culls meshlets in the task shader, it can't be combined with -meshlets\n", meshletOption);
+        return 1;
+    }
+
+    if (gpuCulling && meshletRendering)
+    {
+        printf("ERROR: %s needs the visible objects on the CPU, it can't be combined with -culling gpu\n", meshletOption);
+        return 1;
+    }
+
+    if (lodRequested && meshletRendering)
+    {
+        printf("ERROR: %s only has meshlets for LOD 0, it can't be combined with -lod\n", meshletOption);
+        return 1;
+    }
+
+    if ((recordThreadCount > 0) && (gpuCulling || meshShadingRequested || (meshletCulling == MESHLET_CULLING_GPU)))
+    {
+        printf("ERROR: only the CPU draw list can be recorded in parallel, -threads can't be combined with %s\n", gpuCulling ? "-culling gpu" : meshletOption);
+        return 1;
+    }
+
+    framesInFlight = std::max(1u, std::min(framesInFlight, uint32_t(MAX_FRAMES_IN_FLIGHT)));
+
+    setTraceThreadName("main");
+
+    // NOTE: CPU only, doesn't need a window or a device
+    if (microbench)
+    {
+        runMicrobenchmarks();
+        return 0;
+    }
+
+    // NOTE: a compare run measures the vertex path first, then warms up and measures mesh shading
+    Benchmark benchmarks[2] = {};
+    uint32_t benchmarkCount = benchmarkPath ? (comparePaths ? 2 : 1) : 0;
+
+    for (uint32_t i = 0; i < benchmarkCount; i++)
+    {
+        uint32_t measuredFrames = (frameLimit != 0) ? uint32_t(frameLimit) : 600;
+        createBenchmark(benchmarks[i], warmupFrames, measuredFrames, i * (warmupFrames + measuredFrames));
+    }
+
+    if (benchmarkCount > 0)
+    {
+        const Benchmark& lastBenchmark = benchmarks[benchmarkCount - 1];
+        frameLimit = uint64_t(lastBenchmark.firstFrame) + lastBenchmark.warmupFrames + lastBenchmark.measuredFrames;
+    }
+
+    if (headless && (frameLimit == 0))
+        frameLimit = 1;
+
+    if (!headless)
+    {
+        int rc = glfwInit();
+        assert(rc);
+    }
+
+    VK_CHECK(volkInitialize());
+
+    VkInstance instance = createInstance(headless);
+    assert(instance);
+
+    volkLoadInstance(instance);
+
+#if _DEBUG
+    VkDebugReportCallbackEXT debugCallback = registerDebugCallback(instance);
+#endif
+
+    VkPhysicalDevice physicalDevices[16];
+    uint32_t physicalDeviceCount = ARRAYSIZE(physicalDevices);
+    VK_CHECK(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices));
+
+    VkPhysicalDevice physicalDevice = pickPhysicalDevice(physicalDevices, physicalDeviceCount, headless);
+    assert(physicalDevice);
+
+    uint32_t familyIndex = getGraphicsFamilyIndex(physicalDevice);
+    assert(familyIndex != VK_QUEUE_FAMILY_IGNORED);
+
+    uint32_t transferFamilyIndex = transferQueueAllowed ? getTransferFamilyIndex(physicalDevice) : VK_QUEUE_FAMILY_IGNORED;
+
+    if (transferFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
+        printf("Uploads: transfer queue family %u\n", transferFamilyIndex);
+    else
+        printf("Uploads: graphics queue\n");
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+    DeviceFeatures deviceFeatures = {};
+    getDeviceFeatures(deviceFeatures, physicalDevice);
+
+    // NOTE: the task and mesh shader share one push constant block bigger than the guaranteed 128 bytes
+    bool meshShadingSupported = deviceFeatures.meshShading && (props.limits.maxPushConstantsSize >= sizeof(MeshShadingData));
+
+    if (meshShadingRequested && !meshShadingSupported)
+        printf("WARNING: mesh shading isn't supported, using the vertex pipeline\n");
+
+    if (comparePaths && !meshShadingSupported)
+    {
+        printf("ERROR: -meshshading compare needs a device with mesh shading\n");
+        return 1;
+    }
+
+    deviceFeatures.meshShading = meshShadingRequested && meshShadingSupported;
+    deviceFeatures.meshShadingEXT = deviceFeatures.meshShadingEXT && deviceFeatures.meshShading;
+
+    bool meshShading = deviceFeatures.meshShading;
+
+    if ((meshletCulling == MESHLET_CULLING_GPU) && !deviceFeatures.indirectCount)
+    {
+        printf("WARNING: drawIndirectCount isn't supported, culling meshlets on the CPU\n");
+        meshletCulling = MESHLET_CULLING_CPU;
+    }
+
+    if (gpuCulling && !deviceFeatures.indirectCount)
+    {
+        printf("WARNING: drawIndirectCount isn't supported, culling objects on the CPU\n");
+        gpuCulling = false;
+    }
+
+    occlusionCulling = occlusionCulling && gpuCulling;
+
+    // NOTE: only object culling runs on the async compute queue, the meshlet paths cull on the graphics queue
+    uint32_t computeFamilyIndex = (gpuCulling && asyncComputeAllowed) ? getComputeFamilyIndex(physicalDevice) : VK_QUEUE_FAMILY_IGNORED;
+
+    if ((computeFamilyIndex != VK_QUEUE_FAMILY_IGNORED) && !deviceFeatures.timelineSemaphores)
+    {
+        printf("WARNING: timeline semaphores aren't supported, culling objects on the graphics queue\n");
+        computeFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    }
+
+    bool asyncCull = computeFamilyIndex != VK_QUEUE_FAMILY_IGNORED;
+
+    // NOTE: -lod was rejected above, this only turns off the default threshold
+    if (meshShading || (meshletCulling != MESHLET_CULLING_NONE))
+    {
+        meshProcessing |= MESH_MESHLETS;
+        lodThreshold = 0.0f;
+    }
+
+    if (lodThreshold > 0.0f)
+        meshProcessing |= MESH_LODS;
+
+    const char* renderPath = comparePaths ? "vertex, then mesh" : meshShading ? "mesh" : "vertex";
+    printf("Render path: %s shaders\n", renderPath);
+
+    if (meshShading)
+        printf("Mesh shading: %s\n", deviceFeatures.meshShadingEXT ? "VK_EXT_mesh_shader" : "VK_NV_mesh_shader");
+
+    VkDevice device = createDevice(physicalDevice, familyIndex, transferFamilyIndex, computeFamilyIndex, deviceFeatures, headless);
+    assert(device);
+
+    GLFWwindow* window = 0;
+    VkSurfaceKHR surface = 0;
+    VkFormat swapchainFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+    if (!headless)
+    {
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        window = glfwCreateWindow(1024, 768, "vulkan learning", 0, 0);
+        assert(window);
+
+        surface = createSurface(instance, window);
+        assert(surface);
+
+        VkBool32 presentSupported = 0;
+        VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, familyIndex, surface, &presentSupported));
+        assert(presentSupported);
+
+        swapchainFormat = getSwapchainFormat(physicalDevice, surface);
+    }
+
+    VkFormat depthFormat = getDepthFormat(physicalDevice);
+    assert(depthFormat != VK_FORMAT_UNDEFINED);
+
+    VkQueue queue = 0;
+    vkGetDeviceQueue(device, familyIndex, 0, &queue);
+
+    VkQueue transferQueue = 0;
+    if (transferFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
+        vkGetDeviceQueue(device, transferFamilyIndex, 0, &transferQueue);
+
+    AsyncCompute asyncCompute = {};
+    if (asyncCull)
+    {
+        VkQueue computeQueue = 0;
+        vkGetDeviceQueue(device, computeFamilyIndex, 0, &computeQueue);
+
+        createAsyncCompute(asyncCompute, device, computeFamilyIndex, computeQueue);
+    }
+
+    VkRenderPass renderPass = createRenderPass(device, swapchainFormat, depthFormat);
+    assert(renderPass);
+
+    // NOTE: the late pass of occlusion culling draws on top of the early one
+    VkRenderPass renderPassLate = 0;
+    if (occlusionCulling)
+    {
+        renderPassLate = createRenderPass(device, swapchainFormat, depthFormat, true);
+        assert(renderPassLate);
+    }
+
+    VkShaderModule triangleVS = loadShader(device, "shaders_bytecode/triangle.vert.spv");
+    assert(triangleVS);
+    VkShaderModule triangleFS = loadShader(device, "shaders_bytecode/triangle.frag.spv");
+    assert(triangleFS);
+
+    // NOTE: all pipelines go through this one cache, so it is saved once with everything merged in
+    bool pipelineCacheWarm = false;
+    VkPipelineCache pipelineCache = loadPipelineCache(device, props, "pipeline_cache.bin", &pipelineCacheWarm);
+    assert(pipelineCache);
+
+    // NOTE: vertices and draws, the view-projection matrix goes through push constants
+    VkDescriptorSetLayout triangleSetLayout = createSetLayout(device, 2, VK_SHADER_STAGE_VERTEX_BIT);
+    assert(triangleSetLayout);
+
+    VkPipelineLayout triangleLayout = createPipelineLayout(device, triangleSetLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(Globals));
+    assert(triangleLayout);
+
+    double pipelineTimeBegin = getTimeMs();
+
+    // NOTE: constant_id 0 selects how the vertex shader decodes the vertex buffer
+    VkBool32 packedVerticesConstant = packedVertices;
+    VkSpecializationMapEntry specializationEntry = { 0, 0, sizeof(VkBool32) };
+
+    VkSpecializationInfo vertexSpecialization = {};
+    vertexSpecialization.mapEntryCount = 1;
+    vertexSpecialization.pMapEntries = &specializationEntry;
+    vertexSpecialization.dataSize = sizeof(packedVerticesConstant);
+    vertexSpecialization.pData = &packedVerticesConstant;
+
+    VkPipelineShaderStageCreateInfo triangleStages[] =
+    {
+        shaderStage(VK_SHADER_STAGE_VERTEX_BIT, triangleVS, &vertexSpecialization),
+        shaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, triangleFS),
+    };
+
+    VkPipeline trianglePipeline = createGraphicsPipeline(device, pipelineCache, renderPass, triangleStages, ARRAYSIZE(triangleStages), triangleLayout);
+    assert(trianglePipeline);
+
+    // NOTE: meshlets, draws, visible objects, commands and the command count
+    VkShaderModule meshletCullCS = 0;
+    VkDescriptorSetLayout meshletCullSetLayout = 0;
+    VkPipelineLayout meshletCullLayout = 0;
+    VkPipeline meshletCullPipeline = 0;
+
+    if (meshletCulling == MESHLET_CULLING_GPU)
+    {
+        meshletCullCS = loadShader(device, "shaders_bytecode/meshletcull.comp.spv");
+        assert(meshletCullCS);
+
+        meshletCullSetLayout = createSetLayout(device, 5, VK_SHADER_STAGE_COMPUTE_BIT);
+        assert(meshletCullSetLayout);
+
+        meshletCullLayout = createPipelineLayout(device, meshletCullSetLayout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(MeshletCullData));
+        assert(meshletCullLayout);
+
+        meshletCullPipeline = createComputePipeline(device, pipelineCache, meshletCullCS, meshletCullLayout);
+        assert(meshletCullPipeline);
+    }
+
+    // NOTE: object bounds, LODs, commands, command counts, object visibility and the depth pyramid
+    VkShaderModule drawCullCS = 0;
+    VkDescriptorSetLayout drawCullSetLayout = 0;
+    VkPipelineLayout drawCullLayout = 0;
+    VkPipeline drawCullPipeline = 0;
+
+    if (gpuCulling)
+    {
+        drawCullCS = loadShader(device, "shaders_bytecode/drawcull.comp.spv");
+        assert(drawCullCS);
+
+        VkDescriptorType descriptorTypes[] =
+        {
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        };
+
+        drawCullSetLayout = createSetLayout(device, descriptorTypes, ARRAYSIZE(descriptorTypes), VK_SHADER_STAGE_COMPUTE_BIT);
+        assert(drawCullSetLayout);
+
+        drawCullLayout = createPipelineLayout(device, drawCullSetLayout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(DrawCullData));
+        assert(drawCullLayout);
+
+        drawCullPipeline = createComputePipeline(device, pipelineCache, drawCullCS, drawCullLayout);
+        assert(drawCullPipeline);
+    }
+
+    // NOTE: previous pyramid level (or the depth buffer) and the level being written
+    VkShaderModule depthReduceCS = 0;
+    VkDescriptorSetLayout depthReduceSetLayout = 0;
+    VkPipelineLayout depthReduceLayout = 0;
+    VkPipeline depthReducePipeline = 0;
+
+    if (occlusionCulling)
+    {
+        depthReduceCS = loadShader(device, "shaders_bytecode/depthreduce.comp.spv");
+        assert(depthReduceCS);
+
+        VkDescriptorType descriptorTypes[] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE };
+
+        depthReduceSetLayout = createSetLayout(device, descriptorTypes, ARRAYSIZE(descriptorTypes), VK_SHADER_STAGE_COMPUTE_BIT);
+        assert(depthReduceSetLayout);
+
+        depthReduceLayout = createPipelineLayout(device, depthReduceSetLayout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(DepthReduceData));
+        assert(depthReduceLayout);
+
+        depthReducePipeline = createComputePipeline(device, pipelineCache, depthReduceCS, depthReduceLayout);
+        assert(depthReducePipeline);
+    }
+
+    // NOTE: vertices, draws, meshlets, meshlet vertices, meshlet triangles and visible objects
+    VkShaderModule meshletTS = 0;
+    VkShaderModule meshletMS = 0;
+    VkDescriptorSetLayout meshSetLayout = 0;
+    VkPipelineLayout meshLayout = 0;
+    VkPipeline meshPipeline = 0;
+
+    VkPhysicalDeviceMeshShaderPropertiesNV meshShaderProps = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_NV };
+
+#if defined(VK_EXT_mesh_shader)
+    VkPhysicalDeviceMeshShaderPropertiesEXT meshShaderPropsEXT = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT };
+#endif
+
+    // NOTE: the EXT stage bits have the same values as the NV ones, only the shaders and the draw call differ
+    if (meshShading)
+    {
+        VkPhysicalDeviceProperties2 props2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+        props2.pNext = &meshShaderProps;
+
+#if defined(VK_EXT_mesh_shader)
+        if (deviceFeatures.meshShadingEXT)
+            props2.pNext = &meshShaderPropsEXT;
+#endif
+
+        vkGetPhysicalDeviceProperties2(physicalDevice, &props2);
+
+        meshletTS = loadShader(device, deviceFeatures.meshShadingEXT ? "shaders_bytecode/meshletext.task.spv" : "shaders_bytecode/meshlet.task.spv");
+        assert(meshletTS);
+        meshletMS = loadShader(device, deviceFeatures.meshShadingEXT ? "shaders_bytecode/meshletext.mesh.spv" : "shaders_bytecode/meshlet.mesh.spv");
+        assert(meshletMS);
+
+        meshSetLayout = createSetLayout(device, 6, VK_SHADER_STAGE_TASK_BIT_NV | VK_SHADER_STAGE_MESH_BIT_NV);
+        assert(meshSetLayout);
+
+        meshLayout = createPipelineLayout(device, meshSetLayout, VK_SHADER_STAGE_TASK_BIT_NV | VK_SHADER_STAGE_MESH_BIT_NV, sizeof(MeshShadingData));
+        assert(meshLayout);
+
+        VkPipelineShaderStageCreateInfo meshStages[] =
+        {
+            shaderStage(VK_SHADER_STAGE_TASK_BIT_NV, meshletTS),
+            shaderStage(VK_SHADER_STAGE_MESH_BIT_NV, meshletMS, &vertexSpecialization),
+            shaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, triangleFS),
+        };
+
+        meshPipeline = createGraphicsPipeline(device, pipelineCache, renderPass, meshStages, ARRAYSIZE(meshStages), meshLayout);
+        assert(meshPipeline);
+    }
+
+    printf("Pipelines created in %.2f ms (%s pipeline cache)\n", getTimeMs() - pipelineTimeBegin, pipelineCacheWarm ? "warm" : "cold");
+
+    MemoryAllocator allocator = {};
+    createAllocator(allocator, device, physicalDevice);
+
+    // NOTE: headless gets one offscreen image per frame in flight, so the frame fence also guards its image
+    Swapchain swapchain;
+    if (headless)
+        createOffscreenSwapchain(swapchain, device, swapchainFormat, depthFormat, renderPass, allocator, headlessWidth, headlessHeight, framesInFlight);
+    else
+        createSwapchain(swapchain, physicalDevice, device, surface, familyIndex, swapchainFormat, depthFormat, renderPass, allocator);
+
+    // NOTE: drawcull.comp always binds the pyramid, so it exists (unused) with occlusion culling off too; the async cull
+    // only starts once a cull on the graphics queue has put a new pyramid in GENERAL
+    VkSampler depthPyramidSampler = 0;
+    DepthPyramid depthPyramid = {};
+    bool depthPyramidInitialized = false;
+
+    if (gpuCulling)
+    {
+        depthPyramidSampler = createSampler(device);
+        assert(depthPyramidSampler);
+
+        createDepthPyramid(depthPyramid, device, allocator, swapchain.width, swapchain.height);
+    }
+
+    // NOTE: the pyramid is exclusive to the graphics queue, which rebuilds it while the compute queue culls; the early
+    // phase never samples it but has to bind something, so the compute queue gets a 1x1 stand in only it ever touches
+    DepthPyramid computePyramid = {};
+
+    if (asyncCull)
+        createDepthPyramid(computePyramid, device, allocator, 1, 1);
+
+    Frame frames[MAX_FRAMES_IN_FLIGHT] = {};
+    for (uint32_t i = 0; i < framesInFlight; i++)
+        createFrame(frames[i], device, familyIndex, computeFamilyIndex, recordThreadCount);
+
+    // NOTE: the main thread is one of the workers
+    JobSystem jobSystem;
+    if (recordThreadCount > 0)
+        createJobSystem(jobSystem, recordThreadCount);
+
+    if (recordSweep)
+        runRecordSweep(device, familyIndex, allocator, renderPass, trianglePipeline, triangleLayout, sweepThreadCount);
+
+    StagingRing stagingRing = {};
+    createStagingRing(stagingRing, device, allocator, familyIndex, 16 * 1024 * 1024);
+
+    // NOTE: the mesh streams in while the render loop already presents; headless and benchmark runs wait for it before
+    // their first frame, so what they render and measure doesn't depend on how fast it loaded
+    AssetLoader assetLoader;
+    createAssetLoader(assetLoader, device, allocator, familyIndex, queue, transferFamilyIndex, transferQueue, 64 * 1024 * 1024);
+
+    uint32_t meshAssetFlags = (packedVertices ? MESH_ASSET_PACKED_VERTICES : 0) | (meshShading ? MESH_ASSET_MESHLET_GEOMETRY : 0) |
+                              ((meshShading || (meshletCulling == MESHLET_CULLING_GPU)) ? MESH_ASSET_MESHLETS : 0);
+
+    MeshAsset* meshAsset = 0;
+    if (!recordSweep)
+        requestMesh(assetLoader, "meshes/kitten.obj", meshProcessing, meshAssetFlags, onMeshReady, &meshAsset);
+
+    bool waitForMesh = headless || benchmarkPath;
+    bool meshReady = false;
+    bool meshFailed = false;
+
+    // NOTE: everything from here on that depends on the mesh is filled in once it has landed; the camera orbits the
+    // placeholder bounds until then
+    vec3 meshCenter = vec3(0.0f, 0.0f, 0.0f);
+    float meshRadius = 1.0f;
+
+    VertexQuantization vertexQuantization = { vec3(0.0f, 0.0f, 0.0f), vec3(1.0f, 1.0f, 1.0f) };
+
+    // NOTE: the index buffer holds every LOD, LOD 0 is the full mesh
+    std::vector<MeshLod> lods;
+    uint32_t indexCount = 0;
+
+    // NOTE: objects are uniformly scaled copies of the mesh, so relative to the bounding sphere the errors work for all of them
+    std::vector<MeshLod> objectLods;
+
+    std::vector<Meshlet> meshlets;
+    uint32_t taskGroupsPerObject = 0;
+
+    Buffer vb = {};
+    Buffer ib = {};
+    Buffer mb = {};
+    Buffer mvb = {};
+    Buffer mtb = {};
+    Buffer lb = {};
+
+    Scene scene = {};
+    Buffer db = {};
+
+    // NOTE: indices of the objects that survived culling this frame, in scene order
+    std::vector<uint32_t> visibleObjects(objectCount);
+    uint32_t visibleCount = 0;
+
+    // NOTE: CPU meshlet culling output, and the visible triangles of the objects that passed object culling
+    std::vector<VkDrawIndexedIndirectCommand> meshletCommands;
+    uint64_t visibleTriangles = 0;
+
+    // NOTE: one draw of the selected LOD per visible object, for the path without meshlets
+    std::vector<VkDrawIndexedIndirectCommand> objectCommands;
+
+    // NOTE: the visible object list is written by the CPU every frame, so every frame in flight gets its own copy;
+    // the commands are produced and consumed within one submission
+    uint64_t meshletCommandLimit = std::min(uint64_t(MESHLET_CULL_MAX_COMMANDS), uint64_t(props.limits.maxDrawIndirectCount));
+    uint32_t meshletCommandCapacity = 0;
+
+    Buffer objectBuffers[MAX_FRAMES_IN_FLIGHT] = {};
+    Buffer meshletCommandBuffer = {};
+    Buffer meshletCountBuffer = {};
+
+    if (meshShading || (meshletCulling == MESHLET_CULLING_GPU))
+    {
+        for (uint32_t i = 0; i < framesInFlight; i++)
+            createBuffer(objectBuffers[i], device, allocator, objectCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+
+    // NOTE: the command counts are copied back every frame and read once the frame's fence is signaled, so the number
+    // of visible objects lags behind by framesInFlight frames but never stalls; the early and the late phase of
+    // occlusion culling each get objectCount commands and a count
+    Buffer bb = {};
+    Buffer visibilityBuffer = {};
+    Buffer drawCountReadbacks[MAX_FRAMES_IN_FLIGHT] = {};
+
+    // NOTE: the async cull of the next frame writes commands while this one still draws, so every frame in flight
+    // gets its own; on the graphics queue the frames take turns with one
+    Buffer drawCommandBuffers[MAX_FRAMES_IN_FLIGHT] = {};
+    Buffer drawCountBuffers[MAX_FRAMES_IN_FLIGHT] = {};
+    uint32_t drawCommandBufferCount = asyncCull ? framesInFlight : 1;
+
+    // NOTE: everything drawcull.comp reads or writes is used by both queues with async compute
+    uint32_t cullFamilies[] = { familyIndex, computeFamilyIndex };
+    uint32_t cullFamilyCount = asyncCull ? ARRAYSIZE(cullFamilies) : 0;
+
+    if (gpuCulling)
+    {
+        // NOTE: nothing is visible before the first frame, so the first early phase draws nothing
+        std::vector<uint32_t> visibility(objectCount, 0);
+
+        createBuffer(visibilityBuffer, device, allocator, visibility.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                     cullFamilies, cullFamilyCount);
+        uploadBuffer(stagingRing, device, queue, visibilityBuffer, 0, visibility.data(), visibility.size() * sizeof(uint32_t));
+
+        for (uint32_t i = 0; i < drawCommandBufferCount; i++)
+        {
+            createBuffer(drawCommandBuffers[i], device, allocator, 2 * objectCount * sizeof(VkDrawIndexedIndirectCommand),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cullFamilies, cullFamilyCount);
+            createBuffer(drawCountBuffers[i], device, allocator, 2 * sizeof(uint32_t),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                         cullFamilies, cullFamilyCount);
+        }
+
+        for (uint32_t i = 0; i < framesInFlight; i++)
+        {
+            createBuffer(drawCountReadbacks[i], device, allocator, 2 * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            memset(drawCountReadbacks[i].data, 0, 2 * sizeof(uint32_t));
+        }
+    }
+
+    printf("Scene: %u objects, %s culling: %s\n", objectCount, gpuCulling ? "GPU" : "CPU", gpuCulling ? "drawcull.comp" : VKL_SIMD_NAME);
+
+    if (asyncCull)
+        printf("Async compute: object culling on queue family %u\n", computeFamilyIndex);
+
+    if (occlusionCulling)
+        printf("Occlusion culling: two phase, %ux%u depth pyramid with %u levels\n", depthPyramid.width, depthPyramid.height, depthPyramid.levelCount);
+
+    GpuProfiler gpuProfiler = {};
+    createGpuProfiler(gpuProfiler, device, physicalDevice, familyIndex, computeFamilyIndex, framesInFlight);
+
+    if (gpuTracePath)
+        enableGpuTrace(gpuProfiler);
+
+    uint64_t submitCount = 0;
+    uint64_t completedCount = 0;
+
+    double renderTimeBegin = getTimeMs();
+    double frameTimeBegin = renderTimeBegin;
+    double gpuFrameTime = 0.0;
+
+    bool traceKeyWasDown = false;
+
+    while (!recordSweep && (headless || !glfwWindowShouldClose(window)))
+    {
+        // NOTE: CPU frame time is measured from the start of one iteration to the start of the next
+        double frameTimeEnd = getTimeMs();
+        if (submitCount > 0)
+            recordBenchmarkSample(benchmarks, benchmarkCount, BENCHMARK_CPU_FRAME, submitCount - 1, frameTimeEnd - frameTimeBegin);
+
+        updateBenchmarkMeasureTime(benchmarks, benchmarkCount, submitCount, frameTimeEnd);
+
+        frameTimeBegin = frameTimeEnd;
+
+        if ((frameLimit != 0) && (submitCount >= frameLimit))
+            break;
+
+        TRACE_ZONE("frame");
+
+        if (!headless)
+        {
+            {
+                TRACE_ZONE("glfwPollEvents");
+                glfwPollEvents();
+            }
+
+            {
+                TRACE_ZONE("resizeSwapchainIfNecessary");
+                resizeSwapchainIfNecessary(swapchain, physicalDevice, device, surface, familyIndex, swapchainFormat, depthFormat, renderPass, allocator);
+
+                // NOTE: rare enough that waiting for the GPU to be done with the old pyramid is fine
+                if (gpuCulling && ((depthPyramid.width != previousPow2(swapchain.width)) || (depthPyramid.height != previousPow2(swapchain.height))))
+                {
+                    VK_CHECK(vkDeviceWaitIdle(device));
+
+                    destroyDepthPyramid(depthPyramid, device, allocator);
+                    createDepthPyramid(depthPyramid, device, allocator, swapchain.width, swapchain.height);
+                    depthPyramidInitialized = false;
+                }
+            }
+
+            // NOTE: edge triggered, so holding the key down doesn't dump every frame
+            bool traceKeyDown = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+            if (traceKeyDown && !traceKeyWasDown)
+            {
+                TRACE_ZONE("writeTrace");
+
+                if (writeTrace(tracePath))
+                    printf("Wrote %s\n", tracePath);
+                else
+                    printf("ERROR: Failed to write %s\n", tracePath);
+            }
+
+            traceKeyWasDown = traceKeyDown;
+        }
+
+        uint32_t frameIndex = uint32_t(submitCount % framesInFlight);
+        Frame& frame = frames[frameIndex];
+
+        // NOTE: everything for both paths exists in a compare run, the frames before the second benchmark draw with vertex shaders
+        bool meshShadingFrame = meshShading && (!comparePaths || (submitCount >= benchmarks[1].firstFrame));
+
+        // NOTE: only blocks when the CPU is framesInFlight frames ahead of the GPU
+        {
+            TRACE_ZONE("vkWaitForFences");
+            VK_CHECK(vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+        }
+        completedCount = std::max(completedCount, frame.submitIndex);
+
+        for (uint32_t i = 0; i < framesInFlight; i++)
+            if ((frames[i].submitIndex > completedCount) && (vkGetFenceStatus(device, frames[i].fence) == VK_SUCCESS))
+                completedCount = frames[i].submitIndex;
+
+        if (resolveGpuProfilerFrame(gpuProfiler, device, frameIndex, &gpuFrameTime))
+            recordBenchmarkSample(benchmarks, benchmarkCount, BENCHMARK_GPU_FRAME, frame.submitIndex - 1, gpuFrameTime);
+
+        updateAssetLoader(assetLoader, device, allocator, waitForMesh && !meshReady);
+
+        // NOTE: the mesh has landed, everything that depends on it is created here and this frame already draws it
+        if (meshAsset && !meshReady)
+        {
+            TRACE_ZONE("createMeshResources");
+
+            MeshAsset& asset = *meshAsset;
+
+            // NOTE: the loader has already said why, there is nothing to render without the mesh
+            if (asset.failed)
+            {
+                printf("ERROR: No mesh to render, exiting\n");
+                meshFailed = true;
+                break;
+            }
+
+            printf("Mesh loaded in %.2f ms on the loader thread\n", asset.loadTime);
+
+            meshCenter = asset.center;
+            meshRadius = asset.radius;
+            vertexQuantization = asset.vertexQuantization;
+
+            lods = asset.lods;
+            indexCount = lods[0].indexCount;
+
+            meshlets = asset.meshlets;
+            taskGroupsPerObject = uint32_t((meshlets.size() + MESH_TASK_GROUP_SIZE - 1) / MESH_TASK_GROUP_SIZE);
+
+            vb = asset.buffers[MESH_ASSET_VERTICES];
+            ib = asset.buffers[MESH_ASSET_INDICES];
+            mb = asset.buffers[MESH_ASSET_MESHLETS];
+            mvb = asset.buffers[MESH_ASSET_MESHLET_VERTICES];
+            mtb = asset.buffers[MESH_ASSET_MESHLET_TRIANGLES];
+
+            objectLods = lods;
+            for (size_t i = 0; i < objectLods.size(); i++)
+                objectLods[i].error /= meshRadius;
+
+            if (gpuCulling)
+            {
+                createBuffer(lb, device, allocator, objectLods.size() * sizeof(MeshLod), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             cullFamilies, cullFamilyCount);
+                uploadBuffer(stagingRing, device, queue, lb, 0, objectLods.data(), objectLods.size() * sizeof(MeshLod));
+            }
+
+            createScene(scene, objectCount, meshCenter, meshRadius);
+
+            createBuffer(db, device, allocator, scene.draws.size() * sizeof(MeshDraw), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            uploadBuffer(stagingRing, device, queue, db, 0, scene.draws.data(), scene.draws.size() * sizeof(MeshDraw));
+
+            meshletCommandCapacity = uint32_t(std::min(uint64_t(objectCount) * meshlets.size(), meshletCommandLimit));
+
+            if (meshletCulling == MESHLET_CULLING_GPU)
+            {
+                // NOTE: the cull pass binds the buffer even when there are no meshlets and maxCommandCount keeps it from
+                // writing anything, but buffers can't be empty
+                createBuffer(meshletCommandBuffer, device, allocator, std::max(meshletCommandCapacity, 1u) * sizeof(VkDrawIndexedIndirectCommand),
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                createBuffer(meshletCountBuffer, device, allocator, sizeof(uint32_t),
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            }
+
+            if (gpuCulling)
+            {
+                std::vector<vec4> bounds(objectCount);
+                for (uint32_t i = 0; i < objectCount; i++)
+                    bounds[i] = vec4(scene.bounds.X[i], scene.bounds.Y[i], scene.bounds.Z[i], scene.bounds.Radius[i]);
+
+                createBuffer(bb, device, allocator, bounds.size() * sizeof(vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             cullFamilies, cullFamilyCount);
+                uploadBuffer(stagingRing, device, queue, bb, 0, bounds.data(), bounds.size() * sizeof(vec4));
+            }
+
+            if (meshShading)
+                printf("Meshlets: %u per object, culled in the task shader\n", uint32_t(meshlets.size()));
+            else if (meshletCulling != MESHLET_CULLING_NONE)
+                printf("Meshlets: %u per object, culled on the %s\n", uint32_t(meshlets.size()), (meshletCulling == MESHLET_CULLING_GPU) ? "GPU" : "CPU");
+
+            if (lods.size() > 1)
+                printf("LODs: %u, down to %.1f%% of the triangles, %.1f pixel threshold\n", uint32_t(lods.size()),
+                       double(lods.back().indexCount) / double(indexCount) * 100.0, double(lodThreshold));
+
+            printf("Geometry: %s\n", vb.data ? "host visible device local memory (UMA/ReBAR)" : "device local memory, streamed through the asset ring");
+            printf("Vertices: %s, %.1f KB\n", packedVertices ? "packed" : "full float", double(vb.size) / 1024.0);
+
+            printMemoryStats(allocator);
+
+            meshReady = true;
+        }
+
+        if (gpuCulling)
+        {
+            const uint32_t* drawCounts = static_cast<const uint32_t*>(drawCountReadbacks[frameIndex].data);
+            visibleCount = drawCounts[0] + drawCounts[1];
+        }
+
+        uint32_t imageIndex = frameIndex;
+        if (!headless)
+        {
+            TRACE_ZONE("vkAcquireNextImageKHR");
+
+            double acquireTimeBegin = getTimeMs();
+            VK_CHECK(vkAcquireNextImageKHR(device, swapchain.swapchain, UINT64_MAX, frame.acquireSemaphore, VK_NULL_HANDLE, &imageIndex));
+            recordBenchmarkSample(benchmarks, benchmarkCount, BENCHMARK_ACQUIRE, submitCount, getTimeMs() - acquireTimeBegin);
+        }
+
+        VK_CHECK(vkResetFences(device, 1, &frame.fence));
+
+        // NOTE: the camera orbits the scene by a fixed angle per frame, so runs are reproducible
+        float cameraAngle = Radians(float(submitCount) * 0.25f);
+        float cameraDistance = meshRadius * 3.0f;
+        vec3 cameraPosition = scene.center + vec3(sinf(cameraAngle), 0.25f, cosf(cameraAngle)) * cameraDistance;
+
+        float znear = meshRadius * 0.05f;
+        float zfar = cameraDistance + scene.radius;
+
+        mat4 view = LookAt(cameraPosition, scene.center);
+        mat4 projection = PerspectiveVk(70.0f, float(swapchain.width) / float(swapchain.height), znear, zfar);
+        Globals globals = {};
+        globals.viewProjection = projection * view;
+        globals.positionOffset = vec4(vertexQuantization.offset, 0.0f);
+        globals.positionScale = vec4(vertexQuantization.scale, 0.0f);
+
+        // NOTE: a unit at distance 1 covers P11 * height / 2 pixels
+        float lodTarget = lodThreshold * 2.0f / (projection.a22 * float(swapchain.height));
+
+        MeshletCullData meshletCullData = {};
+        DrawCullData drawCullData = {};
+
+        {
+            TRACE_ZONE("cull");
+
+            double cullTimeBegin = getTimeMs();
+
+            plane frustumPlanes[FRUSTUM_PLANE_COUNT];
+            ExtractFrustumPlanes(frustumPlanes, globals.viewProjection);
+
+            if (gpuCulling)
+            {
+                float frustumX = sqrtf(projection.a11 * projection.a11 + 1.0f);
+                float frustumY = sqrtf(projection.a22 * projection.a22 + 1.0f);
+
+                drawCullData.view = view;
+                drawCullData.frustum = vec4(projection.a11 / frustumX, 1.0f / frustumX, projection.a22 / frustumY, 1.0f / frustumY);
+                drawCullData.P00 = projection.a11;
+                drawCullData.P11 = projection.a22;
+                drawCullData.P22 = projection.a33;
+                drawCullData.P23 = projection.a34;
+                drawCullData.znear = znear;
+                drawCullData.zfar = zfar;
+                drawCullData.lodTarget = lodTarget;
+                drawCullData.objectCount = objectCount;
+                drawCullData.phase = occlusionCulling ? DRAW_CULL_EARLY : DRAW_CULL_ALL;
+            }
+            else if (meshReady)
+            {
+                visibleCount = CullSpheres(frustumPlanes, scene.bounds, objectCount, visibleObjects.data());
+            }
+
+            if (meshletCulling == MESHLET_CULLING_CPU)
+                visibleTriangles = cullMeshlets(meshletCommands, meshlets.data(), uint32_t(meshlets.size()), scene.draws.data(),
+                                                visibleObjects.data(), visibleCount, frustumPlanes, cameraPosition);
+
+            if (!gpuCulling && !meshShadingFrame && (meshletCulling == MESHLET_CULLING_NONE))
+            {
+                objectCommands.resize(visibleCount);
+
+                for (uint32_t i = 0; i < visibleCount; i++)
+                {
+                    uint32_t objectIndex = visibleObjects[i];
+
+                    vec3 center = vec3(scene.bounds.X[objectIndex], scene.bounds.Y[objectIndex], scene.bounds.Z[objectIndex]);
+                    float radius = scene.bounds.Radius[objectIndex];
+                    float distance = std::max(Length(center - cameraPosition) - radius, znear);
+
+                    const MeshLod& lod = objectLods[selectLod(objectLods.data(), uint32_t(objectLods.size()), radius, distance, lodTarget)];
+
+                    VkDrawIndexedIndirectCommand& command = objectCommands[i];
+                    command.indexCount = lod.indexCount;
+                    command.instanceCount = 1;
+                    command.firstIndex = lod.firstIndex;
+                    command.vertexOffset = 0;
+                    command.firstInstance = objectIndex;
+                }
+            }
+
+            if (meshShadingFrame || (meshletCulling == MESHLET_CULLING_GPU))
+            {
+                meshletCullData.cameraPosition = vec4(cameraPosition, 1.0f);
+                meshletCullData.meshletCount = uint32_t(meshlets.size());
+                meshletCullData.objectCount = visibleCount;
+                meshletCullData.maxCommandCount = meshletCommandCapacity;
+
+                for (uint32_t i = 0; i < FRUSTUM_PLANE_COUNT; i++)
+                    meshletCullData.frustum[i] = vec4(frustumPlanes[i].N, frustumPlanes[i].D);
+
+                memcpy(objectBuffers[frameIndex].data, visibleObjects.data(), visibleCount * sizeof(uint32_t));
+            }
+
+            recordBenchmarkSample(benchmarks, benchmarkCount, BENCHMARK_CULL, submitCount, getTimeMs() - cullTimeBegin);
+        }
+
+        VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+        // NOTE: set when this frame's early cull goes to the async compute queue and when the frame is split after its
+        // late cull, see Frame
+        VkCommandBuffer computeCommandBuffer = 0;
+        bool splitFrame = false;
+
+        {
+            TRACE_ZONE("record");
+
+            double recordTimeBegin = getTimeMs();
+
+            VK_CHECK(vkResetCommandPool(device, frame.commandPool, 0));
+
+            VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+            beginGpuProfilerFrame(gpuProfiler, commandBuffer, frameIndex);
+
+            // NOTE: the dispatch is capped by maxComputeWorkGroupCount, the shader loops over the rest
+            uint32_t drawCullGroupCount = std::min((objectCount + 63) / 64, props.limits.maxComputeWorkGroupCount[0]);
+
+            const Buffer& drawCommandBuffer = drawCommandBuffers[asyncCull ? frameIndex : 0];
+            const Buffer& drawCountBuffer = drawCountBuffers[asyncCull ? frameIndex : 0];
+
+            const Buffer* drawCullBuffers[] = { &bb, &lb, &drawCommandBuffer, &drawCountBuffer, &visibilityBuffer };
+
+            VkBufferMemoryBarrier drawCullBarriers[2] =
+            {
+                bufferBarrier(drawCommandBuffer.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT),
+                bufferBarrier(drawCountBuffer.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT),
+            };
+
+            // NOTE: the visibility the previous frame's late phase wrote has to be made visible, the pyramid is rebuilt
+            VkMemoryBarrier visibilityBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+            visibilityBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            visibilityBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 
-    result.images = images;
-    result.imageViews = imageViews;
-    result.framebuffers = framebuffers;
+            VkImageMemoryBarrier pyramidBarrier = imageBarrier(depthPyramid.image.image, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                                               VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
-    result.width = width; 
-    result.height = height;
-    result.imageCount = imageCount;
+            if (gpuCulling && meshReady && asyncCull && depthPyramidInitialized)
+            {
+                // NOTE: the late phase and the pyramid stay on the graphics queue, where the previous frame's late cull may
+                // still be reading the pyramid
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &visibilityBarrier, 0, 0,
+                                     1, &pyramidBarrier);
 
-    result.depthImage = depthImage;
-    result.depthImageMemory = depthImageMemory;
-    result.depthImageView = depthImageView;
-}
+                computeCommandBuffer = frame.computeCommandBuffer;
 
-void destroySwapchain(VkDevice device, const Swapchain& swapchain)
-{
-    for (uint32_t i = 0; i < swapchain.imageCount; i++)
-        vkDestroyFramebuffer(device, swapchain.framebuffers[i], 0);
+                VK_CHECK(vkResetCommandPool(device, frame.computePool, 0));
+                VK_CHECK(vkBeginCommandBuffer(computeCommandBuffer, &beginInfo));
 
-    for (uint32_t i = 0; i < swapchain.imageCount; i++)
-        vkDestroyImageView(device, swapchain.imageViews[i], 0);
+                beginGpuComputeScope(gpuProfiler, computeCommandBuffer, "async draw cull");
 
-    vkDestroySwapchainKHR(device, swapchain.swapchain, 0);
-}
+                // NOTE: the commands and counts are this frame's own and the semaphores order everything against the
+                // graphics queue, so only the fill needs a barrier; the stand in pyramid is never read, so it can start
+                // from UNDEFINED every frame
+                vkCmdFillBuffer(computeCommandBuffer, drawCountBuffer.buffer, 0, 2 * sizeof(uint32_t), 0);
 
-void resizeSwapchainIfNecessary(Swapchain& result, VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface,
-                                uint32_t familyIndex, VkFormat format, VkRenderPass renderPass, const VkPhysicalDeviceMemoryProperties& memoryProperties)
-{
-    VkSurfaceCapabilitiesKHR surfaceCaps;
-    VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCaps));
+                VkBufferMemoryBarrier fillBarrier = bufferBarrier(drawCountBuffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+                VkImageMemoryBarrier computePyramidBarrier = imageBarrier(computePyramid.image.image, 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+                vkCmdPipelineBarrier(computeCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, 0,
+                                     1, &fillBarrier, 1, &computePyramidBarrier);
 
-    uint32_t newWidth = surfaceCaps.currentExtent.width;
-    uint32_t newHeight = surfaceCaps.currentExtent.height;
+                dispatchDrawCull(computeCommandBuffer, drawCullPipeline, drawCullLayout, drawCullBuffers, computePyramid, depthPyramidSampler, drawCullData, drawCullGroupCount);
 
-    if((newWidth == result.width) && (newHeight == result.height))
-        return;
+                endGpuComputeScope(gpuProfiler, computeCommandBuffer);
 
-    Swapchain old = result;
+                VK_CHECK(vkEndCommandBuffer(computeCommandBuffer));
+            }
+            else if (gpuCulling && meshReady)
+            {
+                beginGpuScope(gpuProfiler, commandBuffer, "draw cull");
 
-    createSwapchain(result, physicalDevice, device, surface, familyIndex, format, renderPass, memoryProperties, old.swapchain);
+                // NOTE: the previous frame may still be drawing from the commands or reading the pyramid, WAR only needs an
+                // execution dependency
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &visibilityBarrier, 0, 0, 1, &pyramidBarrier);
 
-    VK_CHECK(vkDeviceWaitIdle(device));
+                vkCmdFillBuffer(commandBuffer, drawCountBuffer.buffer, 0, 2 * sizeof(uint32_t), 0);
 
-    destroySwapchain(device, old);
-}
+                VkBufferMemoryBarrier fillBarrier = bufferBarrier(drawCountBuffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, 0, 1, &fillBarrier, 0, 0);
 
-struct Vertex
-{
-    float vx, vy, vz;
-    float nx, ny, nz;
-    float tu, tv;
-};
+                dispatchDrawCull(commandBuffer, drawCullPipeline, drawCullLayout, drawCullBuffers, depthPyramid, depthPyramidSampler, drawCullData, drawCullGroupCount);
 
-struct Mesh
-{
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-};
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0,
+                                     ARRAYSIZE(drawCullBarriers), drawCullBarriers, 0, 0);
 
-bool loadMesh(Mesh& result, const char* path)
-{
-    fastObjMesh* file = fast_obj_read(path);
-    if (!file)
-        return false;
+                endGpuScope(gpuProfiler, commandBuffer);
 
-    size_t index_count = 0;
-    for (uint32_t i = 0; i < file->face_count; i++)
-    {
-        assert((file->face_vertices[i] == 3) || ((file->face_vertices[i] == 4)));
-        index_count += 3*(file->face_vertices[i] - 2);
-    }
+                depthPyramidInitialized = true;
+            }
 
-    size_t vertex_offset = 0;
-    size_t index_offset = 0;
-    std::vector<Vertex> vertices(index_count);
-    for (uint32_t i = 0; i < file->face_count; i++)
-    {
-        for(uint32_t j = 0; j < file->face_vertices[i]; j++)
-        {
-            if (j >= 3)
+            if ((meshletCulling == MESHLET_CULLING_GPU) && meshReady)
             {
-                vertices[vertex_offset] = vertices[vertex_offset - 3];
-                vertices[vertex_offset + 1] = vertices[vertex_offset - 1];
-                vertex_offset += 2;
-            }
+                beginGpuScope(gpuProfiler, commandBuffer, "meshlet cull");
 
-            Vertex& vertex = vertices[vertex_offset++];
+                // NOTE: the previous frame may still be drawing from the commands, WAR only needs an execution dependency
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     0, 0, 0, 0, 0, 0, 0);
 
-            int vIndex = file->indices[index_offset].p;
-            int nIndex = file->indices[index_offset].n;
-            int tIndex = file->indices[index_offset].t;
+                vkCmdFillBuffer(commandBuffer, meshletCountBuffer.buffer, 0, sizeof(uint32_t), 0);
 
-            vertex.vx = file->positions[3 * vIndex];
-            vertex.vy = file->positions[3 * vIndex + 1];
-            vertex.vz = -file->positions[3 * vIndex + 2];
+                VkBufferMemoryBarrier fillBarrier = bufferBarrier(meshletCountBuffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, 0, 1, &fillBarrier, 0, 0);
 
-            vertex.nx = nIndex < 0 ? 0.0f : file->normals[3 * nIndex];
-            vertex.ny = nIndex < 0 ? 0.0f : file->normals[3 * nIndex + 1];
-            vertex.nz = nIndex < 0 ? 1.0f : file->normals[3 * nIndex + 2];
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshletCullPipeline);
 
-            vertex.tu = tIndex < 0 ? 0.0f : file->texcoords[2 * tIndex];
-            vertex.tv = tIndex < 0 ? 0.0f : file->texcoords[2 * tIndex + 1];
-            
-            index_offset++;
-        }
-    }
+                const Buffer* cullBuffers[] = { &mb, &db, &objectBuffers[frameIndex], &meshletCommandBuffer, &meshletCountBuffer };
+                pushStorageBuffers(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshletCullLayout, cullBuffers, ARRAYSIZE(cullBuffers));
+                vkCmdPushConstants(commandBuffer, meshletCullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(meshletCullData), &meshletCullData);
 
-    assert(vertex_offset == index_count);
+                // NOTE: X covers the meshlets, Y the visible objects (the shader loops when there are more than fit)
+                uint32_t groupCountX = (meshletCullData.meshletCount + 63) / 64;
+                uint32_t groupCountY = std::min(visibleCount, props.limits.maxComputeWorkGroupCount[1]);
+                vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
 
-    if (1)
-    {
-        result.vertices = vertices;
-        result.indices.resize(index_count);
+                VkBufferMemoryBarrier cullBarriers[2] =
+                {
+                    bufferBarrier(meshletCommandBuffer.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT),
+                    bufferBarrier(meshletCountBuffer.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT),
+                };
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, 0,
+                                     ARRAYSIZE(cullBarriers), cullBarriers, 0, 0);
 
-        for (size_t i = 0; i < index_count; i++)
-            result.indices[i] = (uint32_t)i;
-    }
-    else
-    {
-        std::vector<uint32_t> remap(index_count);
-        size_t unique_vertices = meshopt_generateVertexRemap(remap.data(), 0, index_count, vertices.data(), index_count, sizeof(Vertex));
+                endGpuScope(gpuProfiler, commandBuffer);
+            }
 
-        result.vertices.resize(unique_vertices);
-        result.indices.resize(index_count);
+            beginGpuScope(gpuProfiler, commandBuffer, "begin barrier");
 
-        meshopt_remapVertexBuffer(result.vertices.data(), vertices.data(), index_count, sizeof(Vertex), remap.data());
-        meshopt_remapIndexBuffer(result.indices.data(), 0, index_count, remap.data());
-    }
+            VkImageMemoryBarrier renderBeginBarrier = imageBarrier(swapchain.images[imageIndex], 0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &renderBeginBarrier);
 
-    fast_obj_destroy(file);
-    
-    return true;
-}
+            endGpuScope(gpuProfiler, commandBuffer);
 
-struct Buffer
-{
-    VkBuffer buffer;
-    VkDeviceMemory memory;
-    void *data;
-    size_t size;
-};
+            // NOTE: the draw list of whichever CPU path is active
+            const std::vector<VkDrawIndexedIndirectCommand>& cpuDrawCommands = (meshletCulling == MESHLET_CULLING_CPU) ? meshletCommands : objectCommands;
 
-void createBuffer(Buffer &result, VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, size_t size, VkBufferUsageFlags usage)
-{
-    VkBufferCreateInfo createInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-    createInfo.size = size;
-    createInfo.usage = usage;
+            // NOTE: occlusion culling draws twice, the late pass loads what the early one rendered
+            uint32_t passCount = (occlusionCulling && meshReady) ? 2 : 1;
 
-    VkBuffer buffer = 0;
-    VK_CHECK(vkCreateBuffer(device, &createInfo, 0, &buffer));
+            for (uint32_t pass = 0; pass < passCount; pass++)
+            {
+                if (pass == 1)
+                {
+                    beginGpuScope(gpuProfiler, commandBuffer, "depth pyramid");
+
+                    VkImageMemoryBarrier depthReadBarrier = imageBarrier(swapchain.depthImage.image, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                                                                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                                         getDepthAspectMask(depthFormat));
+                    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, 0, 0, 0, 1, &depthReadBarrier);
+
+                    buildDepthPyramid(commandBuffer, depthPyramid, swapchain.depthImage.imageView, swapchain.width, swapchain.height,
+                                      depthReducePipeline, depthReduceLayout, depthPyramidSampler);
+
+                    VkImageMemoryBarrier depthWriteBarrier = imageBarrier(swapchain.depthImage.image, 0, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                                                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                                                                          getDepthAspectMask(depthFormat));
+                    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, 0, 0, 0, 1, &depthWriteBarrier);
+
+                    endGpuScope(gpuProfiler, commandBuffer);
+                    beginGpuScope(gpuProfiler, commandBuffer, "late cull");
+
+                    drawCullData.phase = DRAW_CULL_LATE;
+                    dispatchDrawCull(commandBuffer, drawCullPipeline, drawCullLayout, drawCullBuffers, depthPyramid, depthPyramidSampler, drawCullData, drawCullGroupCount);
+
+                    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0,
+                                         ARRAYSIZE(drawCullBarriers), drawCullBarriers, 0, 0);
+
+                    endGpuScope(gpuProfiler, commandBuffer);
+
+                    // NOTE: the visibility is final from here on, the rest of the frame goes into a second submission
+                    if (asyncCull)
+                    {
+                        VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+                        commandBuffer = frame.lateCommandBuffer;
+                        VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+                        splitFrame = true;
+                    }
+                }
+
+                beginGpuScope(gpuProfiler, commandBuffer, (pass == 0) ? "render pass" : "late render pass");
+
+                VkClearColorValue color = { 48.0f / 255.0f, 10.0f / 255.0f, 36.0f / 255.0f, 1 };
+                VkClearDepthStencilValue depthClearValue = { 1.0f };
+                VkClearValue clearValues[2] = {};
+                clearValues[0].color = color;
+                clearValues[1].depthStencil = depthClearValue;
+
+                VkRenderPassBeginInfo passBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+                passBeginInfo.renderPass = (pass == 0) ? renderPass : renderPassLate;
+                passBeginInfo.framebuffer = swapchain.framebuffers[imageIndex];
+                passBeginInfo.renderArea.extent.width = swapchain.width;
+                passBeginInfo.renderArea.extent.height = swapchain.height;
+                passBeginInfo.clearValueCount = ARRAYSIZE(clearValues);
+                passBeginInfo.pClearValues = clearValues;
+
+                // NOTE: a render pass with secondary command buffers can't contain anything but vkCmdExecuteCommands,
+                // so parallel recording has no separate draw scope
+                vkCmdBeginRenderPass(commandBuffer, &passBeginInfo, (recordThreadCount > 0) ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+                VkViewport viewport = { 0, float(swapchain.height), float(swapchain.width), -float(swapchain.height), 0, 1 };
+                VkRect2D scissor = { {0, 0}, {swapchain.width, swapchain.height} };
+
+                if (!meshReady)
+                {
+                    // NOTE: the mesh is still loading, the pass only clears
+                }
+                else if (recordThreadCount > 0)
+                {
+                    const Buffer* triangleBuffers[] = { &vb, &db };
+
+                    DrawList drawList = {};
+                    drawList.pipeline = trianglePipeline;
+                    drawList.layout = triangleLayout;
+                    drawList.buffers = triangleBuffers;
+                    drawList.bufferCount = ARRAYSIZE(triangleBuffers);
+                    drawList.pushConstants = &globals;
+                    drawList.pushConstantSize = sizeof(globals);
+                    drawList.indexBuffer = ib.buffer;
+                    drawList.viewport = viewport;
+                    drawList.scissor = scissor;
+                    drawList.commands = cpuDrawCommands.data();
+                    drawList.commandCount = uint32_t(cpuDrawCommands.size());
+
+                    VkCommandBufferInheritanceInfo inheritance = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+                    inheritance.renderPass = passBeginInfo.renderPass;
+                    inheritance.subpass = 0;
+                    inheritance.framebuffer = passBeginInfo.framebuffer;
+
+                    recordDrawListParallel(jobSystem, device, drawList, inheritance, frame, recordThreadCount);
+
+                    vkCmdExecuteCommands(commandBuffer, recordThreadCount, frame.recordCommandBuffers);
+                }
+                else if (meshShadingFrame)
+                {
+                    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+                    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+
+                    const Buffer* meshBuffers[] = { &vb, &db, &mb, &mvb, &mtb, &objectBuffers[frameIndex] };
+                    pushStorageBuffers(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshLayout, meshBuffers, ARRAYSIZE(meshBuffers));
+
+                    MeshShadingData meshShadingData = { globals, meshletCullData };
+                    vkCmdPushConstants(commandBuffer, meshLayout, VK_SHADER_STAGE_TASK_BIT_NV | VK_SHADER_STAGE_MESH_BIT_NV, 0, sizeof(meshShadingData), &meshShadingData);
+
+                    beginGpuScope(gpuProfiler, commandBuffer, "draw");
+
+                    // NOTE: every visible object gets the same number of task workgroups, the task shader derives the object from the workgroup index
+                    uint32_t taskCount = visibleCount * taskGroupsPerObject;
+
+#if defined(VK_EXT_mesh_shader)
+                    if (deviceFeatures.meshShadingEXT)
+                    {
+                        // NOTE: there is no first task, the rows of the grid are flattened back into the task index in the
+                        // task shader; 65535 x 64 rows (the guaranteed total) is far more than the scenes here need
+                        uint32_t groupCountX = std::min(taskCount, meshShaderPropsEXT.maxTaskWorkGroupCount[0]);
+                        uint32_t groupCountY = groupCountX ? (taskCount + groupCountX - 1) / groupCountX : 0;
+
+                        if (groupCountX > 0)
+                            vkCmdDrawMeshTasksEXT(commandBuffer, groupCountX, std::min(groupCountY, meshShaderPropsEXT.maxTaskWorkGroupCount[1]), 1);
+                    }
+                    else
+#endif
+                    {
+                        for (uint32_t firstTask = 0; firstTask < taskCount; firstTask += meshShaderProps.maxDrawMeshTasksCount)
+                            vkCmdDrawMeshTasksNV(commandBuffer, std::min(taskCount - firstTask, meshShaderProps.maxDrawMeshTasksCount), firstTask);
+                    }
+
+                    endGpuScope(gpuProfiler, commandBuffer);
+                }
+                else
+                {
+                    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+                    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, trianglePipeline);
+
+                    const Buffer* triangleBuffers[] = { &vb, &db };
+                    pushStorageBuffers(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, triangleLayout, triangleBuffers, ARRAYSIZE(triangleBuffers));
+
+                    vkCmdPushConstants(commandBuffer, triangleLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(globals), &globals);
+
+                    beginGpuScope(gpuProfiler, commandBuffer, "draw");
+
+                    vkCmdBindIndexBuffer(commandBuffer, ib.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+                    // NOTE: firstInstance carries the object index to gl_InstanceIndex; the late pass draws the second half
+                    if (gpuCulling)
+                    {
+                        vkCmdDrawIndexedIndirectCount(commandBuffer, drawCommandBuffer.buffer, pass * objectCount * sizeof(VkDrawIndexedIndirectCommand),
+                                                      drawCountBuffer.buffer, pass * sizeof(uint32_t),
+                                                      std::min(objectCount, props.limits.maxDrawIndirectCount), sizeof(VkDrawIndexedIndirectCommand));
+                    }
+                    else if (meshletCulling == MESHLET_CULLING_GPU)
+                    {
+                        vkCmdDrawIndexedIndirectCount(commandBuffer, meshletCommandBuffer.buffer, 0, meshletCountBuffer.buffer, 0, meshletCommandCapacity,
+                                                      sizeof(VkDrawIndexedIndirectCommand));
+                    }
+                    else
+                    {
+                        for (size_t i = 0; i < cpuDrawCommands.size(); i++)
+                            vkCmdDrawIndexed(commandBuffer, cpuDrawCommands[i].indexCount, 1, cpuDrawCommands[i].firstIndex, 0, cpuDrawCommands[i].firstInstance);
+                    }
+
+                    endGpuScope(gpuProfiler, commandBuffer);
+                }
+
+                vkCmdEndRenderPass(commandBuffer);
+
+                endGpuScope(gpuProfiler, commandBuffer);
+            }
 
-    VkMemoryRequirements memoryRequirements;
-    vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+            if (gpuCulling && meshReady)
+            {
+                VkBufferCopy region = { 0, 0, 2 * sizeof(uint32_t) };
+                vkCmdCopyBuffer(commandBuffer, drawCountBuffer.buffer, drawCountReadbacks[frameIndex].buffer, 1, &region);
 
-    uint32_t memoryTypeIndex = selectMemoryType(memoryProperties, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    assert(memoryTypeIndex != UINT32_MAX);
+                VkBufferMemoryBarrier readbackBarrier = bufferBarrier(drawCountReadbacks[frameIndex].buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, 0, 1, &readbackBarrier, 0, 0);
+            }
 
-    VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-    allocateInfo.allocationSize = memoryRequirements.size;
-    allocateInfo.memoryTypeIndex = memoryTypeIndex;
+            beginGpuScope(gpuProfiler, commandBuffer, "end barrier");
 
-    VkDeviceMemory memory = 0;
-    VK_CHECK(vkAllocateMemory(device, &allocateInfo, 0, &memory));
+            // NOTE: offscreen images end up ready for the readback instead of the presentation engine
+            if (headless)
+            {
+                VkImageMemoryBarrier renderEndBarrier = imageBarrier(swapchain.images[imageIndex], VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                                                                     VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &renderEndBarrier);
+            }
+            else
+            {
+                VkImageMemoryBarrier renderEndBarrier = imageBarrier(swapchain.images[imageIndex], VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                     VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &renderEndBarrier);
+            }
 
-    VK_CHECK(vkBindBufferMemory(device, buffer, memory, 0));
+            endGpuScope(gpuProfiler, commandBuffer);
 
-    void* data = 0;
-    VK_CHECK(vkMapMemory(device, memory, 0, memoryRequirements.size, 0, &data)); 
+            endGpuProfilerFrame(gpuProfiler, commandBuffer);
 
-    result.buffer = buffer;
-    result.memory = memory;
-    result.size = memoryRequirements.size;
-    result.data = data;
-}
+            VK_CHECK(vkEndCommandBuffer(commandBuffer));
 
-void destroyBuffer(const Buffer& buffer, VkDevice device)
-{
-    vkFreeMemory(device, buffer.memory, 0);
-    vkDestroyBuffer(device, buffer.buffer, 0);
-}
+            recordBenchmarkSample(benchmarks, benchmarkCount, BENCHMARK_RECORD, submitCount, getTimeMs() - recordTimeBegin);
+        }
 
-int main() 
-{
-    int rc = glfwInit();
-    assert(rc);
+        VkPipelineStageFlags submitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
-    VK_CHECK(volkInitialize());
+        VkSemaphore releaseSemaphore = headless ? VK_NULL_HANDLE : swapchain.releaseSemaphores[imageIndex];
 
-    VkInstance instance = createInstance();
-    assert(instance);
+        VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+        submitInfo.waitSemaphoreCount = headless ? 0 : 1;
+        submitInfo.pWaitSemaphores = &frame.acquireSemaphore;
+        submitInfo.pWaitDstStageMask = &submitStageMask;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        submitInfo.signalSemaphoreCount = headless ? 0 : 1;
+        submitInfo.pSignalSemaphores = &releaseSemaphore;
 
-    volkLoadInstance(instance);
+        // NOTE: with async compute the graphics queue waits for the frame's cull right before the first stage that
+        // reads its results, so it can already clear and set up the frame; the binary semaphores ignore their values
+        VkSemaphore waitSemaphores[] = { frame.acquireSemaphore, asyncCompute.computeTimeline };
+        VkPipelineStageFlags waitStageMasks[] = { submitStageMask, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT };
+        uint64_t waitValues[] = { 0, 0 };
 
-#if _DEBUG
-    VkDebugReportCallbackEXT debugCallback = registerDebugCallback(instance);
-#endif
+        VkSemaphore earlySignalSemaphores[] = { asyncCompute.graphicsTimeline, releaseSemaphore };
+        uint64_t earlySignalValues[] = { 0, 0 };
+        uint64_t lateSignalValue = 0;
 
-    VkPhysicalDevice physicalDevices[16];
-    uint32_t physicalDeviceCount = ARRAYSIZE(physicalDevices);
-    VK_CHECK(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices));
+        VkTimelineSemaphoreSubmitInfo timelineInfos[2] = {};
+        VkSubmitInfo splitSubmitInfos[2] = {};
 
-    VkPhysicalDevice physicalDevice = pickPhysicalDevice(physicalDevices, physicalDeviceCount);
-    assert(physicalDevice);
+        if (asyncCull)
+        {
+            uint32_t waitOffset = headless ? 1 : 0;
 
-    uint32_t familyIndex = getGraphicsFamilyIndex(physicalDevice);
-    assert(familyIndex != VK_QUEUE_FAMILY_IGNORED);
+            // NOTE: the cull waits for the last value the graphics queue signaled: the early phase reads the visibility
+            // the previous frame's late phase wrote, and the async path only starts after a frame that was submitted
+            // after the mesh uploads, which go through the graphics queue as well
+            if (computeCommandBuffer)
+                waitValues[1] = submitAsyncCompute(asyncCompute, computeCommandBuffer, asyncCompute.graphicsValue);
 
-    VkDevice device = createDevice(physicalDevice, familyIndex);
-    assert(device);
+            timelineInfos[0].sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfos[0].waitSemaphoreValueCount = (computeCommandBuffer ? 2 : 1) - waitOffset;
+            timelineInfos[0].pWaitSemaphoreValues = waitValues + waitOffset;
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    GLFWwindow *window = glfwCreateWindow(1024, 768, "vulkan learning", 0, 0);
-    assert(window);
+            splitSubmitInfos[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            splitSubmitInfos[0].pNext = &timelineInfos[0];
+            splitSubmitInfos[0].waitSemaphoreCount = timelineInfos[0].waitSemaphoreValueCount;
+            splitSubmitInfos[0].pWaitSemaphores = waitSemaphores + waitOffset;
+            splitSubmitInfos[0].pWaitDstStageMask = waitStageMasks + waitOffset;
+            splitSubmitInfos[0].commandBufferCount = 1;
+            splitSubmitInfos[0].pCommandBuffers = &frame.commandBuffer;
 
-    VkSurfaceKHR surface = createSurface(instance, window);
-    assert(surface);
+            // NOTE: every frame signals the graphics timeline once; a split frame does so as soon as the visibility is
+            // final and the late part presents
+            earlySignalValues[0] = ++asyncCompute.graphicsValue;
 
-    VkBool32 presentSupported = 0;
-    VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, familyIndex, surface, &presentSupported));
-    assert(presentSupported);
+            timelineInfos[0].signalSemaphoreValueCount = (splitFrame || headless) ? 1 : 2;
+            timelineInfos[0].pSignalSemaphoreValues = earlySignalValues;
 
-    VkFormat swapchainFormat = getSwapchainFormat(physicalDevice, surface);
+            splitSubmitInfos[0].signalSemaphoreCount = timelineInfos[0].signalSemaphoreValueCount;
+            splitSubmitInfos[0].pSignalSemaphores = earlySignalSemaphores;
 
-    VkSemaphore acquireSemaphore = createSemaphore(device);
-    assert(acquireSemaphore);
+            if (splitFrame)
+            {
+                timelineInfos[1].sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+                timelineInfos[1].signalSemaphoreValueCount = headless ? 0 : 1;
+                timelineInfos[1].pSignalSemaphoreValues = &lateSignalValue;
+
+                splitSubmitInfos[1].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                splitSubmitInfos[1].pNext = &timelineInfos[1];
+                splitSubmitInfos[1].commandBufferCount = 1;
+                splitSubmitInfos[1].pCommandBuffers = &frame.lateCommandBuffer;
+                splitSubmitInfos[1].signalSemaphoreCount = headless ? 0 : 1;
+                splitSubmitInfos[1].pSignalSemaphores = &releaseSemaphore;
+            }
+        }
 
-    VkSemaphore releaseSemaphore = createSemaphore(device);
-    assert(releaseSemaphore);
+        {
+            TRACE_ZONE("vkQueueSubmit");
 
-    VkQueue queue = 0;
-    vkGetDeviceQueue(device, familyIndex, 0, &queue);
+            double submitTimeBegin = getTimeMs();
 
-    VkRenderPass renderPass = createRenderPass(device, swapchainFormat);
-    assert(renderPass);
+            if (asyncCull)
+            {
+                VK_CHECK(vkQueueSubmit(queue, splitFrame ? 2 : 1, splitSubmitInfos, frame.fence));
+            }
+            else
+            {
+                VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, frame.fence));
+            }
 
-    VkShaderModule triangleVS = loadShader(device, "shaders_bytecode\\triangle.vert.spv");
-    assert(triangleVS);
-    VkShaderModule triangleFS = loadShader(device, "shaders_bytecode\\triangle.frag.spv");
-    assert(triangleFS);
+            recordBenchmarkSample(benchmarks, benchmarkCount, BENCHMARK_SUBMIT, submitCount, getTimeMs() - submitTimeBegin);
+        }
 
-    // TODO: this is critical for performance!
-    VkPipelineCache pipelineCache = 0;
+        frame.submitIndex = ++submitCount;
 
-    VkPipelineLayout triangleLayout = createPipelineLayout(device);
-    assert(triangleLayout);
+        if (headless)
+            continue;
 
-    VkPipeline trianglePipeline = createGraphicsPipeline(device, pipelineCache, renderPass, triangleVS, triangleFS, triangleLayout);
-    assert(trianglePipeline);
+        VkPresentInfoKHR presentInfo = { VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &releaseSemaphore;
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &swapchain.swapchain;
+        presentInfo.pImageIndices = &imageIndex;
+
+        {
+            TRACE_ZONE("vkQueuePresentKHR");
 
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+            double presentTimeBegin = getTimeMs();
+            VK_CHECK(vkQueuePresentKHR(queue, &presentInfo));
+            recordBenchmarkSample(benchmarks, benchmarkCount, BENCHMARK_PRESENT, submitCount - 1, getTimeMs() - presentTimeBegin);
+        }
 
-    Swapchain swapchain;
-    createSwapchain(swapchain, physicalDevice, device, surface, familyIndex, swapchainFormat, renderPass, memoryProperties);
+        // NOTE: frame pacing - how many submitted frames the GPU hasn't finished yet
+        uint64_t framesAhead = submitCount - completedCount;
 
-    VkCommandPool commandPool = createCommandPool(device, familyIndex);
-    assert(commandPool);
+        // NOTE: only the CPU path knows how many triangles survived meshlet culling without a readback
+        char meshletStats[64] = "";
+        if ((meshletCulling == MESHLET_CULLING_CPU) && (visibleCount > 0))
+            snprintf(meshletStats, ARRAYSIZE(meshletStats), "; triangles: %.1f%%",
+                     double(visibleTriangles) / (double(visibleCount) * double(indexCount / 3)) * 100.0);
 
-    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
-    allocateInfo.commandPool = commandPool;
-    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocateInfo.commandBufferCount = 1;
+        char title[256];
+        snprintf(title, ARRAYSIZE(title), "vulkan learning; frames in flight: %u; CPU ahead: %llu; GPU: %.2f ms; visible: %u/%u%s",
+                 framesInFlight, (unsigned long long)framesAhead, gpuFrameTime, visibleCount, objectCount, meshletStats);
+        glfwSetWindowTitle(window, title);
+    }
 
-    VkCommandBuffer commandBuffer = 0;
-    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer));
+    VK_CHECK(vkDeviceWaitIdle(device));
 
-    Mesh mesh;
-    bool rcm = loadMesh(mesh, "meshes\\kitten.obj");
+    // NOTE: the window was closed before the benchmark was over
+    for (uint32_t i = 0; i < benchmarkCount; i++)
+        if (benchmarks[i].measureTimeEnd == 0.0)
+            benchmarks[i].measureTimeEnd = frameTimeBegin;
 
-    Buffer vb = {};
-    createBuffer(vb, device, memoryProperties, 128 * 1024 * 1024, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-    Buffer ib = {};
-    createBuffer(ib, device, memoryProperties, 128 * 1024 * 1024, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    // NOTE: GPU times of the frames still in flight when the loop ended
+    for (uint32_t i = 0; i < framesInFlight; i++)
+        if (resolveGpuProfilerFrame(gpuProfiler, device, i, &gpuFrameTime))
+            recordBenchmarkSample(benchmarks, benchmarkCount, BENCHMARK_GPU_FRAME, frames[i].submitIndex - 1, gpuFrameTime);
 
-    assert(vb.size >= mesh.vertices.size() * sizeof(Vertex));
-    memcpy(vb.data, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+    printGpuProfile(gpuProfiler);
 
-    assert(vb.size >= mesh.indices.size() * sizeof(uint32_t));
-    memcpy(ib.data, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    if (traceOnExit)
+    {
+        if (writeTrace(tracePath))
+            printf("Wrote %s\n", tracePath);
+        else
+            printf("ERROR: Failed to write %s\n", tracePath);
+    }
 
-    while (!glfwWindowShouldClose(window))
+    if (gpuProfilePath)
     {
-        glfwPollEvents();
+        if (writeGpuProfile(gpuProfiler, gpuProfilePath))
+            printf("Wrote %s\n", gpuProfilePath);
+        else
+            printf("ERROR: Failed to write %s\n", gpuProfilePath);
+    }
 
-        resizeSwapchainIfNecessary(swapchain, physicalDevice, device, surface, familyIndex, swapchainFormat, renderPass, memoryProperties);
+    if (gpuTracePath)
+    {
+        if (writeGpuTrace(gpuProfiler, gpuTracePath))
+            printf("Wrote %s\n", gpuTracePath);
+        else
+            printf("ERROR: Failed to write %s\n", gpuTracePath);
+    }
 
-        uint32_t imageIndex = 0;
-        VK_CHECK(vkAcquireNextImageKHR(device, swapchain.swapchain, UINT64_MAX, acquireSemaphore, VK_NULL_HANDLE, &imageIndex));
+    if (benchmarkPath && !meshFailed)
+    {
+        if (comparePaths)
+            printBenchmarkComparison(benchmarks[0], "vertex", benchmarks[1], "mesh");
+        else
+            printBenchmarkSummary(benchmarks[0], renderPath);
+
+        BenchmarkConfig benchmarkConfig = {};
+        benchmarkConfig.deviceName = props.deviceName;
+        benchmarkConfig.renderPath = renderPath;
+        benchmarkConfig.width = swapchain.width;
+        benchmarkConfig.height = swapchain.height;
+        benchmarkConfig.framesInFlight = framesInFlight;
+        benchmarkConfig.headless = headless;
+        benchmarkConfig.recordThreads = recordThreadCount;
+        benchmarkConfig.asyncCompute = asyncCull;
+
+        bool written = comparePaths ? writeBenchmarkComparison(benchmarks[0], "vertex", benchmarks[1], "mesh", benchmarkConfig, benchmarkPath)
+                                    : writeBenchmarkReport(benchmarks[0], benchmarkConfig, benchmarkPath);
+
+        if (written)
+            printf("Wrote %s\n", benchmarkPath);
+        else
+            printf("ERROR: Failed to write %s\n", benchmarkPath);
+    }
 
-        VK_CHECK(vkResetCommandPool(device, commandPool, 0));
+    if (headless && !recordSweep)
+        printf("Rendered %llu frames in %.2f ms\n", (unsigned long long)submitCount, getTimeMs() - renderTimeBegin);
 
-        VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-        VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    if (headless && outputPath && (submitCount > 0))
+    {
+        uint32_t lastImageIndex = uint32_t((submitCount - 1) % framesInFlight);
 
-        VkImageMemoryBarrier renderBeginBarrier = imageBarrier(swapchain.images[imageIndex], 0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &renderBeginBarrier);
+        std::vector<uint8_t> pixels;
+        readbackImage(pixels, device, queue, familyIndex, allocator, swapchain.images[lastImageIndex], swapchain.width, swapchain.height);
 
-        VkClearColorValue color = { 48.0f / 255.0f, 10.0f / 255.0f, 36.0f / 255.0f, 1 };
-        VkClearDepthStencilValue depthClearValue = { 1.0f };
-        VkClearValue clearValues[2] = {};
-        clearValues[0].color = color;
-        clearValues[1].depthStencil = depthClearValue;
+        if (writePPM(outputPath, pixels.data(), swapchain.width, swapchain.height, swapchainFormat))
+            printf("Wrote %s\n", outputPath);
+        else
+            printf("ERROR: Failed to write %s\n", outputPath);
+    }
 
-        VkRenderPassBeginInfo passBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-        passBeginInfo.renderPass = renderPass;
-        passBeginInfo.framebuffer = swapchain.framebuffers[imageIndex];
-        passBeginInfo.renderArea.extent.width = swapchain.width;
-        passBeginInfo.renderArea.extent.height = swapchain.height;
-        passBeginInfo.clearValueCount = ARRAYSIZE(clearValues);
-        passBeginInfo.pClearValues = clearValues;
-        vkCmdBeginRenderPass(commandBuffer, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    destroyStagingRing(stagingRing, device, allocator);
 
-        VkViewport viewport = { 0, float(swapchain.height), float(swapchain.width), -float(swapchain.height), 0, 1 };
-        VkRect2D scissor = { {0, 0}, {swapchain.width, swapchain.height} };
+    // NOTE: the window can be closed before the mesh has landed
+    if (meshReady)
+    {
+        destroyBuffer(vb, device, allocator);
+        destroyBuffer(ib, device, allocator);
+        destroyBuffer(db, device, allocator);
 
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        if (meshShading || (meshletCulling == MESHLET_CULLING_GPU))
+            destroyBuffer(mb, device, allocator);
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, trianglePipeline);
+        if (meshShading)
+        {
+            destroyBuffer(mvb, device, allocator);
+            destroyBuffer(mtb, device, allocator);
+        }
 
-        VkDescriptorBufferInfo bufferInfo = {};
-        bufferInfo.buffer = vb.buffer;
-        bufferInfo.offset = 0;
-        bufferInfo.range = vb.size;
+        if (meshletCulling == MESHLET_CULLING_GPU)
+        {
+            destroyBuffer(meshletCommandBuffer, device, allocator);
+            destroyBuffer(meshletCountBuffer, device, allocator);
+        }
 
-        VkWriteDescriptorSet descriptors[1] = {};
-        descriptors[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptors[0].dstBinding = 0;
-        descriptors[0].descriptorCount = 1;
-        descriptors[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptors[0].pBufferInfo = &bufferInfo;
-        
-        vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, triangleLayout, 0, 1, descriptors);
-        
-        vkCmdBindIndexBuffer(commandBuffer, ib.buffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(commandBuffer, mesh.indices.size(), 1, 0, 0, 0);
+        if (gpuCulling)
+        {
+            destroyBuffer(bb, device, allocator);
+            destroyBuffer(lb, device, allocator);
+        }
+    }
 
-        vkCmdEndRenderPass(commandBuffer);
+    destroyAssetLoader(assetLoader, device, allocator);
 
-        VkImageMemoryBarrier renderEndBarrier = imageBarrier(swapchain.images[imageIndex], VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                             VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &renderEndBarrier);
+    if (meshShading || (meshletCulling == MESHLET_CULLING_GPU))
+    {
+        for (uint32_t i = 0; i < framesInFlight; i++)
+            destroyBuffer(objectBuffers[i], device, allocator);
+    }
 
+    if (gpuCulling)
+    {
+        destroyBuffer(visibilityBuffer, device, allocator);
 
-        VK_CHECK(vkEndCommandBuffer(commandBuffer));
+        for (uint32_t i = 0; i < drawCommandBufferCount; i++)
+        {
+            destroyBuffer(drawCommandBuffers[i], device, allocator);
+            destroyBuffer(drawCountBuffers[i], device, allocator);
+        }
 
-        VkPipelineStageFlags submitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        for (uint32_t i = 0; i < framesInFlight; i++)
+            destroyBuffer(drawCountReadbacks[i], device, allocator);
+    }
 
-        VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = &acquireSemaphore;
-        submitInfo.pWaitDstStageMask = &submitStageMask;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = &releaseSemaphore;
-        VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+    if (recordThreadCount > 0)
+        destroyJobSystem(jobSystem);
 
-        VkPresentInfoKHR presentInfo = { VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = &releaseSemaphore;
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = &swapchain.swapchain;
-        presentInfo.pImageIndices = &imageIndex;
+    for (uint32_t i = 0; i < framesInFlight; i++)
+        destroyFrame(device, frames[i]);
 
-        VK_CHECK(vkQueuePresentKHR(queue, &presentInfo));
+    if (asyncCull)
+        destroyAsyncCompute(asyncCompute, device);
 
-        VK_CHECK(vkDeviceWaitIdle(device));
+    destroyGpuProfiler(gpuProfiler, device);
+
+    if (gpuCulling)
+    {
+        destroyDepthPyramid(depthPyramid, device, allocator);
+        vkDestroySampler(device, depthPyramidSampler, 0);
     }
 
-    VK_CHECK(vkDeviceWaitIdle(device));
+    if (asyncCull)
+        destroyDepthPyramid(computePyramid, device, allocator);
 
-    destroyBuffer(vb, device);
-    destroyBuffer(ib, device);
+    destroySwapchain(device, allocator, swapchain);
 
-    vkDestroyCommandPool(device, commandPool, 0);
-    
-    destroySwapchain(device, swapchain);
+    if (!savePipelineCache(device, pipelineCache, props, "pipeline_cache.bin"))
+        printf("ERROR: Failed to save pipeline cache\n");
+
+    vkDestroyPipelineCache(device, pipelineCache, 0);
 
     vkDestroyPipeline(device, trianglePipeline, 0);
     vkDestroyPipelineLayout(device, triangleLayout, 0);
+    vkDestroyDescriptorSetLayout(device, triangleSetLayout, 0);
+
+    if (meshletCullPipeline)
+    {
+        vkDestroyPipeline(device, meshletCullPipeline, 0);
+        vkDestroyPipelineLayout(device, meshletCullLayout, 0);
+        vkDestroyDescriptorSetLayout(device, meshletCullSetLayout, 0);
+        vkDestroyShaderModule(device, meshletCullCS, 0);
+    }
+
+    if (drawCullPipeline)
+    {
+        vkDestroyPipeline(device, drawCullPipeline, 0);
+        vkDestroyPipelineLayout(device, drawCullLayout, 0);
+        vkDestroyDescriptorSetLayout(device, drawCullSetLayout, 0);
+        vkDestroyShaderModule(device, drawCullCS, 0);
+    }
+
+    if (depthReducePipeline)
+    {
+        vkDestroyPipeline(device, depthReducePipeline, 0);
+        vkDestroyPipelineLayout(device, depthReduceLayout, 0);
+        vkDestroyDescriptorSetLayout(device, depthReduceSetLayout, 0);
+        vkDestroyShaderModule(device, depthReduceCS, 0);
+    }
+
+    if (meshPipeline)
+    {
+        vkDestroyPipeline(device, meshPipeline, 0);
+        vkDestroyPipelineLayout(device, meshLayout, 0);
+        vkDestroyDescriptorSetLayout(device, meshSetLayout, 0);
+        vkDestroyShaderModule(device, meshletMS, 0);
+        vkDestroyShaderModule(device, meshletTS, 0);
+    }
 
     vkDestroyShaderModule(device, triangleFS, 0);
     vkDestroyShaderModule(device, triangleVS, 0);
 
+    if (renderPassLate)
+        vkDestroyRenderPass(device, renderPassLate, 0);
+
     vkDestroyRenderPass(device, renderPass, 0);
 
-    vkDestroySemaphore(device, releaseSemaphore, 0);
-    vkDestroySemaphore(device, acquireSemaphore, 0);
+    destroyAllocator(allocator);
 
-    vkDestroySurfaceKHR(instance, surface, 0);
+    if (!headless)
+    {
+        vkDestroySurfaceKHR(instance, surface, 0);
 
-    glfwDestroyWindow(window);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 
     vkDestroyDevice(device, 0);
 
@@ -1002,5 +5324,7 @@ int main()
 
     vkDestroyInstance(instance, 0);
 
-    return 0;
+    destroyTrace();
+
+    return meshFailed ? 1 : 0;
 }
\ No newline at end of file
@@ -1,13 +1,42 @@
 #pragma once
 
 #include <math.h>
+
+// NOTE(georgy): SIMD backend is picked at compile time, define VKL_NO_SIMD to force the scalar code
+#if !defined(VKL_NO_SIMD)
+#if defined(__AVX__)
+#define VKL_SIMD_AVX 1
+#endif
+#if defined(__AVX2__)
+#define VKL_SIMD_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(VKL_SIMD_AVX)
+#define VKL_SIMD_SSE 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define VKL_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+#if defined(VKL_SIMD_AVX)
+#define VKL_SIMD_NAME "AVX"
+#elif defined(VKL_SIMD_SSE)
+#define VKL_SIMD_NAME "SSE"
+#elif defined(VKL_SIMD_NEON)
+#define VKL_SIMD_NAME "NEON"
+#else
+#define VKL_SIMD_NAME "scalar"
+#endif
 #define PI 3.14159265358979323846f
 
 #define Epsilon (1.19e-7f)
 #define I32_MIN (-2147483647 - 1)
 #define I32_MAX 2147483647
 #define U32_MAX 0xFFFFFFFF
+#ifndef FLT_MAX
 #define FLT_MAX 3.402823466e+38F
+#endif
 
 #define Max(A, B) (((A) > (B)) ? (A) : (B))
 #define Min(A, B) (((A) < (B)) ? (A) : (B))
@@ -47,6 +76,8 @@ union vec3
         float r, g, b;
     };
 
+    // NOTE(georgy): swizzles nest types with constructors in anonymous structs, only MSVC accepts that
+#ifdef _MSC_VER
     struct 
     {
         vec2 xy;
@@ -67,6 +98,7 @@ union vec3
         float Ignored_3;
         vec2 vw;
     };
+#endif
 
     float E[3];
 
@@ -87,6 +119,7 @@ union vec4
         float r, g, b, a;
     };
 
+#ifdef _MSC_VER
     struct 
     {
         vec3 xyz;
@@ -116,11 +149,13 @@ union vec4
         vec3 rgb;
         float Ignored_7;
     };
+#endif
 
     float E[4];
 
     vec4() {}
     vec4(float X, float Y, float Z, float W) { x = X; y = Y; z = Z; w = W; }
+    vec4(vec3 XYZ, float W) { x = XYZ.x; y = XYZ.y; z = XYZ.z; w = W; }
 };
 
 inline vec2
@@ -694,12 +729,33 @@ Lerp(vec4 A, vec4 B, float t)
 // NOTE(georgy): plane
 // 
 
+// NOTE(georgy): points P with Dot(N, P) + D = 0, N is unit length and points to the positive half-space
 struct plane
 {
-    vec2 N;
+    vec3 N;
     float D;
 };
 
+inline plane
+NormalizePlane(vec4 P)
+{
+    float OneOverLength = 1.0f / sqrtf(P.x*P.x + P.y*P.y + P.z*P.z);
+
+    plane Result;
+    Result.N = vec3(P.x, P.y, P.z)*OneOverLength;
+    Result.D = P.w*OneOverLength;
+
+    return(Result);
+}
+
+inline float
+SignedDistance(const plane &Plane, vec3 P)
+{
+    float Result = Dot(Plane.N, P) + Plane.D;
+
+    return(Result);
+}
+
 // 
 // NOTE(georgy): mat3
 // 
@@ -1081,8 +1137,27 @@ Perspective(float FoV, float AspectRatio, float Near, float Far)
     return(Result);
 }
 
+// NOTE(georgy): right-handed like Perspective, but maps depth to Vulkan's [0, 1] instead of [-1, 1]
 static mat4
-operator*(mat4 A, mat4 B)
+PerspectiveVk(float FoV, float AspectRatio, float Near, float Far)
+{
+    float OneOverTan = 1.0f / tanf(Radians(FoV) * 0.5f);
+
+    mat4 Result = {};
+
+    Result.a11 = OneOverTan / AspectRatio;
+    Result.a22 = OneOverTan;
+    Result.a33 = Far / (Near - Far);
+    Result.a34 = (Near * Far) / (Near - Far);
+    Result.a43 = -1.0f;
+
+    return(Result);
+}
+
+// NOTE(georgy): scalar reference versions, the operators below use SIMD when available
+
+static mat4
+MultiplyScalar(const mat4 &A, const mat4 &B)
 {
     mat4 Result;
 
@@ -1106,4 +1181,1088 @@ operator*(mat4 A, mat4 B)
     }
 
     return(Result);
-}
\ No newline at end of file
+}
+
+inline vec4
+TransformScalar(const mat4 &A, vec4 B)
+{
+    vec4 Result;
+
+    Result.x = A.a11*B.x + A.a12*B.y + A.a13*B.z + A.a14*B.w;
+    Result.y = A.a21*B.x + A.a22*B.y + A.a23*B.z + A.a24*B.w;
+    Result.z = A.a31*B.x + A.a32*B.y + A.a33*B.z + A.a34*B.w;
+    Result.w = A.a41*B.x + A.a42*B.y + A.a43*B.z + A.a44*B.w;
+
+    return(Result);
+}
+
+static mat4
+TransposeScalar(const mat4 &M)
+{
+    mat4 Result;
+
+    for(uint32_t Row = 0;
+        Row < 4;
+        Row++)
+    {
+        for(uint32_t Column = 0;
+            Column < 4;
+            Column++)
+        {
+            Result.E[Column + Row*4] = M.E[Row + Column*4];
+        }
+    }
+
+    return(Result);
+}
+
+// NOTE(georgy): cofactor expansion, M has to be invertible
+static mat4
+InverseScalar(const mat4 &M)
+{
+    const float *m = M.E;
+    float Inv[16];
+
+    Inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    Inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    Inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    Inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    Inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    Inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    Inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    Inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    Inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+    Inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+    Inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+    Inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+    Inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+    Inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+    Inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+    Inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+
+    float OneOverDeterminant = 1.0f / (m[0]*Inv[0] + m[1]*Inv[4] + m[2]*Inv[8] + m[3]*Inv[12]);
+
+    mat4 Result;
+    for(uint32_t I = 0;
+        I < 16;
+        I++)
+    {
+        Result.E[I] = Inv[I]*OneOverDeterminant;
+    }
+
+    return(Result);
+}
+
+#if defined(VKL_SIMD_SSE)
+
+#define SIMD_SHUFFLE_MASK(X, Y, Z, W) ((X) | ((Y) << 2) | ((Z) << 4) | ((W) << 6))
+#define SIMD_SWIZZLE(V, X, Y, Z, W) _mm_shuffle_ps(V, V, SIMD_SHUFFLE_MASK(X, Y, Z, W))
+#define SIMD_SHUFFLE(A, B, X, Y, Z, W) _mm_shuffle_ps(A, B, SIMD_SHUFFLE_MASK(X, Y, Z, W))
+
+#if defined(__FMA__)
+#define SIMD_MADD(A, B, C) _mm_fmadd_ps(A, B, C)
+#define SIMD_MADD256(A, B, C) _mm256_fmadd_ps(A, B, C)
+#else
+#define SIMD_MADD(A, B, C) _mm_add_ps(_mm_mul_ps(A, B), C)
+#define SIMD_MADD256(A, B, C) _mm256_add_ps(_mm256_mul_ps(A, B), C)
+#endif
+
+// NOTE(georgy): A*B for the 2x2 blocks of the inverse, stored as (m00, m01, m10, m11)
+inline __m128
+Mat2Multiply(__m128 A, __m128 B)
+{
+    return(_mm_add_ps(_mm_mul_ps(A, SIMD_SWIZZLE(B, 0, 3, 0, 3)),
+                      _mm_mul_ps(SIMD_SWIZZLE(A, 1, 0, 3, 2), SIMD_SWIZZLE(B, 2, 1, 2, 1))));
+}
+
+// NOTE(georgy): adjugate(A)*B
+inline __m128
+Mat2AdjMultiply(__m128 A, __m128 B)
+{
+    return(_mm_sub_ps(_mm_mul_ps(SIMD_SWIZZLE(A, 3, 3, 0, 0), B),
+                      _mm_mul_ps(SIMD_SWIZZLE(A, 1, 1, 2, 2), SIMD_SWIZZLE(B, 2, 3, 0, 1))));
+}
+
+// NOTE(georgy): A*adjugate(B)
+inline __m128
+Mat2MultiplyAdj(__m128 A, __m128 B)
+{
+    return(_mm_sub_ps(_mm_mul_ps(A, SIMD_SWIZZLE(B, 3, 0, 3, 0)),
+                      _mm_mul_ps(SIMD_SWIZZLE(A, 1, 0, 3, 2), SIMD_SWIZZLE(B, 2, 1, 2, 1))));
+}
+
+#endif
+
+static mat4
+operator*(mat4 A, mat4 B)
+{
+#if defined(VKL_SIMD_AVX)
+    mat4 Result;
+
+    // NOTE(georgy): two result columns per iteration, A's columns are duplicated into both 128-bit lanes
+    __m256 A0 = _mm256_broadcast_ps((const __m128 *)(A.E + 0));
+    __m256 A1 = _mm256_broadcast_ps((const __m128 *)(A.E + 4));
+    __m256 A2 = _mm256_broadcast_ps((const __m128 *)(A.E + 8));
+    __m256 A3 = _mm256_broadcast_ps((const __m128 *)(A.E + 12));
+
+    for(uint32_t Column = 0;
+        Column < 4;
+        Column += 2)
+    {
+        __m256 BC = _mm256_loadu_ps(B.E + Column*4);
+
+        __m256 R = _mm256_mul_ps(A0, _mm256_permute_ps(BC, 0x00));
+        R = SIMD_MADD256(A1, _mm256_permute_ps(BC, 0x55), R);
+        R = SIMD_MADD256(A2, _mm256_permute_ps(BC, 0xAA), R);
+        R = SIMD_MADD256(A3, _mm256_permute_ps(BC, 0xFF), R);
+
+        _mm256_storeu_ps(Result.E + Column*4, R);
+    }
+
+    return(Result);
+#elif defined(VKL_SIMD_SSE)
+    mat4 Result;
+
+    __m128 A0 = _mm_loadu_ps(A.E + 0);
+    __m128 A1 = _mm_loadu_ps(A.E + 4);
+    __m128 A2 = _mm_loadu_ps(A.E + 8);
+    __m128 A3 = _mm_loadu_ps(A.E + 12);
+
+    for(uint32_t Column = 0;
+        Column < 4;
+        Column++)
+    {
+        __m128 BC = _mm_loadu_ps(B.E + Column*4);
+
+        __m128 R = _mm_mul_ps(A0, SIMD_SWIZZLE(BC, 0, 0, 0, 0));
+        R = SIMD_MADD(A1, SIMD_SWIZZLE(BC, 1, 1, 1, 1), R);
+        R = SIMD_MADD(A2, SIMD_SWIZZLE(BC, 2, 2, 2, 2), R);
+        R = SIMD_MADD(A3, SIMD_SWIZZLE(BC, 3, 3, 3, 3), R);
+
+        _mm_storeu_ps(Result.E + Column*4, R);
+    }
+
+    return(Result);
+#elif defined(VKL_SIMD_NEON)
+    mat4 Result;
+
+    float32x4_t A0 = vld1q_f32(A.E + 0);
+    float32x4_t A1 = vld1q_f32(A.E + 4);
+    float32x4_t A2 = vld1q_f32(A.E + 8);
+    float32x4_t A3 = vld1q_f32(A.E + 12);
+
+    for(uint32_t Column = 0;
+        Column < 4;
+        Column++)
+    {
+        float32x4_t BC = vld1q_f32(B.E + Column*4);
+
+        float32x4_t R = vmulq_lane_f32(A0, vget_low_f32(BC), 0);
+        R = vmlaq_lane_f32(R, A1, vget_low_f32(BC), 1);
+        R = vmlaq_lane_f32(R, A2, vget_high_f32(BC), 0);
+        R = vmlaq_lane_f32(R, A3, vget_high_f32(BC), 1);
+
+        vst1q_f32(Result.E + Column*4, R);
+    }
+
+    return(Result);
+#else
+    return(MultiplyScalar(A, B));
+#endif
+}
+
+// NOTE(georgy): with AVX enabled the compiler already vectorizes TransformScalar across the loop it's called in
+// (8 lanes wide, no broadcasts), and the 4-lane version measured ~0.65x of that, so AVX builds take the scalar path
+inline vec4
+operator*(const mat4 &A, vec4 B)
+{
+#if defined(VKL_SIMD_SSE) && !defined(VKL_SIMD_AVX)
+    __m128 V = _mm_loadu_ps(B.E);
+
+    __m128 R = _mm_mul_ps(_mm_loadu_ps(A.E + 0), SIMD_SWIZZLE(V, 0, 0, 0, 0));
+    R = SIMD_MADD(_mm_loadu_ps(A.E + 4), SIMD_SWIZZLE(V, 1, 1, 1, 1), R);
+    R = SIMD_MADD(_mm_loadu_ps(A.E + 8), SIMD_SWIZZLE(V, 2, 2, 2, 2), R);
+    R = SIMD_MADD(_mm_loadu_ps(A.E + 12), SIMD_SWIZZLE(V, 3, 3, 3, 3), R);
+
+    vec4 Result;
+    _mm_storeu_ps(Result.E, R);
+
+    return(Result);
+#elif defined(VKL_SIMD_NEON)
+    float32x4_t V = vld1q_f32(B.E);
+
+    float32x4_t R = vmulq_lane_f32(vld1q_f32(A.E + 0), vget_low_f32(V), 0);
+    R = vmlaq_lane_f32(R, vld1q_f32(A.E + 4), vget_low_f32(V), 1);
+    R = vmlaq_lane_f32(R, vld1q_f32(A.E + 8), vget_high_f32(V), 0);
+    R = vmlaq_lane_f32(R, vld1q_f32(A.E + 12), vget_high_f32(V), 1);
+
+    vec4 Result;
+    vst1q_f32(Result.E, R);
+
+    return(Result);
+#else
+    return(TransformScalar(A, B));
+#endif
+}
+
+static mat4
+Transpose(const mat4 &M)
+{
+#if defined(VKL_SIMD_SSE)
+    __m128 C0 = _mm_loadu_ps(M.E + 0);
+    __m128 C1 = _mm_loadu_ps(M.E + 4);
+    __m128 C2 = _mm_loadu_ps(M.E + 8);
+    __m128 C3 = _mm_loadu_ps(M.E + 12);
+
+    _MM_TRANSPOSE4_PS(C0, C1, C2, C3);
+
+    mat4 Result;
+    _mm_storeu_ps(Result.E + 0, C0);
+    _mm_storeu_ps(Result.E + 4, C1);
+    _mm_storeu_ps(Result.E + 8, C2);
+    _mm_storeu_ps(Result.E + 12, C3);
+
+    return(Result);
+#elif defined(VKL_SIMD_NEON)
+    // NOTE(georgy): de-interleaving load is a transpose
+    float32x4x4_t Rows = vld4q_f32(M.E);
+
+    mat4 Result;
+    vst1q_f32(Result.E + 0, Rows.val[0]);
+    vst1q_f32(Result.E + 4, Rows.val[1]);
+    vst1q_f32(Result.E + 8, Rows.val[2]);
+    vst1q_f32(Result.E + 12, Rows.val[3]);
+
+    return(Result);
+#else
+    return(TransposeScalar(M));
+#endif
+}
+
+// NOTE(georgy): general inverse, M has to be invertible.
+// The SSE path inverts via 2x2 blocks (adjugates and Schur complements) instead of cofactors,
+// it only needs SSE2 shuffles and works for either storage order since inverse(transpose(M)) = transpose(inverse(M)).
+static mat4
+Inverse(const mat4 &M)
+{
+#if defined(VKL_SIMD_SSE)
+    __m128 C0 = _mm_loadu_ps(M.E + 0);
+    __m128 C1 = _mm_loadu_ps(M.E + 4);
+    __m128 C2 = _mm_loadu_ps(M.E + 8);
+    __m128 C3 = _mm_loadu_ps(M.E + 12);
+
+    __m128 A = _mm_movelh_ps(C0, C1);
+    __m128 B = _mm_movehl_ps(C1, C0);
+    __m128 C = _mm_movelh_ps(C2, C3);
+    __m128 D = _mm_movehl_ps(C3, C2);
+
+    // NOTE(georgy): (|A|, |B|, |C|, |D|)
+    __m128 DetSub = _mm_sub_ps(_mm_mul_ps(SIMD_SHUFFLE(C0, C2, 0, 2, 0, 2), SIMD_SHUFFLE(C1, C3, 1, 3, 1, 3)),
+                               _mm_mul_ps(SIMD_SHUFFLE(C0, C2, 1, 3, 1, 3), SIMD_SHUFFLE(C1, C3, 0, 2, 0, 2)));
+    __m128 DetA = SIMD_SWIZZLE(DetSub, 0, 0, 0, 0);
+    __m128 DetB = SIMD_SWIZZLE(DetSub, 1, 1, 1, 1);
+    __m128 DetC = SIMD_SWIZZLE(DetSub, 2, 2, 2, 2);
+    __m128 DetD = SIMD_SWIZZLE(DetSub, 3, 3, 3, 3);
+
+    __m128 D_C = Mat2AdjMultiply(D, C);
+    __m128 A_B = Mat2AdjMultiply(A, B);
+
+    __m128 X_ = _mm_sub_ps(_mm_mul_ps(DetD, A), Mat2Multiply(B, D_C));
+    __m128 W_ = _mm_sub_ps(_mm_mul_ps(DetA, D), Mat2Multiply(C, A_B));
+    __m128 Y_ = _mm_sub_ps(_mm_mul_ps(DetB, C), Mat2MultiplyAdj(D, A_B));
+    __m128 Z_ = _mm_sub_ps(_mm_mul_ps(DetC, B), Mat2MultiplyAdj(A, D_C));
+
+    // NOTE(georgy): |M| = |A||D| + |B||C| - tr(A#B D#C), the trace is summed with shuffles instead of SSE3 hadd
+    __m128 Trace = _mm_mul_ps(A_B, SIMD_SWIZZLE(D_C, 0, 2, 1, 3));
+    Trace = _mm_add_ps(Trace, SIMD_SWIZZLE(Trace, 2, 3, 0, 1));
+    Trace = _mm_add_ps(Trace, SIMD_SWIZZLE(Trace, 1, 0, 3, 2));
+
+    __m128 DetM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(DetA, DetD), _mm_mul_ps(DetB, DetC)), Trace);
+    __m128 OneOverDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), DetM);
+
+    X_ = _mm_mul_ps(X_, OneOverDetM);
+    Y_ = _mm_mul_ps(Y_, OneOverDetM);
+    Z_ = _mm_mul_ps(Z_, OneOverDetM);
+    W_ = _mm_mul_ps(W_, OneOverDetM);
+
+    mat4 Result;
+    _mm_storeu_ps(Result.E + 0, SIMD_SHUFFLE(X_, Y_, 3, 1, 3, 1));
+    _mm_storeu_ps(Result.E + 4, SIMD_SHUFFLE(X_, Y_, 2, 0, 2, 0));
+    _mm_storeu_ps(Result.E + 8, SIMD_SHUFFLE(Z_, W_, 3, 1, 3, 1));
+    _mm_storeu_ps(Result.E + 12, SIMD_SHUFFLE(Z_, W_, 2, 0, 2, 0));
+
+    return(Result);
+#else
+    // NOTE(georgy): non-x86 builds use the cofactor version on purpose. The block inverse above is built on
+    // arbitrary 2-source shuffles, which are one shufps each on SSE but 2-3 ext/zip/rev ops on NEON, while
+    // InverseScalar is plain multiply-adds that the compiler vectorizes fine
+    return(InverseScalar(M));
+#endif
+}
+
+// NOTE(georgy): for affine M (bottom row 0, 0, 0, 1), i.e. any rotation/scale/shear plus translation.
+// Only the upper 3x3 is inverted, its inverse rows are the cross products of its columns divided by the determinant,
+// the translation becomes -inverse(3x3)*T.
+static mat4
+InverseAffineScalar(const mat4 &M)
+{
+    vec3 X = vec3(M.a11, M.a21, M.a31);
+    vec3 Y = vec3(M.a12, M.a22, M.a32);
+    vec3 Z = vec3(M.a13, M.a23, M.a33);
+    vec3 T = vec3(M.a14, M.a24, M.a34);
+
+    vec3 Row0 = Cross(Y, Z);
+    vec3 Row1 = Cross(Z, X);
+    vec3 Row2 = Cross(X, Y);
+
+    float OneOverDeterminant = 1.0f / Dot(X, Row0);
+    Row0 = Row0*OneOverDeterminant;
+    Row1 = Row1*OneOverDeterminant;
+    Row2 = Row2*OneOverDeterminant;
+
+    mat4 Result;
+
+    Result.a11 = Row0.x; Result.a12 = Row0.y; Result.a13 = Row0.z; Result.a14 = -Dot(Row0, T);
+    Result.a21 = Row1.x; Result.a22 = Row1.y; Result.a23 = Row1.z; Result.a24 = -Dot(Row1, T);
+    Result.a31 = Row2.x; Result.a32 = Row2.y; Result.a33 = Row2.z; Result.a34 = -Dot(Row2, T);
+    Result.a41 = 0.0f; Result.a42 = 0.0f; Result.a43 = 0.0f; Result.a44 = 1.0f;
+
+    return(Result);
+}
+
+#if defined(VKL_SIMD_SSE)
+// NOTE(georgy): A x B with the w lane as 0 if both inputs have w = 0
+inline __m128
+CrossSSE(__m128 A, __m128 B)
+{
+    __m128 Result = _mm_sub_ps(_mm_mul_ps(A, SIMD_SWIZZLE(B, 1, 2, 0, 3)), _mm_mul_ps(SIMD_SWIZZLE(A, 1, 2, 0, 3), B));
+
+    return(SIMD_SWIZZLE(Result, 1, 2, 0, 3));
+}
+#endif
+
+static mat4
+InverseAffine(const mat4 &M)
+{
+#if defined(VKL_SIMD_SSE)
+    // NOTE(georgy): clear w, the bottom row is assumed to be (0, 0, 0, 1) anyway
+    __m128 Mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+    __m128 X = _mm_and_ps(_mm_loadu_ps(M.E + 0), Mask);
+    __m128 Y = _mm_and_ps(_mm_loadu_ps(M.E + 4), Mask);
+    __m128 Z = _mm_and_ps(_mm_loadu_ps(M.E + 8), Mask);
+    __m128 T = _mm_loadu_ps(M.E + 12);
+
+    __m128 Row0 = CrossSSE(Y, Z);
+    __m128 Row1 = CrossSSE(Z, X);
+    __m128 Row2 = CrossSSE(X, Y);
+
+    __m128 Determinant = _mm_mul_ps(X, Row0);
+    Determinant = _mm_add_ps(Determinant, SIMD_SWIZZLE(Determinant, 2, 3, 0, 1));
+    Determinant = _mm_add_ps(Determinant, SIMD_SWIZZLE(Determinant, 1, 0, 3, 2));
+
+    __m128 OneOverDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), Determinant);
+    Row0 = _mm_mul_ps(Row0, OneOverDeterminant);
+    Row1 = _mm_mul_ps(Row1, OneOverDeterminant);
+    Row2 = _mm_mul_ps(Row2, OneOverDeterminant);
+
+    __m128 Row3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(Row0, Row1, Row2, Row3);
+
+    // NOTE(georgy): after the transpose Row0..Row2 are the columns of the inverse, the last one is -inverse(3x3)*T
+    __m128 Translation = _mm_mul_ps(Row0, SIMD_SWIZZLE(T, 0, 0, 0, 0));
+    Translation = SIMD_MADD(Row1, SIMD_SWIZZLE(T, 1, 1, 1, 1), Translation);
+    Translation = SIMD_MADD(Row2, SIMD_SWIZZLE(T, 2, 2, 2, 2), Translation);
+    Translation = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), Translation);
+
+    mat4 Result;
+    _mm_storeu_ps(Result.E + 0, Row0);
+    _mm_storeu_ps(Result.E + 4, Row1);
+    _mm_storeu_ps(Result.E + 8, Row2);
+    _mm_storeu_ps(Result.E + 12, Translation);
+
+    return(Result);
+#else
+    return(InverseAffineScalar(M));
+#endif
+}
+
+// NOTE(georgy): transpose(inverse(3x3 of M)), for transforming normals, i.e. the cofactor matrix over the determinant.
+// Written out per element rather than as cross products of the columns: the compiler vectorizes the flat form
+// across the loop, the vec3 cross products turned into shuffles and measured slower than Inverse3x3 by hand.
+// Unlike Inverse3x3 there's no determinant check, mirrored transforms (negative determinant) are valid here
+static mat3
+NormalMatrix(const mat4 &M)
+{
+    float Determinant = M.a11*M.a22*M.a33 + M.a12*M.a23*M.a31 + M.a13*M.a21*M.a32 -
+                       (M.a31*M.a22*M.a13 + M.a32*M.a23*M.a11 + M.a33*M.a21*M.a12);
+    float OneOverDeterminant = 1.0f / Determinant;
+
+    mat3 Result;
+
+    Result.a11 = (M.a22*M.a33 - M.a32*M.a23)*OneOverDeterminant;
+    Result.a12 = (-(M.a21*M.a33 - M.a31*M.a23))*OneOverDeterminant;
+    Result.a13 = (M.a21*M.a32 - M.a31*M.a22)*OneOverDeterminant;
+    Result.a21 = (-(M.a12*M.a33 - M.a32*M.a13))*OneOverDeterminant;
+    Result.a22 = (M.a11*M.a33 - M.a31*M.a13)*OneOverDeterminant;
+    Result.a23 = (-(M.a11*M.a32 - M.a31*M.a12))*OneOverDeterminant;
+    Result.a31 = (M.a12*M.a23 - M.a22*M.a13)*OneOverDeterminant;
+    Result.a32 = (-(M.a11*M.a23 - M.a21*M.a13))*OneOverDeterminant;
+    Result.a33 = (M.a11*M.a22 - M.a21*M.a12)*OneOverDeterminant;
+
+    return(Result);
+}
+
+// 
+// NOTE(georgy): batched SoA transforms
+// 
+// Every element has its own affine transform, stored as one array per matrix entry (same indices as mat4.E,
+// the bottom row E[3], E[7], E[11], E[15] is never read). The wide versions process 4 (SSE) or 8 (AVX2) elements
+// per iteration with plain loads from each array, so large batches are limited by memory bandwidth, not ALU.
+// Out may alias In.
+// 
+
+struct mat4_soa
+{
+    float *E[16];
+};
+
+struct points_soa
+{
+    float *X, *Y, *Z;
+};
+
+struct spheres_soa
+{
+    float *X, *Y, *Z, *Radius;
+};
+
+struct aabbs_soa
+{
+    float *MinX, *MinY, *MinZ;
+    float *MaxX, *MaxY, *MaxZ;
+};
+
+static void
+TransformPointsScalar(const mat4_soa &M, const points_soa &In, const points_soa &Out, uint32_t Begin, uint32_t End)
+{
+    for(uint32_t I = Begin;
+        I < End;
+        I++)
+    {
+        float X = In.X[I], Y = In.Y[I], Z = In.Z[I];
+
+        Out.X[I] = M.E[0][I]*X + M.E[4][I]*Y + M.E[8][I]*Z + M.E[12][I];
+        Out.Y[I] = M.E[1][I]*X + M.E[5][I]*Y + M.E[9][I]*Z + M.E[13][I];
+        Out.Z[I] = M.E[2][I]*X + M.E[6][I]*Y + M.E[10][I]*Z + M.E[14][I];
+    }
+}
+
+// NOTE(georgy): radius is scaled by the largest axis scale, so non-uniform scale still gives a conservative sphere
+static void
+TransformSpheresScalar(const mat4_soa &M, const spheres_soa &In, const spheres_soa &Out, uint32_t Begin, uint32_t End)
+{
+    for(uint32_t I = Begin;
+        I < End;
+        I++)
+    {
+        float X = In.X[I], Y = In.Y[I], Z = In.Z[I];
+
+        Out.X[I] = M.E[0][I]*X + M.E[4][I]*Y + M.E[8][I]*Z + M.E[12][I];
+        Out.Y[I] = M.E[1][I]*X + M.E[5][I]*Y + M.E[9][I]*Z + M.E[13][I];
+        Out.Z[I] = M.E[2][I]*X + M.E[6][I]*Y + M.E[10][I]*Z + M.E[14][I];
+
+        float ScaleX = M.E[0][I]*M.E[0][I] + M.E[1][I]*M.E[1][I] + M.E[2][I]*M.E[2][I];
+        float ScaleY = M.E[4][I]*M.E[4][I] + M.E[5][I]*M.E[5][I] + M.E[6][I]*M.E[6][I];
+        float ScaleZ = M.E[8][I]*M.E[8][I] + M.E[9][I]*M.E[9][I] + M.E[10][I]*M.E[10][I];
+
+        Out.Radius[I] = In.Radius[I] * sqrtf(Max(ScaleX, Max(ScaleY, ScaleZ)));
+    }
+}
+
+// NOTE(georgy): transformed center plus extents through |M| (Arvo), gives the tight AABB of the transformed box
+static void
+TransformAABBsScalar(const mat4_soa &M, const aabbs_soa &In, const aabbs_soa &Out, uint32_t Begin, uint32_t End)
+{
+    for(uint32_t I = Begin;
+        I < End;
+        I++)
+    {
+        float CX = (In.MinX[I] + In.MaxX[I])*0.5f, EX = (In.MaxX[I] - In.MinX[I])*0.5f;
+        float CY = (In.MinY[I] + In.MaxY[I])*0.5f, EY = (In.MaxY[I] - In.MinY[I])*0.5f;
+        float CZ = (In.MinZ[I] + In.MaxZ[I])*0.5f, EZ = (In.MaxZ[I] - In.MinZ[I])*0.5f;
+
+        float NewCX = M.E[0][I]*CX + M.E[4][I]*CY + M.E[8][I]*CZ + M.E[12][I];
+        float NewCY = M.E[1][I]*CX + M.E[5][I]*CY + M.E[9][I]*CZ + M.E[13][I];
+        float NewCZ = M.E[2][I]*CX + M.E[6][I]*CY + M.E[10][I]*CZ + M.E[14][I];
+
+        float NewEX = fabsf(M.E[0][I])*EX + fabsf(M.E[4][I])*EY + fabsf(M.E[8][I])*EZ;
+        float NewEY = fabsf(M.E[1][I])*EX + fabsf(M.E[5][I])*EY + fabsf(M.E[9][I])*EZ;
+        float NewEZ = fabsf(M.E[2][I])*EX + fabsf(M.E[6][I])*EY + fabsf(M.E[10][I])*EZ;
+
+        Out.MinX[I] = NewCX - NewEX; Out.MaxX[I] = NewCX + NewEX;
+        Out.MinY[I] = NewCY - NewEY; Out.MaxY[I] = NewCY + NewEY;
+        Out.MinZ[I] = NewCZ - NewEZ; Out.MaxZ[I] = NewCZ + NewEZ;
+    }
+}
+
+#if defined(VKL_SIMD_SSE)
+
+static void
+TransformPointsSSE(const mat4_soa &M, const points_soa &In, const points_soa &Out, uint32_t Count)
+{
+    uint32_t I = 0;
+    for(;
+        I + 4 <= Count;
+        I += 4)
+    {
+        __m128 X = _mm_loadu_ps(In.X + I), Y = _mm_loadu_ps(In.Y + I), Z = _mm_loadu_ps(In.Z + I);
+
+        __m128 OutX = SIMD_MADD(_mm_loadu_ps(M.E[8] + I), Z, SIMD_MADD(_mm_loadu_ps(M.E[4] + I), Y, SIMD_MADD(_mm_loadu_ps(M.E[0] + I), X, _mm_loadu_ps(M.E[12] + I))));
+        __m128 OutY = SIMD_MADD(_mm_loadu_ps(M.E[9] + I), Z, SIMD_MADD(_mm_loadu_ps(M.E[5] + I), Y, SIMD_MADD(_mm_loadu_ps(M.E[1] + I), X, _mm_loadu_ps(M.E[13] + I))));
+        __m128 OutZ = SIMD_MADD(_mm_loadu_ps(M.E[10] + I), Z, SIMD_MADD(_mm_loadu_ps(M.E[6] + I), Y, SIMD_MADD(_mm_loadu_ps(M.E[2] + I), X, _mm_loadu_ps(M.E[14] + I))));
+
+        _mm_storeu_ps(Out.X + I, OutX);
+        _mm_storeu_ps(Out.Y + I, OutY);
+        _mm_storeu_ps(Out.Z + I, OutZ);
+    }
+
+    TransformPointsScalar(M, In, Out, I, Count);
+}
+
+static void
+TransformSpheresSSE(const mat4_soa &M, const spheres_soa &In, const spheres_soa &Out, uint32_t Count)
+{
+    uint32_t I = 0;
+    for(;
+        I + 4 <= Count;
+        I += 4)
+    {
+        __m128 M0 = _mm_loadu_ps(M.E[0] + I), M1 = _mm_loadu_ps(M.E[1] + I), M2 = _mm_loadu_ps(M.E[2] + I);
+        __m128 M4 = _mm_loadu_ps(M.E[4] + I), M5 = _mm_loadu_ps(M.E[5] + I), M6 = _mm_loadu_ps(M.E[6] + I);
+        __m128 M8 = _mm_loadu_ps(M.E[8] + I), M9 = _mm_loadu_ps(M.E[9] + I), M10 = _mm_loadu_ps(M.E[10] + I);
+
+        __m128 X = _mm_loadu_ps(In.X + I), Y = _mm_loadu_ps(In.Y + I), Z = _mm_loadu_ps(In.Z + I);
+
+        _mm_storeu_ps(Out.X + I, SIMD_MADD(M8, Z, SIMD_MADD(M4, Y, SIMD_MADD(M0, X, _mm_loadu_ps(M.E[12] + I)))));
+        _mm_storeu_ps(Out.Y + I, SIMD_MADD(M9, Z, SIMD_MADD(M5, Y, SIMD_MADD(M1, X, _mm_loadu_ps(M.E[13] + I)))));
+        _mm_storeu_ps(Out.Z + I, SIMD_MADD(M10, Z, SIMD_MADD(M6, Y, SIMD_MADD(M2, X, _mm_loadu_ps(M.E[14] + I)))));
+
+        __m128 ScaleX = SIMD_MADD(M2, M2, SIMD_MADD(M1, M1, _mm_mul_ps(M0, M0)));
+        __m128 ScaleY = SIMD_MADD(M6, M6, SIMD_MADD(M5, M5, _mm_mul_ps(M4, M4)));
+        __m128 ScaleZ = SIMD_MADD(M10, M10, SIMD_MADD(M9, M9, _mm_mul_ps(M8, M8)));
+        __m128 Scale = _mm_sqrt_ps(_mm_max_ps(ScaleX, _mm_max_ps(ScaleY, ScaleZ)));
+
+        _mm_storeu_ps(Out.Radius + I, _mm_mul_ps(_mm_loadu_ps(In.Radius + I), Scale));
+    }
+
+    TransformSpheresScalar(M, In, Out, I, Count);
+}
+
+static void
+TransformAABBsSSE(const mat4_soa &M, const aabbs_soa &In, const aabbs_soa &Out, uint32_t Count)
+{
+    __m128 Half = _mm_set1_ps(0.5f);
+    __m128 AbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    uint32_t I = 0;
+    for(;
+        I + 4 <= Count;
+        I += 4)
+    {
+        __m128 MinX = _mm_loadu_ps(In.MinX + I), MaxX = _mm_loadu_ps(In.MaxX + I);
+        __m128 MinY = _mm_loadu_ps(In.MinY + I), MaxY = _mm_loadu_ps(In.MaxY + I);
+        __m128 MinZ = _mm_loadu_ps(In.MinZ + I), MaxZ = _mm_loadu_ps(In.MaxZ + I);
+
+        __m128 CX = _mm_mul_ps(_mm_add_ps(MinX, MaxX), Half), EX = _mm_mul_ps(_mm_sub_ps(MaxX, MinX), Half);
+        __m128 CY = _mm_mul_ps(_mm_add_ps(MinY, MaxY), Half), EY = _mm_mul_ps(_mm_sub_ps(MaxY, MinY), Half);
+        __m128 CZ = _mm_mul_ps(_mm_add_ps(MinZ, MaxZ), Half), EZ = _mm_mul_ps(_mm_sub_ps(MaxZ, MinZ), Half);
+
+        __m128 M0 = _mm_loadu_ps(M.E[0] + I), M1 = _mm_loadu_ps(M.E[1] + I), M2 = _mm_loadu_ps(M.E[2] + I);
+        __m128 M4 = _mm_loadu_ps(M.E[4] + I), M5 = _mm_loadu_ps(M.E[5] + I), M6 = _mm_loadu_ps(M.E[6] + I);
+        __m128 M8 = _mm_loadu_ps(M.E[8] + I), M9 = _mm_loadu_ps(M.E[9] + I), M10 = _mm_loadu_ps(M.E[10] + I);
+
+        __m128 NewCX = SIMD_MADD(M8, CZ, SIMD_MADD(M4, CY, SIMD_MADD(M0, CX, _mm_loadu_ps(M.E[12] + I))));
+        __m128 NewCY = SIMD_MADD(M9, CZ, SIMD_MADD(M5, CY, SIMD_MADD(M1, CX, _mm_loadu_ps(M.E[13] + I))));
+        __m128 NewCZ = SIMD_MADD(M10, CZ, SIMD_MADD(M6, CY, SIMD_MADD(M2, CX, _mm_loadu_ps(M.E[14] + I))));
+
+        __m128 NewEX = SIMD_MADD(_mm_and_ps(M8, AbsMask), EZ, SIMD_MADD(_mm_and_ps(M4, AbsMask), EY, _mm_mul_ps(_mm_and_ps(M0, AbsMask), EX)));
+        __m128 NewEY = SIMD_MADD(_mm_and_ps(M9, AbsMask), EZ, SIMD_MADD(_mm_and_ps(M5, AbsMask), EY, _mm_mul_ps(_mm_and_ps(M1, AbsMask), EX)));
+        __m128 NewEZ = SIMD_MADD(_mm_and_ps(M10, AbsMask), EZ, SIMD_MADD(_mm_and_ps(M6, AbsMask), EY, _mm_mul_ps(_mm_and_ps(M2, AbsMask), EX)));
+
+        _mm_storeu_ps(Out.MinX + I, _mm_sub_ps(NewCX, NewEX)); _mm_storeu_ps(Out.MaxX + I, _mm_add_ps(NewCX, NewEX));
+        _mm_storeu_ps(Out.MinY + I, _mm_sub_ps(NewCY, NewEY)); _mm_storeu_ps(Out.MaxY + I, _mm_add_ps(NewCY, NewEY));
+        _mm_storeu_ps(Out.MinZ + I, _mm_sub_ps(NewCZ, NewEZ)); _mm_storeu_ps(Out.MaxZ + I, _mm_add_ps(NewCZ, NewEZ));
+    }
+
+    TransformAABBsScalar(M, In, Out, I, Count);
+}
+
+#endif
+
+#if defined(VKL_SIMD_AVX2)
+
+static void
+TransformPointsAVX2(const mat4_soa &M, const points_soa &In, const points_soa &Out, uint32_t Count)
+{
+    uint32_t I = 0;
+    for(;
+        I + 8 <= Count;
+        I += 8)
+    {
+        __m256 X = _mm256_loadu_ps(In.X + I), Y = _mm256_loadu_ps(In.Y + I), Z = _mm256_loadu_ps(In.Z + I);
+
+        __m256 OutX = SIMD_MADD256(_mm256_loadu_ps(M.E[8] + I), Z, SIMD_MADD256(_mm256_loadu_ps(M.E[4] + I), Y, SIMD_MADD256(_mm256_loadu_ps(M.E[0] + I), X, _mm256_loadu_ps(M.E[12] + I))));
+        __m256 OutY = SIMD_MADD256(_mm256_loadu_ps(M.E[9] + I), Z, SIMD_MADD256(_mm256_loadu_ps(M.E[5] + I), Y, SIMD_MADD256(_mm256_loadu_ps(M.E[1] + I), X, _mm256_loadu_ps(M.E[13] + I))));
+        __m256 OutZ = SIMD_MADD256(_mm256_loadu_ps(M.E[10] + I), Z, SIMD_MADD256(_mm256_loadu_ps(M.E[6] + I), Y, SIMD_MADD256(_mm256_loadu_ps(M.E[2] + I), X, _mm256_loadu_ps(M.E[14] + I))));
+
+        _mm256_storeu_ps(Out.X + I, OutX);
+        _mm256_storeu_ps(Out.Y + I, OutY);
+        _mm256_storeu_ps(Out.Z + I, OutZ);
+    }
+
+    TransformPointsScalar(M, In, Out, I, Count);
+}
+
+static void
+TransformSpheresAVX2(const mat4_soa &M, const spheres_soa &In, const spheres_soa &Out, uint32_t Count)
+{
+    uint32_t I = 0;
+    for(;
+        I + 8 <= Count;
+        I += 8)
+    {
+        __m256 M0 = _mm256_loadu_ps(M.E[0] + I), M1 = _mm256_loadu_ps(M.E[1] + I), M2 = _mm256_loadu_ps(M.E[2] + I);
+        __m256 M4 = _mm256_loadu_ps(M.E[4] + I), M5 = _mm256_loadu_ps(M.E[5] + I), M6 = _mm256_loadu_ps(M.E[6] + I);
+        __m256 M8 = _mm256_loadu_ps(M.E[8] + I), M9 = _mm256_loadu_ps(M.E[9] + I), M10 = _mm256_loadu_ps(M.E[10] + I);
+
+        __m256 X = _mm256_loadu_ps(In.X + I), Y = _mm256_loadu_ps(In.Y + I), Z = _mm256_loadu_ps(In.Z + I);
+
+        _mm256_storeu_ps(Out.X + I, SIMD_MADD256(M8, Z, SIMD_MADD256(M4, Y, SIMD_MADD256(M0, X, _mm256_loadu_ps(M.E[12] + I)))));
+        _mm256_storeu_ps(Out.Y + I, SIMD_MADD256(M9, Z, SIMD_MADD256(M5, Y, SIMD_MADD256(M1, X, _mm256_loadu_ps(M.E[13] + I)))));
+        _mm256_storeu_ps(Out.Z + I, SIMD_MADD256(M10, Z, SIMD_MADD256(M6, Y, SIMD_MADD256(M2, X, _mm256_loadu_ps(M.E[14] + I)))));
+
+        __m256 ScaleX = SIMD_MADD256(M2, M2, SIMD_MADD256(M1, M1, _mm256_mul_ps(M0, M0)));
+        __m256 ScaleY = SIMD_MADD256(M6, M6, SIMD_MADD256(M5, M5, _mm256_mul_ps(M4, M4)));
+        __m256 ScaleZ = SIMD_MADD256(M10, M10, SIMD_MADD256(M9, M9, _mm256_mul_ps(M8, M8)));
+        __m256 Scale = _mm256_sqrt_ps(_mm256_max_ps(ScaleX, _mm256_max_ps(ScaleY, ScaleZ)));
+
+        _mm256_storeu_ps(Out.Radius + I, _mm256_mul_ps(_mm256_loadu_ps(In.Radius + I), Scale));
+    }
+
+    TransformSpheresScalar(M, In, Out, I, Count);
+}
+
+static void
+TransformAABBsAVX2(const mat4_soa &M, const aabbs_soa &In, const aabbs_soa &Out, uint32_t Count)
+{
+    __m256 Half = _mm256_set1_ps(0.5f);
+    __m256 AbsMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    uint32_t I = 0;
+    for(;
+        I + 8 <= Count;
+        I += 8)
+    {
+        __m256 MinX = _mm256_loadu_ps(In.MinX + I), MaxX = _mm256_loadu_ps(In.MaxX + I);
+        __m256 MinY = _mm256_loadu_ps(In.MinY + I), MaxY = _mm256_loadu_ps(In.MaxY + I);
+        __m256 MinZ = _mm256_loadu_ps(In.MinZ + I), MaxZ = _mm256_loadu_ps(In.MaxZ + I);
+
+        __m256 CX = _mm256_mul_ps(_mm256_add_ps(MinX, MaxX), Half), EX = _mm256_mul_ps(_mm256_sub_ps(MaxX, MinX), Half);
+        __m256 CY = _mm256_mul_ps(_mm256_add_ps(MinY, MaxY), Half), EY = _mm256_mul_ps(_mm256_sub_ps(MaxY, MinY), Half);
+        __m256 CZ = _mm256_mul_ps(_mm256_add_ps(MinZ, MaxZ), Half), EZ = _mm256_mul_ps(_mm256_sub_ps(MaxZ, MinZ), Half);
+
+        __m256 M0 = _mm256_loadu_ps(M.E[0] + I), M1 = _mm256_loadu_ps(M.E[1] + I), M2 = _mm256_loadu_ps(M.E[2] + I);
+        __m256 M4 = _mm256_loadu_ps(M.E[4] + I), M5 = _mm256_loadu_ps(M.E[5] + I), M6 = _mm256_loadu_ps(M.E[6] + I);
+        __m256 M8 = _mm256_loadu_ps(M.E[8] + I), M9 = _mm256_loadu_ps(M.E[9] + I), M10 = _mm256_loadu_ps(M.E[10] + I);
+
+        __m256 NewCX = SIMD_MADD256(M8, CZ, SIMD_MADD256(M4, CY, SIMD_MADD256(M0, CX, _mm256_loadu_ps(M.E[12] + I))));
+        __m256 NewCY = SIMD_MADD256(M9, CZ, SIMD_MADD256(M5, CY, SIMD_MADD256(M1, CX, _mm256_loadu_ps(M.E[13] + I))));
+        __m256 NewCZ = SIMD_MADD256(M10, CZ, SIMD_MADD256(M6, CY, SIMD_MADD256(M2, CX, _mm256_loadu_ps(M.E[14] + I))));
+
+        __m256 NewEX = SIMD_MADD256(_mm256_and_ps(M8, AbsMask), EZ, SIMD_MADD256(_mm256_and_ps(M4, AbsMask), EY, _mm256_mul_ps(_mm256_and_ps(M0, AbsMask), EX)));
+        __m256 NewEY = SIMD_MADD256(_mm256_and_ps(M9, AbsMask), EZ, SIMD_MADD256(_mm256_and_ps(M5, AbsMask), EY, _mm256_mul_ps(_mm256_and_ps(M1, AbsMask), EX)));
+        __m256 NewEZ = SIMD_MADD256(_mm256_and_ps(M10, AbsMask), EZ, SIMD_MADD256(_mm256_and_ps(M6, AbsMask), EY, _mm256_mul_ps(_mm256_and_ps(M2, AbsMask), EX)));
+
+        _mm256_storeu_ps(Out.MinX + I, _mm256_sub_ps(NewCX, NewEX)); _mm256_storeu_ps(Out.MaxX + I, _mm256_add_ps(NewCX, NewEX));
+        _mm256_storeu_ps(Out.MinY + I, _mm256_sub_ps(NewCY, NewEY)); _mm256_storeu_ps(Out.MaxY + I, _mm256_add_ps(NewCY, NewEY));
+        _mm256_storeu_ps(Out.MinZ + I, _mm256_sub_ps(NewCZ, NewEZ)); _mm256_storeu_ps(Out.MaxZ + I, _mm256_add_ps(NewCZ, NewEZ));
+    }
+
+    TransformAABBsScalar(M, In, Out, I, Count);
+}
+
+#endif
+
+inline void
+TransformPoints(const mat4_soa &M, const points_soa &In, const points_soa &Out, uint32_t Count)
+{
+#if defined(VKL_SIMD_AVX2)
+    TransformPointsAVX2(M, In, Out, Count);
+#elif defined(VKL_SIMD_SSE)
+    TransformPointsSSE(M, In, Out, Count);
+#else
+    TransformPointsScalar(M, In, Out, 0, Count);
+#endif
+}
+
+inline void
+TransformSpheres(const mat4_soa &M, const spheres_soa &In, const spheres_soa &Out, uint32_t Count)
+{
+#if defined(VKL_SIMD_AVX2)
+    TransformSpheresAVX2(M, In, Out, Count);
+#elif defined(VKL_SIMD_SSE)
+    TransformSpheresSSE(M, In, Out, Count);
+#else
+    TransformSpheresScalar(M, In, Out, 0, Count);
+#endif
+}
+
+inline void
+TransformAABBs(const mat4_soa &M, const aabbs_soa &In, const aabbs_soa &Out, uint32_t Count)
+{
+#if defined(VKL_SIMD_AVX2)
+    TransformAABBsAVX2(M, In, Out, Count);
+#elif defined(VKL_SIMD_SSE)
+    TransformAABBsSSE(M, In, Out, Count);
+#else
+    TransformAABBsScalar(M, In, Out, 0, Count);
+#endif
+}
+
+// 
+// NOTE(georgy): frustum culling
+// 
+// Planes are extracted from the rows of the view-projection matrix (Gribb/Hartmann) for Vulkan's [0, 1] depth range,
+// they point inside, so an object is visible unless it is completely behind one of them.
+// The culling functions test a whole SoA batch against all 6 planes, 4 (SSE) or 8 (AVX2) objects per iteration,
+// and write the indices of the visible ones to Visible in order, returning how many there are.
+// Visible has to have room for Count indices.
+// 
+
+#define FRUSTUM_PLANE_COUNT 6
+
+static void
+ExtractFrustumPlanes(plane *Planes, const mat4 &ViewProjection)
+{
+    const mat4 &M = ViewProjection;
+
+    vec4 Row0 = vec4(M.a11, M.a12, M.a13, M.a14);
+    vec4 Row1 = vec4(M.a21, M.a22, M.a23, M.a24);
+    vec4 Row2 = vec4(M.a31, M.a32, M.a33, M.a34);
+    vec4 Row3 = vec4(M.a41, M.a42, M.a43, M.a44);
+
+    Planes[0] = NormalizePlane(Row3 + Row0); // NOTE(georgy): left
+    Planes[1] = NormalizePlane(Row3 - Row0); // NOTE(georgy): right
+    Planes[2] = NormalizePlane(Row3 + Row1); // NOTE(georgy): bottom
+    Planes[3] = NormalizePlane(Row3 - Row1); // NOTE(georgy): top
+    Planes[4] = NormalizePlane(Row2);        // NOTE(georgy): near, z >= 0
+    Planes[5] = NormalizePlane(Row3 - Row2); // NOTE(georgy): far, z <= w
+}
+
+static uint32_t
+CullSpheresScalar(const plane *Planes, const spheres_soa &Spheres, uint32_t Begin, uint32_t End, uint32_t *Visible)
+{
+    uint32_t VisibleCount = 0;
+
+    for(uint32_t I = Begin;
+        I < End;
+        I++)
+    {
+        vec3 Center = vec3(Spheres.X[I], Spheres.Y[I], Spheres.Z[I]);
+
+        bool Inside = true;
+        for(uint32_t P = 0;
+            P < FRUSTUM_PLANE_COUNT;
+            P++)
+        {
+            Inside = Inside && (SignedDistance(Planes[P], Center) >= -Spheres.Radius[I]);
+        }
+
+        Visible[VisibleCount] = I;
+        VisibleCount += Inside;
+    }
+
+    return(VisibleCount);
+}
+
+static uint32_t
+CullAABBsScalar(const plane *Planes, const aabbs_soa &AABBs, uint32_t Begin, uint32_t End, uint32_t *Visible)
+{
+    uint32_t VisibleCount = 0;
+
+    for(uint32_t I = Begin;
+        I < End;
+        I++)
+    {
+        vec3 Center = vec3(AABBs.MinX[I] + AABBs.MaxX[I], AABBs.MinY[I] + AABBs.MaxY[I], AABBs.MinZ[I] + AABBs.MaxZ[I])*0.5f;
+        vec3 Extents = vec3(AABBs.MaxX[I] - AABBs.MinX[I], AABBs.MaxY[I] - AABBs.MinY[I], AABBs.MaxZ[I] - AABBs.MinZ[I])*0.5f;
+
+        bool Inside = true;
+        for(uint32_t P = 0;
+            P < FRUSTUM_PLANE_COUNT;
+            P++)
+        {
+            // NOTE(georgy): projected radius of the box onto the plane normal
+            float Radius = fabsf(Planes[P].N.x)*Extents.x + fabsf(Planes[P].N.y)*Extents.y + fabsf(Planes[P].N.z)*Extents.z;
+
+            Inside = Inside && (SignedDistance(Planes[P], Center) >= -Radius);
+        }
+
+        Visible[VisibleCount] = I;
+        VisibleCount += Inside;
+    }
+
+    return(VisibleCount);
+}
+
+#if defined(VKL_SIMD_SSE)
+
+// NOTE(georgy): branchless compaction, every lane is written and only the visible ones advance the count
+inline uint32_t
+CompactVisibleSSE(__m128 Inside, uint32_t Base, uint32_t *Visible, uint32_t VisibleCount)
+{
+    uint32_t Mask = uint32_t(_mm_movemask_ps(Inside));
+
+    for(uint32_t Lane = 0;
+        Lane < 4;
+        Lane++)
+    {
+        Visible[VisibleCount] = Base + Lane;
+        VisibleCount += (Mask >> Lane) & 1;
+    }
+
+    return(VisibleCount);
+}
+
+static uint32_t
+CullSpheresSSE(const plane *Planes, const spheres_soa &Spheres, uint32_t Count, uint32_t *Visible)
+{
+    __m128 PlaneX[FRUSTUM_PLANE_COUNT], PlaneY[FRUSTUM_PLANE_COUNT], PlaneZ[FRUSTUM_PLANE_COUNT], PlaneD[FRUSTUM_PLANE_COUNT];
+    for(uint32_t P = 0;
+        P < FRUSTUM_PLANE_COUNT;
+        P++)
+    {
+        PlaneX[P] = _mm_set1_ps(Planes[P].N.x);
+        PlaneY[P] = _mm_set1_ps(Planes[P].N.y);
+        PlaneZ[P] = _mm_set1_ps(Planes[P].N.z);
+        PlaneD[P] = _mm_set1_ps(Planes[P].D);
+    }
+
+    __m128 SignMask = _mm_set1_ps(-0.0f);
+
+    uint32_t VisibleCount = 0;
+
+    uint32_t I = 0;
+    for(;
+        I + 4 <= Count;
+        I += 4)
+    {
+        __m128 X = _mm_loadu_ps(Spheres.X + I), Y = _mm_loadu_ps(Spheres.Y + I), Z = _mm_loadu_ps(Spheres.Z + I);
+        __m128 NegativeRadius = _mm_xor_ps(_mm_loadu_ps(Spheres.Radius + I), SignMask);
+
+        __m128 Inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(uint32_t P = 0;
+            P < FRUSTUM_PLANE_COUNT;
+            P++)
+        {
+            __m128 Distance = SIMD_MADD(PlaneZ[P], Z, SIMD_MADD(PlaneY[P], Y, SIMD_MADD(PlaneX[P], X, PlaneD[P])));
+            Inside = _mm_and_ps(Inside, _mm_cmpge_ps(Distance, NegativeRadius));
+        }
+
+        VisibleCount = CompactVisibleSSE(Inside, I, Visible, VisibleCount);
+    }
+
+    return(VisibleCount + CullSpheresScalar(Planes, Spheres, I, Count, Visible + VisibleCount));
+}
+
+static uint32_t
+CullAABBsSSE(const plane *Planes, const aabbs_soa &AABBs, uint32_t Count, uint32_t *Visible)
+{
+    __m128 PlaneX[FRUSTUM_PLANE_COUNT], PlaneY[FRUSTUM_PLANE_COUNT], PlaneZ[FRUSTUM_PLANE_COUNT], PlaneD[FRUSTUM_PLANE_COUNT];
+    __m128 AbsPlaneX[FRUSTUM_PLANE_COUNT], AbsPlaneY[FRUSTUM_PLANE_COUNT], AbsPlaneZ[FRUSTUM_PLANE_COUNT];
+    for(uint32_t P = 0;
+        P < FRUSTUM_PLANE_COUNT;
+        P++)
+    {
+        PlaneX[P] = _mm_set1_ps(Planes[P].N.x);
+        PlaneY[P] = _mm_set1_ps(Planes[P].N.y);
+        PlaneZ[P] = _mm_set1_ps(Planes[P].N.z);
+        PlaneD[P] = _mm_set1_ps(Planes[P].D);
+        AbsPlaneX[P] = _mm_set1_ps(fabsf(Planes[P].N.x));
+        AbsPlaneY[P] = _mm_set1_ps(fabsf(Planes[P].N.y));
+        AbsPlaneZ[P] = _mm_set1_ps(fabsf(Planes[P].N.z));
+    }
+
+    __m128 Half = _mm_set1_ps(0.5f);
+    __m128 SignMask = _mm_set1_ps(-0.0f);
+
+    uint32_t VisibleCount = 0;
+
+    uint32_t I = 0;
+    for(;
+        I + 4 <= Count;
+        I += 4)
+    {
+        __m128 MinX = _mm_loadu_ps(AABBs.MinX + I), MaxX = _mm_loadu_ps(AABBs.MaxX + I);
+        __m128 MinY = _mm_loadu_ps(AABBs.MinY + I), MaxY = _mm_loadu_ps(AABBs.MaxY + I);
+        __m128 MinZ = _mm_loadu_ps(AABBs.MinZ + I), MaxZ = _mm_loadu_ps(AABBs.MaxZ + I);
+
+        __m128 CX = _mm_mul_ps(_mm_add_ps(MinX, MaxX), Half), EX = _mm_mul_ps(_mm_sub_ps(MaxX, MinX), Half);
+        __m128 CY = _mm_mul_ps(_mm_add_ps(MinY, MaxY), Half), EY = _mm_mul_ps(_mm_sub_ps(MaxY, MinY), Half);
+        __m128 CZ = _mm_mul_ps(_mm_add_ps(MinZ, MaxZ), Half), EZ = _mm_mul_ps(_mm_sub_ps(MaxZ, MinZ), Half);
+
+        __m128 Inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(uint32_t P = 0;
+            P < FRUSTUM_PLANE_COUNT;
+            P++)
+        {
+            __m128 Distance = SIMD_MADD(PlaneZ[P], CZ, SIMD_MADD(PlaneY[P], CY, SIMD_MADD(PlaneX[P], CX, PlaneD[P])));
+            __m128 Radius = SIMD_MADD(AbsPlaneZ[P], EZ, SIMD_MADD(AbsPlaneY[P], EY, _mm_mul_ps(AbsPlaneX[P], EX)));
+            Inside = _mm_and_ps(Inside, _mm_cmpge_ps(Distance, _mm_xor_ps(Radius, SignMask)));
+        }
+
+        VisibleCount = CompactVisibleSSE(Inside, I, Visible, VisibleCount);
+    }
+
+    return(VisibleCount + CullAABBsScalar(Planes, AABBs, I, Count, Visible + VisibleCount));
+}
+
+#endif
+
+#if defined(VKL_SIMD_AVX2)
+
+inline uint32_t
+CompactVisibleAVX2(__m256 Inside, uint32_t Base, uint32_t *Visible, uint32_t VisibleCount)
+{
+    uint32_t Mask = uint32_t(_mm256_movemask_ps(Inside));
+
+    for(uint32_t Lane = 0;
+        Lane < 8;
+        Lane++)
+    {
+        Visible[VisibleCount] = Base + Lane;
+        VisibleCount += (Mask >> Lane) & 1;
+    }
+
+    return(VisibleCount);
+}
+
+static uint32_t
+CullSpheresAVX2(const plane *Planes, const spheres_soa &Spheres, uint32_t Count, uint32_t *Visible)
+{
+    __m256 PlaneX[FRUSTUM_PLANE_COUNT], PlaneY[FRUSTUM_PLANE_COUNT], PlaneZ[FRUSTUM_PLANE_COUNT], PlaneD[FRUSTUM_PLANE_COUNT];
+    for(uint32_t P = 0;
+        P < FRUSTUM_PLANE_COUNT;
+        P++)
+    {
+        PlaneX[P] = _mm256_set1_ps(Planes[P].N.x);
+        PlaneY[P] = _mm256_set1_ps(Planes[P].N.y);
+        PlaneZ[P] = _mm256_set1_ps(Planes[P].N.z);
+        PlaneD[P] = _mm256_set1_ps(Planes[P].D);
+    }
+
+    __m256 SignMask = _mm256_set1_ps(-0.0f);
+
+    uint32_t VisibleCount = 0;
+
+    uint32_t I = 0;
+    for(;
+        I + 8 <= Count;
+        I += 8)
+    {
+        __m256 X = _mm256_loadu_ps(Spheres.X + I), Y = _mm256_loadu_ps(Spheres.Y + I), Z = _mm256_loadu_ps(Spheres.Z + I);
+        __m256 NegativeRadius = _mm256_xor_ps(_mm256_loadu_ps(Spheres.Radius + I), SignMask);
+
+        __m256 Inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(uint32_t P = 0;
+            P < FRUSTUM_PLANE_COUNT;
+            P++)
+        {
+            __m256 Distance = SIMD_MADD256(PlaneZ[P], Z, SIMD_MADD256(PlaneY[P], Y, SIMD_MADD256(PlaneX[P], X, PlaneD[P])));
+            Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(Distance, NegativeRadius, _CMP_GE_OQ));
+        }
+
+        VisibleCount = CompactVisibleAVX2(Inside, I, Visible, VisibleCount);
+    }
+
+    return(VisibleCount + CullSpheresScalar(Planes, Spheres, I, Count, Visible + VisibleCount));
+}
+
+static uint32_t
+CullAABBsAVX2(const plane *Planes, const aabbs_soa &AABBs, uint32_t Count, uint32_t *Visible)
+{
+    __m256 PlaneX[FRUSTUM_PLANE_COUNT], PlaneY[FRUSTUM_PLANE_COUNT], PlaneZ[FRUSTUM_PLANE_COUNT], PlaneD[FRUSTUM_PLANE_COUNT];
+    __m256 AbsPlaneX[FRUSTUM_PLANE_COUNT], AbsPlaneY[FRUSTUM_PLANE_COUNT], AbsPlaneZ[FRUSTUM_PLANE_COUNT];
+    for(uint32_t P = 0;
+        P < FRUSTUM_PLANE_COUNT;
+        P++)
+    {
+        PlaneX[P] = _mm256_set1_ps(Planes[P].N.x);
+        PlaneY[P] = _mm256_set1_ps(Planes[P].N.y);
+        PlaneZ[P] = _mm256_set1_ps(Planes[P].N.z);
+        PlaneD[P] = _mm256_set1_ps(Planes[P].D);
+        AbsPlaneX[P] = _mm256_set1_ps(fabsf(Planes[P].N.x));
+        AbsPlaneY[P] = _mm256_set1_ps(fabsf(Planes[P].N.y));
+        AbsPlaneZ[P] = _mm256_set1_ps(fabsf(Planes[P].N.z));
+    }
+
+    __m256 Half = _mm256_set1_ps(0.5f);
+    __m256 SignMask = _mm256_set1_ps(-0.0f);
+
+    uint32_t VisibleCount = 0;
+
+    uint32_t I = 0;
+    for(;
+        I + 8 <= Count;
+        I += 8)
+    {
+        __m256 MinX = _mm256_loadu_ps(AABBs.MinX + I), MaxX = _mm256_loadu_ps(AABBs.MaxX + I);
+        __m256 MinY = _mm256_loadu_ps(AABBs.MinY + I), MaxY = _mm256_loadu_ps(AABBs.MaxY + I);
+        __m256 MinZ = _mm256_loadu_ps(AABBs.MinZ + I), MaxZ = _mm256_loadu_ps(AABBs.MaxZ + I);
+
+        __m256 CX = _mm256_mul_ps(_mm256_add_ps(MinX, MaxX), Half), EX = _mm256_mul_ps(_mm256_sub_ps(MaxX, MinX), Half);
+        __m256 CY = _mm256_mul_ps(_mm256_add_ps(MinY, MaxY), Half), EY = _mm256_mul_ps(_mm256_sub_ps(MaxY, MinY), Half);
+        __m256 CZ = _mm256_mul_ps(_mm256_add_ps(MinZ, MaxZ), Half), EZ = _mm256_mul_ps(_mm256_sub_ps(MaxZ, MinZ), Half);
+
+        __m256 Inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(uint32_t P = 0;
+            P < FRUSTUM_PLANE_COUNT;
+            P++)
+        {
+            __m256 Distance = SIMD_MADD256(PlaneZ[P], CZ, SIMD_MADD256(PlaneY[P], CY, SIMD_MADD256(PlaneX[P], CX, PlaneD[P])));
+            __m256 Radius = SIMD_MADD256(AbsPlaneZ[P], EZ, SIMD_MADD256(AbsPlaneY[P], EY, _mm256_mul_ps(AbsPlaneX[P], EX)));
+            Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(Distance, _mm256_xor_ps(Radius, SignMask), _CMP_GE_OQ));
+        }
+
+        VisibleCount = CompactVisibleAVX2(Inside, I, Visible, VisibleCount);
+    }
+
+    return(VisibleCount + CullAABBsScalar(Planes, AABBs, I, Count, Visible + VisibleCount));
+}
+
+#endif
+
+inline uint32_t
+CullSpheres(const plane *Planes, const spheres_soa &Spheres, uint32_t Count, uint32_t *Visible)
+{
+#if defined(VKL_SIMD_AVX2)
+    return(CullSpheresAVX2(Planes, Spheres, Count, Visible));
+#elif defined(VKL_SIMD_SSE)
+    return(CullSpheresSSE(Planes, Spheres, Count, Visible));
+#else
+    return(CullSpheresScalar(Planes, Spheres, 0, Count, Visible));
+#endif
+}
+
+inline uint32_t
+CullAABBs(const plane *Planes, const aabbs_soa &AABBs, uint32_t Count, uint32_t *Visible)
+{
+#if defined(VKL_SIMD_AVX2)
+    return(CullAABBsAVX2(Planes, AABBs, Count, Visible));
+#elif defined(VKL_SIMD_SSE)
+    return(CullAABBsSSE(Planes, AABBs, Count, Visible));
+#else
+    return(CullAABBsScalar(Planes, AABBs, 0, Count, Visible));
+#endif
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+//
+// NOTE: Device memory sub-allocator
+//
+// Every memory type gets its own pool of large VkDeviceMemory blocks that are carved up with a buddy allocator,
+// so the number of vkAllocateMemory calls stays far below maxMemoryAllocationCount.
+// Linear (buffers) and optimal (images) resources live in separate pools when bufferImageGranularity > 1,
+// which keeps them from ever sharing a granularity page.
+//
+
+#define MEMORY_BLOCK_SIZE_MAX VkDeviceSize(64 * 1024 * 1024)
+#define MEMORY_BLOCK_SIZE_MIN VkDeviceSize(1 * 1024 * 1024)
+#define MEMORY_ALLOCATION_SIZE_MIN VkDeviceSize(256)
+
+struct MemoryBlock
+{
+    VkDeviceMemory memory;
+    void* data;
+
+    VkDeviceSize usedSize;
+
+    // NOTE: level 0 is the whole block, every next level halves the node size
+    std::vector<std::vector<VkDeviceSize>> freeLists;
+};
+
+struct MemoryPool
+{
+    std::vector<MemoryBlock> blocks;
+    VkDeviceSize blockSize;
+    uint32_t levelCount;
+};
+
+struct Allocation
+{
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void* data;
+
+    uint32_t memoryTypeIndex;
+    uint32_t poolIndex;
+    uint32_t blockIndex; // UINT32_MAX for dedicated allocations
+    uint32_t level;
+};
+
+struct MemoryAllocator
+{
+    VkDevice device;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize bufferImageGranularity;
+    uint32_t maxAllocationCount;
+
+    // NOTE: set on UMA and resizable BAR systems where all of device local memory is also host visible
+    bool hostVisibleDeviceLocal;
+
+    MemoryPool pools[VK_MAX_MEMORY_TYPES][2];
+
+    uint32_t allocationCount;
+    VkDeviceSize requestedSize[VK_MAX_MEMORY_TYPES];
+    uint32_t dedicatedCount[VK_MAX_MEMORY_TYPES];
+    VkDeviceSize dedicatedSize[VK_MAX_MEMORY_TYPES];
+};
+
+uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t memoryTypeBits, VkMemoryPropertyFlags flags)
+{
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        if (((memoryTypeBits & (1 << i)) != 0) && ((memoryProperties.memoryTypes[i].propertyFlags & flags) == flags))
+            return i;
+
+    return UINT32_MAX;
+}
+
+uint32_t selectMemoryType(const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t memoryTypeBits, VkMemoryPropertyFlags flags)
+{
+    uint32_t result = findMemoryType(memoryProperties, memoryTypeBits, flags);
+
+    assert(result != UINT32_MAX && "No compatible memory type found!");
+    return result;
+}
+
+static uint32_t log2Floor(VkDeviceSize value)
+{
+    uint32_t result = 0;
+    while (value > 1)
+    {
+        value >>= 1;
+        result++;
+    }
+
+    return result;
+}
+
+static VkDeviceSize roundUpPow2(VkDeviceSize value)
+{
+    VkDeviceSize result = 1;
+    while (result < value)
+        result <<= 1;
+
+    return result;
+}
+
+void createAllocator(MemoryAllocator& result, VkDevice device, VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+    result.device = device;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &result.memoryProperties);
+    result.bufferImageGranularity = props.limits.bufferImageGranularity;
+    result.maxAllocationCount = props.limits.maxMemoryAllocationCount;
+
+    for (uint32_t i = 0; i < result.memoryProperties.memoryTypeCount; i++)
+    {
+        VkDeviceSize heapSize = result.memoryProperties.memoryHeaps[result.memoryProperties.memoryTypes[i].heapIndex].size;
+
+        // NOTE: small heaps (e.g. 256 MB BAR window) get smaller blocks so a single block can't eat most of them
+        VkDeviceSize blockSize = MEMORY_BLOCK_SIZE_MAX;
+        while ((blockSize > MEMORY_BLOCK_SIZE_MIN) && (blockSize > heapSize / 8))
+            blockSize >>= 1;
+
+        for (uint32_t j = 0; j < 2; j++)
+        {
+            result.pools[i][j].blockSize = blockSize;
+            result.pools[i][j].levelCount = log2Floor(blockSize / MEMORY_ALLOCATION_SIZE_MIN) + 1;
+        }
+
+        result.requestedSize[i] = 0;
+        result.dedicatedCount[i] = 0;
+        result.dedicatedSize[i] = 0;
+    }
+
+    VkDeviceSize deviceLocalHeapSize = 0;
+    VkDeviceSize hostVisibleDeviceLocalHeapSize = 0;
+    for (uint32_t i = 0; i < result.memoryProperties.memoryTypeCount; i++)
+    {
+        VkMemoryPropertyFlags flags = result.memoryProperties.memoryTypes[i].propertyFlags;
+        VkDeviceSize heapSize = result.memoryProperties.memoryHeaps[result.memoryProperties.memoryTypes[i].heapIndex].size;
+
+        if (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+            deviceLocalHeapSize = std::max(deviceLocalHeapSize, heapSize);
+
+        if ((flags & (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) ==
+            (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+            hostVisibleDeviceLocalHeapSize = std::max(hostVisibleDeviceLocalHeapSize, heapSize);
+    }
+
+    // NOTE: the classic 256 MB BAR window is too small to put static geometry in, so it doesn't count
+    result.hostVisibleDeviceLocal = (deviceLocalHeapSize > 0) && (hostVisibleDeviceLocalHeapSize >= deviceLocalHeapSize);
+
+    result.allocationCount = 0;
+}
+
+static VkDeviceMemory allocateDeviceMemory(MemoryAllocator& allocator, uint32_t memoryTypeIndex, VkDeviceSize size, void** data)
+{
+    assert(allocator.allocationCount < allocator.maxAllocationCount);
+
+    VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+    allocateInfo.allocationSize = size;
+    allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VkDeviceMemory memory = 0;
+    VK_CHECK(vkAllocateMemory(allocator.device, &allocateInfo, 0, &memory));
+
+    *data = 0;
+    if (allocator.memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        VK_CHECK(vkMapMemory(allocator.device, memory, 0, size, 0, data));
+
+    allocator.allocationCount++;
+
+    return memory;
+}
+
+static bool allocateFromBlock(MemoryBlock& block, const MemoryPool& pool, uint32_t level, VkDeviceSize* offset)
+{
+    uint32_t freeLevel = level;
+    while (block.freeLists[freeLevel].empty())
+    {
+        if (freeLevel == 0)
+            return false;
+
+        freeLevel--;
+    }
+
+    VkDeviceSize nodeOffset = block.freeLists[freeLevel].back();
+    block.freeLists[freeLevel].pop_back();
+
+    for (; freeLevel < level; freeLevel++)
+        block.freeLists[freeLevel + 1].push_back(nodeOffset + (pool.blockSize >> (freeLevel + 1)));
+
+    block.usedSize += pool.blockSize >> level;
+
+    *offset = nodeOffset;
+    return true;
+}
+
+void allocateMemory(Allocation& result, MemoryAllocator& allocator, const VkMemoryRequirements& requirements, VkMemoryPropertyFlags flags, bool linear,
+                    VkMemoryPropertyFlags preferredFlags = 0)
+{
+    uint32_t memoryTypeIndex = findMemoryType(allocator.memoryProperties, requirements.memoryTypeBits, flags | preferredFlags);
+    if (memoryTypeIndex == UINT32_MAX)
+        memoryTypeIndex = selectMemoryType(allocator.memoryProperties, requirements.memoryTypeBits, flags);
+
+    uint32_t poolIndex = (!linear && (allocator.bufferImageGranularity > 1)) ? 1 : 0;
+    MemoryPool& pool = allocator.pools[memoryTypeIndex][poolIndex];
+
+    result.memoryTypeIndex = memoryTypeIndex;
+    result.poolIndex = poolIndex;
+    result.size = requirements.size;
+
+    allocator.requestedSize[memoryTypeIndex] += requirements.size;
+
+    // NOTE: buddy nodes are aligned to their own size, so rounding up to the alignment covers both
+    VkDeviceSize nodeSize = roundUpPow2(std::max(std::max(requirements.size, requirements.alignment), MEMORY_ALLOCATION_SIZE_MIN));
+
+    if (nodeSize > pool.blockSize / 2)
+    {
+        result.memory = allocateDeviceMemory(allocator, memoryTypeIndex, requirements.size, &result.data);
+        result.offset = 0;
+        result.blockIndex = UINT32_MAX;
+        result.level = 0;
+
+        allocator.dedicatedCount[memoryTypeIndex]++;
+        allocator.dedicatedSize[memoryTypeIndex] += requirements.size;
+        return;
+    }
+
+    uint32_t level = log2Floor(pool.blockSize / nodeSize);
+    assert(level < pool.levelCount);
+
+    VkDeviceSize offset = 0;
+    uint32_t blockIndex = 0;
+    for (; blockIndex < pool.blocks.size(); blockIndex++)
+        if (allocateFromBlock(pool.blocks[blockIndex], pool, level, &offset))
+            break;
+
+    if (blockIndex == pool.blocks.size())
+    {
+        MemoryBlock block = {};
+        block.memory = allocateDeviceMemory(allocator, memoryTypeIndex, pool.blockSize, &block.data);
+        block.usedSize = 0;
+        block.freeLists.resize(pool.levelCount);
+        block.freeLists[0].push_back(0);
+
+        pool.blocks.push_back(block);
+
+        bool allocated = allocateFromBlock(pool.blocks[blockIndex], pool, level, &offset);
+        assert(allocated);
+    }
+
+    MemoryBlock& block = pool.blocks[blockIndex];
+
+    result.memory = block.memory;
+    result.offset = offset;
+    result.data = block.data ? static_cast<char*>(block.data) + offset : 0;
+    result.blockIndex = blockIndex;
+    result.level = level;
+}
+
+void freeMemory(MemoryAllocator& allocator, const Allocation& allocation)
+{
+    allocator.requestedSize[allocation.memoryTypeIndex] -= allocation.size;
+
+    if (allocation.blockIndex == UINT32_MAX)
+    {
+        vkFreeMemory(allocator.device, allocation.memory, 0);
+        allocator.allocationCount--;
+
+        allocator.dedicatedCount[allocation.memoryTypeIndex]--;
+        allocator.dedicatedSize[allocation.memoryTypeIndex] -= allocation.size;
+        return;
+    }
+
+    MemoryPool& pool = allocator.pools[allocation.memoryTypeIndex][allocation.poolIndex];
+    MemoryBlock& block = pool.blocks[allocation.blockIndex];
+
+    block.usedSize -= pool.blockSize >> allocation.level;
+
+    // NOTE: merge with the buddy for as long as it is free as well
+    VkDeviceSize offset = allocation.offset;
+    uint32_t level = allocation.level;
+    while (level > 0)
+    {
+        VkDeviceSize buddy = offset ^ (pool.blockSize >> level);
+
+        std::vector<VkDeviceSize>& freeList = block.freeLists[level];
+        std::vector<VkDeviceSize>::iterator it = std::find(freeList.begin(), freeList.end(), buddy);
+        if (it == freeList.end())
+            break;
+
+        *it = freeList.back();
+        freeList.pop_back();
+
+        offset = std::min(offset, buddy);
+        level--;
+    }
+
+    block.freeLists[level].push_back(offset);
+}
+
+void destroyAllocator(MemoryAllocator& allocator)
+{
+    for (uint32_t i = 0; i < allocator.memoryProperties.memoryTypeCount; i++)
+    {
+        assert(allocator.dedicatedCount[i] == 0);
+
+        for (uint32_t j = 0; j < 2; j++)
+        {
+            for (MemoryBlock& block : allocator.pools[i][j].blocks)
+            {
+                assert(block.usedSize == 0);
+                vkFreeMemory(allocator.device, block.memory, 0);
+            }
+
+            allocator.pools[i][j].blocks.clear();
+        }
+    }
+
+    allocator.allocationCount = 0;
+}
+
+void printMemoryStats(const MemoryAllocator& allocator)
+{
+    printf("Device memory: %u of %u allocations\n", allocator.allocationCount, allocator.maxAllocationCount);
+
+    for (uint32_t heapIndex = 0; heapIndex < allocator.memoryProperties.memoryHeapCount; heapIndex++)
+    {
+        uint32_t blockCount = 0;
+        VkDeviceSize blockSize = 0;
+        VkDeviceSize usedSize = 0;
+        VkDeviceSize requestedSize = 0;
+        VkDeviceSize largestFree = 0;
+        uint32_t dedicatedCount = 0;
+        VkDeviceSize dedicatedSize = 0;
+
+        for (uint32_t i = 0; i < allocator.memoryProperties.memoryTypeCount; i++)
+        {
+            if (allocator.memoryProperties.memoryTypes[i].heapIndex != heapIndex)
+                continue;
+
+            requestedSize += allocator.requestedSize[i];
+            dedicatedCount += allocator.dedicatedCount[i];
+            dedicatedSize += allocator.dedicatedSize[i];
+
+            for (uint32_t j = 0; j < 2; j++)
+            {
+                const MemoryPool& pool = allocator.pools[i][j];
+
+                for (const MemoryBlock& block : pool.blocks)
+                {
+                    blockCount++;
+                    blockSize += pool.blockSize;
+                    usedSize += block.usedSize;
+
+                    for (uint32_t level = 0; level < pool.levelCount; level++)
+                        if (!block.freeLists[level].empty())
+                        {
+                            largestFree = std::max(largestFree, pool.blockSize >> level);
+                            break;
+                        }
+                }
+            }
+        }
+
+        VkDeviceSize freeSize = blockSize - usedSize;
+
+        // NOTE: internal - lost to power of two rounding, external - how much of the free space can't be used by one allocation
+        double internalFragmentation = usedSize ? 1.0 - double(requestedSize - dedicatedSize) / double(usedSize) : 0.0;
+        double externalFragmentation = freeSize ? 1.0 - double(largestFree) / double(freeSize) : 0.0;
+
+        printf("Heap %u (%s, %.1f MB): %u blocks, %.2f MB used, %.2f MB free, fragmentation %.1f%% internal %.1f%% external; %u dedicated (%.2f MB)\n",
+               heapIndex, (allocator.memoryProperties.memoryHeaps[heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "device local" : "host",
+               double(allocator.memoryProperties.memoryHeaps[heapIndex].size) / (1024 * 1024), blockCount,
+               double(usedSize) / (1024 * 1024), double(freeSize) / (1024 * 1024),
+               internalFragmentation * 100.0, externalFragmentation * 100.0, dedicatedCount, double(dedicatedSize) / (1024 * 1024));
+    }
+}
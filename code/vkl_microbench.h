@@ -0,0 +1,571 @@
+#pragma once
+
+//
+// NOTE: Math micro-benchmarks (-microbench)
+//
+// Runs every vkl_math.h kernel over a working set of random inputs that fits in L1/L2 and compares
+// the SIMD version against its scalar reference: nanoseconds per operation and the largest difference in the results.
+// The batched SoA transforms are reported as throughput instead, for every variant the build has compiled in.
+// The job system is measured with fine grained jobs of a fixed amount of work: the overhead column is the worker time
+// per job that went to scheduling instead of work, compared to running the same jobs in a loop on one thread.
+//
+
+#define MICROBENCH_COUNT 1024
+#define MICROBENCH_ROUNDS 2000
+
+// NOTE: batched kernels run over a working set larger than L2, closer to a real scene's instance data
+#define MICROBENCH_BATCH_COUNT (64 * 1024)
+#define MICROBENCH_BATCH_ROUNDS 20
+
+#define MICROBENCH_CULL_COUNT (200 * 1024)
+
+// NOTE: all of them fit in the submitting worker's deque
+#define MICROBENCH_JOB_COUNT 4096
+
+static volatile float microbenchSink;
+
+static double microbenchTimeMs()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static float microbenchRandom(uint32_t& state)
+{
+    // NOTE: xorshift32, deterministic so runs are comparable
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return float(state & 0xffffff) / float(0xffffff) * 2.0f - 1.0f;
+}
+
+// NOTE: best of a few runs, reported in ns per call of kernel(i)
+template <typename Kernel>
+static double microbenchMeasure(size_t count, Kernel kernel)
+{
+    double best = DBL_MAX;
+
+    for (int run = 0; run < 5; run++)
+    {
+        double begin = microbenchTimeMs();
+
+        for (int round = 0; round < MICROBENCH_ROUNDS / 5; round++)
+            for (size_t i = 0; i < count; i++)
+                kernel(i);
+
+        double timeNs = (microbenchTimeMs() - begin) * 1e6 / (double(MICROBENCH_ROUNDS / 5) * count);
+        best = std::min(best, timeNs);
+    }
+
+    return best;
+}
+
+static float microbenchMaxError(const float* a, const float* b, size_t count)
+{
+    float result = 0.0f;
+
+    for (size_t i = 0; i < count; i++)
+        result = std::max(result, fabsf(a[i] - b[i]) / std::max(1.0f, fabsf(b[i])));
+
+    return result;
+}
+
+static void microbenchReport(const char* name, double scalarNs, double simdNs, float maxError)
+{
+    printf("%-24s %10.2f %10.2f %8.2fx %12.3g\n", name, scalarNs, simdNs, scalarNs / simdNs, maxError);
+}
+
+static void runMatrixMicrobenchmarks()
+{
+    uint32_t seed = 0x12345678;
+
+    std::vector<mat4> a(MICROBENCH_COUNT), b(MICROBENCH_COUNT);
+    std::vector<vec4> v(MICROBENCH_COUNT);
+
+    for (size_t i = 0; i < MICROBENCH_COUNT; i++)
+    {
+        for (int e = 0; e < 16; e++)
+        {
+            a[i].E[e] = microbenchRandom(seed);
+            b[i].E[e] = microbenchRandom(seed);
+        }
+
+        // NOTE: diagonally dominant, so every matrix is comfortably invertible
+        a[i].a11 += 4.0f; a[i].a22 += 4.0f; a[i].a33 += 4.0f; a[i].a44 += 4.0f;
+
+        v[i] = vec4(microbenchRandom(seed), microbenchRandom(seed), microbenchRandom(seed), 1.0f);
+    }
+
+    std::vector<mat4> scalarM(MICROBENCH_COUNT), simdM(MICROBENCH_COUNT);
+    std::vector<vec4> scalarV(MICROBENCH_COUNT), simdV(MICROBENCH_COUNT);
+
+    double scalarNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { scalarM[i] = MultiplyScalar(a[i], b[i]); });
+    double simdNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { simdM[i] = a[i] * b[i]; });
+    microbenchReport("mat4 * mat4", scalarNs, simdNs, microbenchMaxError((const float*)simdM.data(), (const float*)scalarM.data(), MICROBENCH_COUNT * 16));
+
+    scalarNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { scalarV[i] = TransformScalar(a[i], v[i]); });
+    simdNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { simdV[i] = a[i] * v[i]; });
+    microbenchReport("mat4 * vec4", scalarNs, simdNs, microbenchMaxError((const float*)simdV.data(), (const float*)scalarV.data(), MICROBENCH_COUNT * 4));
+
+    scalarNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { scalarM[i] = TransposeScalar(a[i]); });
+    simdNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { simdM[i] = Transpose(a[i]); });
+    microbenchReport("Transpose", scalarNs, simdNs, microbenchMaxError((const float*)simdM.data(), (const float*)scalarM.data(), MICROBENCH_COUNT * 16));
+
+    scalarNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { scalarM[i] = InverseScalar(a[i]); });
+    simdNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { simdM[i] = Inverse(a[i]); });
+    microbenchReport("Inverse", scalarNs, simdNs, microbenchMaxError((const float*)simdM.data(), (const float*)scalarM.data(), MICROBENCH_COUNT * 16));
+
+    microbenchSink = scalarM[MICROBENCH_COUNT / 2].E[5] + simdM[MICROBENCH_COUNT / 3].E[7] + scalarV[1].x + simdV[2].y;
+}
+
+// NOTE: Gauss-Jordan with partial pivoting in double, the reference the float inverses are checked against
+static void inverseReference(double* result, const float* m)
+{
+    double a[4][8];
+
+    for (int row = 0; row < 4; row++)
+        for (int column = 0; column < 4; column++)
+        {
+            a[row][column] = m[row + column * 4];
+            a[row][column + 4] = (row == column) ? 1.0 : 0.0;
+        }
+
+    for (int column = 0; column < 4; column++)
+    {
+        int pivot = column;
+        for (int row = column + 1; row < 4; row++)
+            if (fabs(a[row][column]) > fabs(a[pivot][column]))
+                pivot = row;
+
+        for (int k = 0; k < 8; k++)
+            std::swap(a[column][k], a[pivot][k]);
+
+        double scale = 1.0 / a[column][column];
+        for (int k = 0; k < 8; k++)
+            a[column][k] *= scale;
+
+        for (int row = 0; row < 4; row++)
+        {
+            if (row == column)
+                continue;
+
+            double factor = a[row][column];
+            for (int k = 0; k < 8; k++)
+                a[row][k] -= factor * a[column][k];
+        }
+    }
+
+    for (int row = 0; row < 4; row++)
+        for (int column = 0; column < 4; column++)
+            result[row + column * 4] = a[row][column + 4];
+}
+
+// NOTE: largest error relative to the largest element of the reference inverse, so near-zero elements don't dominate
+static float microbenchInverseError(const mat4* inverses, const std::vector<double>& reference, size_t count)
+{
+    float result = 0.0f;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const double* expected = &reference[i * 16];
+
+        double norm = 0.0;
+        for (int e = 0; e < 16; e++)
+            norm = std::max(norm, fabs(expected[e]));
+
+        for (int e = 0; e < 16; e++)
+            result = std::max(result, float(fabs(double(inverses[i].E[e]) - expected[e]) / norm));
+    }
+
+    return result;
+}
+
+static void runInverseMicrobenchmarks()
+{
+    uint32_t seed = 0x2545f491;
+
+    // NOTE: rotation times non-uniform scale plus translation, i.e. typical object and camera transforms
+    std::vector<mat4> affine(MICROBENCH_COUNT);
+
+    for (size_t i = 0; i < MICROBENCH_COUNT; i++)
+    {
+        vec3 axis = Normalize(vec3(microbenchRandom(seed), microbenchRandom(seed), microbenchRandom(seed) + 2.0f));
+        float angle = microbenchRandom(seed) * 180.0f;
+        vec3 scale = vec3(1.5f + microbenchRandom(seed), 1.5f + microbenchRandom(seed), 1.5f + microbenchRandom(seed));
+
+        affine[i] = Translation(vec3(microbenchRandom(seed), microbenchRandom(seed), microbenchRandom(seed)) * 100.0f) * Rotation(angle, axis) * Scaling(scale);
+    }
+
+    std::vector<double> reference(MICROBENCH_COUNT * 16);
+    for (size_t i = 0; i < MICROBENCH_COUNT; i++)
+        inverseReference(&reference[i * 16], affine[i].E);
+
+    std::vector<mat4> scalarM(MICROBENCH_COUNT), simdM(MICROBENCH_COUNT), fullM(MICROBENCH_COUNT);
+    std::vector<mat3> normalM(MICROBENCH_COUNT);
+
+    double scalarNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { scalarM[i] = InverseAffineScalar(affine[i]); });
+    double simdNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { simdM[i] = InverseAffine(affine[i]); });
+    microbenchReport("InverseAffine", scalarNs, simdNs, microbenchMaxError((const float*)simdM.data(), (const float*)scalarM.data(), MICROBENCH_COUNT * 16));
+
+    // NOTE: what the fast path saves over the general inverse on the same input
+    double fullNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { fullM[i] = Inverse(affine[i]); });
+    microbenchReport("Inverse -> InverseAffine", fullNs, simdNs, microbenchMaxError((const float*)simdM.data(), (const float*)fullM.data(), MICROBENCH_COUNT * 16));
+
+    // NOTE: against inverting and transposing the upper 3x3 by hand
+    std::vector<mat3> adHocM(MICROBENCH_COUNT);
+
+    scalarNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { adHocM[i] = Transpose3x3(Inverse3x3(ToMat3(affine[i]))); });
+    simdNs = microbenchMeasure(MICROBENCH_COUNT, [&](size_t i) { normalM[i] = NormalMatrix(affine[i]); });
+    microbenchReport("Inverse3x3 -> NormalMat", scalarNs, simdNs, microbenchMaxError((const float*)normalM.data(), (const float*)adHocM.data(), MICROBENCH_COUNT * 9));
+
+    printf("\nAccuracy against a double precision inverse, affine inputs\n");
+    printf("%-24s %12s\n", "kernel", "max rel err");
+
+    for (size_t i = 0; i < MICROBENCH_COUNT; i++)
+        scalarM[i] = InverseScalar(affine[i]);
+    printf("%-24s %12.3g\n", "InverseScalar", microbenchInverseError(scalarM.data(), reference, MICROBENCH_COUNT));
+    printf("%-24s %12.3g\n", "Inverse", microbenchInverseError(fullM.data(), reference, MICROBENCH_COUNT));
+
+    for (size_t i = 0; i < MICROBENCH_COUNT; i++)
+        scalarM[i] = InverseAffineScalar(affine[i]);
+    printf("%-24s %12.3g\n", "InverseAffineScalar", microbenchInverseError(scalarM.data(), reference, MICROBENCH_COUNT));
+    printf("%-24s %12.3g\n", "InverseAffine", microbenchInverseError(simdM.data(), reference, MICROBENCH_COUNT));
+
+    // NOTE: the normal matrix is the transposed upper 3x3 of the inverse
+    for (size_t i = 0; i < MICROBENCH_COUNT; i++)
+    {
+        mat3 normal = Transpose3x3(normalM[i]);
+        scalarM[i] = Mat4(normal);
+        scalarM[i].a14 = simdM[i].a14;
+        scalarM[i].a24 = simdM[i].a24;
+        scalarM[i].a34 = simdM[i].a34;
+    }
+    printf("%-24s %12.3g\n", "NormalMatrix", microbenchInverseError(scalarM.data(), reference, MICROBENCH_COUNT));
+
+    microbenchSink = scalarM[MICROBENCH_COUNT / 2].E[5] + simdM[MICROBENCH_COUNT / 3].E[7] + fullM[1].E[3] + adHocM[2].E[4];
+}
+
+// NOTE: best of a few runs over the whole batch, reported in millions of elements per second
+template <typename Kernel>
+static double microbenchThroughput(size_t count, Kernel kernel)
+{
+    double best = DBL_MAX;
+
+    for (int run = 0; run < 5; run++)
+    {
+        double begin = microbenchTimeMs();
+
+        for (int round = 0; round < MICROBENCH_BATCH_ROUNDS; round++)
+            kernel();
+
+        best = std::min(best, microbenchTimeMs() - begin);
+    }
+
+    return double(count) * MICROBENCH_BATCH_ROUNDS / (best * 1e3);
+}
+
+static void microbenchReportThroughput(const char* name, double scalarRate, double sseRate, double avx2Rate, float maxError)
+{
+    printf("%-24s %10.1f ", name, scalarRate);
+
+    if (sseRate > 0.0)
+        printf("%10.1f ", sseRate);
+    else
+        printf("%10s ", "-");
+
+    if (avx2Rate > 0.0)
+        printf("%10.1f ", avx2Rate);
+    else
+        printf("%10s ", "-");
+
+    printf("%12.3g\n", maxError);
+}
+
+static void runBatchMicrobenchmarks()
+{
+    uint32_t seed = 0x9e3779b9;
+
+    // NOTE: one array per component, like the instance data the kernels are meant for
+    std::vector<float> transforms(16 * MICROBENCH_BATCH_COUNT);
+    std::vector<float> input(6 * MICROBENCH_BATCH_COUNT);
+    std::vector<float> scalarOutput(6 * MICROBENCH_BATCH_COUNT), simdOutput(6 * MICROBENCH_BATCH_COUNT);
+
+    for (size_t i = 0; i < transforms.size(); i++)
+        transforms[i] = microbenchRandom(seed);
+
+    for (size_t i = 0; i < input.size(); i++)
+        input[i] = microbenchRandom(seed);
+
+    // NOTE: keep min <= max and the radius positive
+    for (size_t i = 0; i < 3 * MICROBENCH_BATCH_COUNT; i++)
+        input[3 * MICROBENCH_BATCH_COUNT + i] = input[i] + fabsf(input[3 * MICROBENCH_BATCH_COUNT + i]);
+
+    mat4_soa m;
+    for (int e = 0; e < 16; e++)
+        m.E[e] = &transforms[e * MICROBENCH_BATCH_COUNT];
+
+    float* in[6];
+    float* scalarOut[6];
+    float* simdOut[6];
+
+    for (int c = 0; c < 6; c++)
+    {
+        in[c] = &input[c * MICROBENCH_BATCH_COUNT];
+        scalarOut[c] = &scalarOutput[c * MICROBENCH_BATCH_COUNT];
+        simdOut[c] = &simdOutput[c * MICROBENCH_BATCH_COUNT];
+    }
+
+    points_soa pointsIn = { in[0], in[1], in[2] };
+    points_soa pointsScalar = { scalarOut[0], scalarOut[1], scalarOut[2] };
+    points_soa pointsSimd = { simdOut[0], simdOut[1], simdOut[2] };
+
+    spheres_soa spheresIn = { in[0], in[1], in[2], in[3] };
+    spheres_soa spheresScalar = { scalarOut[0], scalarOut[1], scalarOut[2], scalarOut[3] };
+    spheres_soa spheresSimd = { simdOut[0], simdOut[1], simdOut[2], simdOut[3] };
+
+    aabbs_soa aabbsIn = { in[0], in[1], in[2], in[3], in[4], in[5] };
+    aabbs_soa aabbsScalar = { scalarOut[0], scalarOut[1], scalarOut[2], scalarOut[3], scalarOut[4], scalarOut[5] };
+    aabbs_soa aabbsSimd = { simdOut[0], simdOut[1], simdOut[2], simdOut[3], simdOut[4], simdOut[5] };
+
+    uint32_t count = MICROBENCH_BATCH_COUNT;
+
+    double scalarRate = 0.0, sseRate = 0.0, avx2Rate = 0.0;
+
+    // NOTE: the error column compares the widest compiled variant against the scalar one
+    scalarRate = microbenchThroughput(count, [&]() { TransformPointsScalar(m, pointsIn, pointsScalar, 0, count); });
+#if defined(VKL_SIMD_SSE)
+    sseRate = microbenchThroughput(count, [&]() { TransformPointsSSE(m, pointsIn, pointsSimd, count); });
+#endif
+#if defined(VKL_SIMD_AVX2)
+    avx2Rate = microbenchThroughput(count, [&]() { TransformPointsAVX2(m, pointsIn, pointsSimd, count); });
+#endif
+    TransformPoints(m, pointsIn, pointsSimd, count);
+    microbenchReportThroughput("TransformPoints", scalarRate, sseRate, avx2Rate, microbenchMaxError(simdOutput.data(), scalarOutput.data(), 3 * count));
+
+    scalarRate = microbenchThroughput(count, [&]() { TransformSpheresScalar(m, spheresIn, spheresScalar, 0, count); });
+#if defined(VKL_SIMD_SSE)
+    sseRate = microbenchThroughput(count, [&]() { TransformSpheresSSE(m, spheresIn, spheresSimd, count); });
+#endif
+#if defined(VKL_SIMD_AVX2)
+    avx2Rate = microbenchThroughput(count, [&]() { TransformSpheresAVX2(m, spheresIn, spheresSimd, count); });
+#endif
+    TransformSpheres(m, spheresIn, spheresSimd, count);
+    microbenchReportThroughput("TransformSpheres", scalarRate, sseRate, avx2Rate, microbenchMaxError(simdOutput.data(), scalarOutput.data(), 4 * count));
+
+    scalarRate = microbenchThroughput(count, [&]() { TransformAABBsScalar(m, aabbsIn, aabbsScalar, 0, count); });
+#if defined(VKL_SIMD_SSE)
+    sseRate = microbenchThroughput(count, [&]() { TransformAABBsSSE(m, aabbsIn, aabbsSimd, count); });
+#endif
+#if defined(VKL_SIMD_AVX2)
+    avx2Rate = microbenchThroughput(count, [&]() { TransformAABBsAVX2(m, aabbsIn, aabbsSimd, count); });
+#endif
+    TransformAABBs(m, aabbsIn, aabbsSimd, count);
+    microbenchReportThroughput("TransformAABBs", scalarRate, sseRate, avx2Rate, microbenchMaxError(simdOutput.data(), scalarOutput.data(), 6 * count));
+
+    microbenchSink = scalarOutput[count / 2] + simdOutput[count / 3];
+}
+
+// NOTE: best of a few runs of a whole cull, in ms; returns the number of visible objects in *visibleCount
+template <typename Kernel>
+static double microbenchCull(uint32_t* visibleCount, Kernel kernel)
+{
+    double best = DBL_MAX;
+
+    for (int run = 0; run < 5 * MICROBENCH_BATCH_ROUNDS; run++)
+    {
+        double begin = microbenchTimeMs();
+        *visibleCount = kernel();
+        best = std::min(best, microbenchTimeMs() - begin);
+    }
+
+    return best;
+}
+
+static void microbenchReportCull(const char* name, double scalarMs, double sseMs, double avx2Ms, bool match)
+{
+    printf("%-24s %10.3f ", name, scalarMs);
+
+    if (sseMs > 0.0)
+        printf("%10.3f ", sseMs);
+    else
+        printf("%10s ", "-");
+
+    if (avx2Ms > 0.0)
+        printf("%10.3f ", avx2Ms);
+    else
+        printf("%10s ", "-");
+
+    printf("%12s\n", match ? "yes" : "NO");
+}
+
+static void runCullingMicrobenchmarks()
+{
+    uint32_t seed = 0x1b873593;
+
+    // NOTE: camera in the middle of a field of objects, only a small part of them is visible
+    std::vector<float> spheres(4 * MICROBENCH_CULL_COUNT);
+    std::vector<float> aabbs(6 * MICROBENCH_CULL_COUNT);
+
+    for (size_t i = 0; i < MICROBENCH_CULL_COUNT; i++)
+    {
+        float x = microbenchRandom(seed) * 500.0f, y = microbenchRandom(seed) * 500.0f, z = microbenchRandom(seed) * 500.0f;
+        float radius = 1.0f + fabsf(microbenchRandom(seed));
+
+        spheres[0 * MICROBENCH_CULL_COUNT + i] = x;
+        spheres[1 * MICROBENCH_CULL_COUNT + i] = y;
+        spheres[2 * MICROBENCH_CULL_COUNT + i] = z;
+        spheres[3 * MICROBENCH_CULL_COUNT + i] = radius;
+
+        aabbs[0 * MICROBENCH_CULL_COUNT + i] = x - radius;
+        aabbs[1 * MICROBENCH_CULL_COUNT + i] = y - radius;
+        aabbs[2 * MICROBENCH_CULL_COUNT + i] = z - radius;
+        aabbs[3 * MICROBENCH_CULL_COUNT + i] = x + radius;
+        aabbs[4 * MICROBENCH_CULL_COUNT + i] = y + radius;
+        aabbs[5 * MICROBENCH_CULL_COUNT + i] = z + radius;
+    }
+
+    spheres_soa spheresSoA = { &spheres[0], &spheres[MICROBENCH_CULL_COUNT], &spheres[2 * MICROBENCH_CULL_COUNT], &spheres[3 * MICROBENCH_CULL_COUNT] };
+    aabbs_soa aabbsSoA = { &aabbs[0], &aabbs[MICROBENCH_CULL_COUNT], &aabbs[2 * MICROBENCH_CULL_COUNT],
+                           &aabbs[3 * MICROBENCH_CULL_COUNT], &aabbs[4 * MICROBENCH_CULL_COUNT], &aabbs[5 * MICROBENCH_CULL_COUNT] };
+
+    mat4 viewProjection = PerspectiveVk(70.0f, 16.0f / 9.0f, 0.1f, 400.0f) * LookAt(vec3(0.0f, 0.0f, 0.0f), vec3(1.0f, 0.2f, -0.5f));
+
+    plane planes[FRUSTUM_PLANE_COUNT];
+    ExtractFrustumPlanes(planes, viewProjection);
+
+    std::vector<uint32_t> scalarVisible(MICROBENCH_CULL_COUNT), simdVisible(MICROBENCH_CULL_COUNT);
+    uint32_t count = MICROBENCH_CULL_COUNT;
+
+    uint32_t scalarCount = 0, simdCount = 0;
+    double scalarMs = 0.0, sseMs = 0.0, avx2Ms = 0.0;
+
+    scalarMs = microbenchCull(&scalarCount, [&]() { return CullSpheresScalar(planes, spheresSoA, 0, count, scalarVisible.data()); });
+#if defined(VKL_SIMD_SSE)
+    sseMs = microbenchCull(&simdCount, [&]() { return CullSpheresSSE(planes, spheresSoA, count, simdVisible.data()); });
+#endif
+#if defined(VKL_SIMD_AVX2)
+    avx2Ms = microbenchCull(&simdCount, [&]() { return CullSpheresAVX2(planes, spheresSoA, count, simdVisible.data()); });
+#endif
+    simdCount = CullSpheres(planes, spheresSoA, count, simdVisible.data());
+    microbenchReportCull("CullSpheres", scalarMs, sseMs, avx2Ms,
+                         (simdCount == scalarCount) && std::equal(simdVisible.begin(), simdVisible.begin() + simdCount, scalarVisible.begin()));
+
+    scalarMs = microbenchCull(&scalarCount, [&]() { return CullAABBsScalar(planes, aabbsSoA, 0, count, scalarVisible.data()); });
+#if defined(VKL_SIMD_SSE)
+    sseMs = microbenchCull(&simdCount, [&]() { return CullAABBsSSE(planes, aabbsSoA, count, simdVisible.data()); });
+#endif
+#if defined(VKL_SIMD_AVX2)
+    avx2Ms = microbenchCull(&simdCount, [&]() { return CullAABBsAVX2(planes, aabbsSoA, count, simdVisible.data()); });
+#endif
+    simdCount = CullAABBs(planes, aabbsSoA, count, simdVisible.data());
+    microbenchReportCull("CullAABBs", scalarMs, sseMs, avx2Ms,
+                         (simdCount == scalarCount) && std::equal(simdVisible.begin(), simdVisible.begin() + simdCount, scalarVisible.begin()));
+
+    printf("%u of %u objects visible\n", scalarCount, count);
+}
+
+// NOTE: xorshift32 steps, a dependent chain the compiler can't shorten
+static uint32_t microbenchSpin(uint32_t iterations, uint32_t state)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+    }
+
+    return state;
+}
+
+struct MicrobenchJobData
+{
+    uint32_t iterations;
+    uint32_t* results;
+};
+
+static void microbenchJob(void* data, uint32_t begin, uint32_t end)
+{
+    MicrobenchJobData& job = *(MicrobenchJobData*)data;
+
+    for (uint32_t i = begin; i < end; i++)
+        job.results[i] = microbenchSpin(job.iterations, i + 1);
+}
+
+static void runJobMicrobenchmarks(JobSystem& jobSystem)
+{
+    uint32_t workerCount = getJobWorkerCount(jobSystem);
+
+    double calibrationBegin = microbenchTimeMs();
+    uint32_t calibrationState = microbenchSpin(1 << 24, 1);
+    double iterationsPerUs = double(1 << 24) / ((microbenchTimeMs() - calibrationBegin) * 1e3);
+
+    std::vector<uint32_t> results(MICROBENCH_JOB_COUNT);
+
+    const double jobTimesUs[] = { 0.0, 1.0, 2.0, 5.0, 10.0 };
+
+    for (size_t t = 0; t < sizeof(jobTimesUs) / sizeof(jobTimesUs[0]); t++)
+    {
+        MicrobenchJobData data = { uint32_t(jobTimesUs[t] * iterationsPerUs), results.data() };
+
+        double serialMs = DBL_MAX;
+        double parallelMs = DBL_MAX;
+
+        for (int run = 0; run < 5; run++)
+        {
+            double begin = microbenchTimeMs();
+            microbenchJob(&data, 0, MICROBENCH_JOB_COUNT);
+            serialMs = std::min(serialMs, microbenchTimeMs() - begin);
+        }
+
+        JobStats statsBegin = getJobStats(jobSystem);
+
+        for (int run = 0; run < 5; run++)
+        {
+            double begin = microbenchTimeMs();
+            parallelFor(jobSystem, MICROBENCH_JOB_COUNT, 1, microbenchJob, &data, "microbenchJob");
+            parallelMs = std::min(parallelMs, microbenchTimeMs() - begin);
+        }
+
+        JobStats statsEnd = getJobStats(jobSystem);
+
+        // NOTE: worker time that didn't go to the work itself, spread over the jobs
+        double overheadNs = std::max(parallelMs * workerCount - serialMs, 0.0) * 1e6 / MICROBENCH_JOB_COUNT;
+        double speedup = serialMs / parallelMs;
+
+        printf("%-24.1f %10.3f %10.3f %8.2fx %10.0f %10.1f\n", jobTimesUs[t], serialMs, parallelMs, speedup, overheadNs,
+               double(statsEnd.stealCount - statsBegin.stealCount) / 5.0);
+    }
+
+    microbenchSink = float(calibrationState & 0xff) + float(results[MICROBENCH_JOB_COUNT / 2] & 0xff);
+}
+
+void runMicrobenchmarks()
+{
+    printf("Math micro-benchmarks, SIMD backend: %s\n", VKL_SIMD_NAME);
+    printf("%-24s %10s %10s %9s %12s\n", "kernel", "scalar ns", "simd ns", "speedup", "max rel err");
+
+    runMatrixMicrobenchmarks();
+    runInverseMicrobenchmarks();
+
+    printf("\nBatched SoA transforms, %u elements\n", MICROBENCH_BATCH_COUNT);
+    printf("%-24s %10s %10s %10s %12s\n", "kernel", "scalar M/s", "SSE M/s", "AVX2 M/s", "max rel err");
+
+    runBatchMicrobenchmarks();
+
+    printf("\nFrustum culling, %u objects\n", MICROBENCH_CULL_COUNT);
+    printf("%-24s %10s %10s %10s %12s\n", "kernel", "scalar ms", "SSE ms", "AVX2 ms", "same result");
+
+    runCullingMicrobenchmarks();
+
+    // NOTE: the main thread is worker 0 like it is when rendering
+    JobSystem jobSystem;
+    createJobSystem(jobSystem, std::max(1u, std::thread::hardware_concurrency()));
+
+    printf("\nJob system, %u jobs per parallelFor, %u workers\n", MICROBENCH_JOB_COUNT, getJobWorkerCount(jobSystem));
+    printf("%-24s %10s %10s %9s %10s %10s\n", "job us", "serial ms", "jobs ms", "speedup", "ovh ns/job", "steals");
+
+    runJobMicrobenchmarks(jobSystem);
+
+    destroyJobSystem(jobSystem);
+}
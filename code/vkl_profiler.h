@@ -0,0 +1,448 @@
+#pragma once
+
+//
+// NOTE: GPU profiler
+//
+// Every frame in flight owns a timestamp query pool. The frame is bracketed by two timestamps and any number of
+// named (nestable) scopes can be placed inside it. Results are read back when the frame slot comes around again,
+// after its fence has been waited on, so reading them never stalls the CPU.
+// Per-scope min/avg/max are accumulated over the whole run for the breakdown.
+// Work the frame submits to the async compute queue is timed with top level scopes in a second query pool per frame.
+// With a GPU trace enabled every resolved scope is also kept, writeGpuTrace writes them as Chrome trace JSON.
+//
+
+#define GPU_PROFILER_MAX_SCOPES 64
+#define GPU_PROFILER_QUERY_COUNT (2 + 2 * GPU_PROFILER_MAX_SCOPES)
+
+#define GPU_PROFILER_TRACE_SIZE (256 * 1024)
+
+enum GpuQueue
+{
+    GPU_QUEUE_GRAPHICS,
+    GPU_QUEUE_COMPUTE,
+
+    GPU_QUEUE_COUNT
+};
+
+struct GpuScope
+{
+    const char* name;
+    uint32_t depth;
+    GpuQueue queue;
+
+    uint32_t beginQuery;
+    uint32_t endQuery;
+};
+
+struct GpuProfilerFrame
+{
+    VkQueryPool queryPools[GPU_QUEUE_COUNT];
+    uint32_t queryCounts[GPU_QUEUE_COUNT];
+
+    std::vector<GpuScope> scopes;
+
+    uint64_t frameIndex;
+    bool pending;
+};
+
+struct GpuTraceEvent
+{
+    const char* name;
+    uint32_t depth;
+    GpuQueue queue;
+    uint64_t frameIndex;
+
+    uint64_t beginTicks;
+    uint64_t endTicks;
+};
+
+struct GpuScopeStats
+{
+    const char* name;
+    uint32_t depth;
+
+    uint32_t count;
+    double lastMs;
+    double totalMs;
+    double minMs;
+    double maxMs;
+};
+
+struct GpuProfiler
+{
+    // NOTE: 0 valid bits for a queue that doesn't exist or can't write timestamps
+    uint32_t timestampValidBits[GPU_QUEUE_COUNT];
+    double timestampPeriod;
+
+    uint32_t frameCount;
+    GpuProfilerFrame frames[MAX_FRAMES_IN_FLIGHT];
+
+    // NOTE: the frame currently being recorded, its open scopes and its open compute scope
+    uint32_t currentFrame;
+    uint64_t recordedFrames;
+    std::vector<uint32_t> scopeStack;
+    uint32_t computeScope;
+
+    // NOTE: first entry is the whole frame
+    std::vector<GpuScopeStats> stats;
+
+    // NOTE: only filled once enableGpuTrace has been called, stops when full
+    bool traceEnabled;
+    std::vector<GpuTraceEvent> trace;
+};
+
+// NOTE: computeFamilyIndex is VK_QUEUE_FAMILY_IGNORED without an async compute queue
+void createGpuProfiler(GpuProfiler& result, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t familyIndex, uint32_t computeFamilyIndex,
+                       uint32_t frameCount)
+{
+    assert(frameCount <= MAX_FRAMES_IN_FLIGHT);
+
+    uint32_t queueFamilyPropertyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, 0);
+
+    std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyPropertyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, queueFamilyProperties.data());
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+    result.timestampValidBits[GPU_QUEUE_GRAPHICS] = queueFamilyProperties[familyIndex].timestampValidBits;
+    result.timestampValidBits[GPU_QUEUE_COMPUTE] = (computeFamilyIndex != VK_QUEUE_FAMILY_IGNORED) ? queueFamilyProperties[computeFamilyIndex].timestampValidBits : 0;
+    result.timestampPeriod = props.limits.timestampPeriod;
+    result.frameCount = frameCount;
+
+    if (result.timestampValidBits[GPU_QUEUE_GRAPHICS] == 0)
+        printf("WARNING: Queue family %u doesn't support timestamps, GPU profiling disabled\n", familyIndex);
+
+    if ((computeFamilyIndex != VK_QUEUE_FAMILY_IGNORED) && (result.timestampValidBits[GPU_QUEUE_COMPUTE] == 0))
+        printf("WARNING: Queue family %u doesn't support timestamps, async compute isn't profiled\n", computeFamilyIndex);
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        for (uint32_t queue = 0; queue < GPU_QUEUE_COUNT; queue++)
+        {
+            result.frames[i].queryPools[queue] = 0;
+            result.frames[i].queryCounts[queue] = 0;
+
+            if (result.timestampValidBits[queue] == 0)
+                continue;
+
+            VkQueryPoolCreateInfo createInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+            createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            createInfo.queryCount = GPU_PROFILER_QUERY_COUNT;
+
+            VK_CHECK(vkCreateQueryPool(device, &createInfo, 0, &result.frames[i].queryPools[queue]));
+        }
+
+        result.frames[i].frameIndex = 0;
+        result.frames[i].pending = false;
+        result.frames[i].scopes.reserve(GPU_PROFILER_MAX_SCOPES);
+    }
+
+    result.currentFrame = 0;
+    result.recordedFrames = 0;
+    result.computeScope = UINT32_MAX;
+    result.stats.clear();
+
+    result.traceEnabled = false;
+    result.trace.clear();
+}
+
+void destroyGpuProfiler(GpuProfiler& profiler, VkDevice device)
+{
+    for (uint32_t i = 0; i < profiler.frameCount; i++)
+        for (uint32_t queue = 0; queue < GPU_QUEUE_COUNT; queue++)
+            if (profiler.frames[i].queryPools[queue])
+                vkDestroyQueryPool(device, profiler.frames[i].queryPools[queue], 0);
+}
+
+void enableGpuTrace(GpuProfiler& profiler)
+{
+    profiler.traceEnabled = true;
+    profiler.trace.reserve(GPU_PROFILER_TRACE_SIZE);
+}
+
+static GpuScopeStats& getGpuScopeStats(GpuProfiler& profiler, const char* name, uint32_t depth)
+{
+    for (size_t i = 0; i < profiler.stats.size(); i++)
+        if ((profiler.stats[i].depth == depth) && (strcmp(profiler.stats[i].name, name) == 0))
+            return profiler.stats[i];
+
+    GpuScopeStats stats = {};
+    stats.name = name;
+    stats.depth = depth;
+    stats.minMs = DBL_MAX;
+
+    profiler.stats.push_back(stats);
+    return profiler.stats.back();
+}
+
+// NOTE: call after the fence of the frame that last used this slot has been waited on; returns the GPU frame time
+bool resolveGpuProfilerFrame(GpuProfiler& profiler, VkDevice device, uint32_t frameIndex, double* frameTimeMs)
+{
+    GpuProfilerFrame& frame = profiler.frames[frameIndex];
+
+    if (!frame.pending)
+        return false;
+
+    frame.pending = false;
+
+    // NOTE: value + availability pairs
+    uint64_t results[GPU_QUEUE_COUNT][GPU_PROFILER_QUERY_COUNT * 2];
+
+    for (uint32_t queue = 0; queue < GPU_QUEUE_COUNT; queue++)
+    {
+        uint32_t queryCount = frame.queryCounts[queue];
+        if (queryCount == 0)
+            continue;
+
+        VkResult rc = vkGetQueryPoolResults(device, frame.queryPools[queue], 0, queryCount, queryCount * sizeof(uint64_t) * 2, results[queue],
+                                            sizeof(uint64_t) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if ((rc != VK_SUCCESS) && (rc != VK_NOT_READY))
+            return false;
+    }
+
+    // NOTE: query 0 and 1 bracket the whole frame, they are stored as the first scope
+    bool resolved = false;
+
+    for (size_t i = 0; i < frame.scopes.size(); i++)
+    {
+        const GpuScope& scope = frame.scopes[i];
+        const uint64_t* queueResults = results[scope.queue];
+
+        if (!queueResults[scope.beginQuery * 2 + 1] || !queueResults[scope.endQuery * 2 + 1])
+            continue;
+
+        uint32_t validBits = profiler.timestampValidBits[scope.queue];
+        uint64_t mask = (validBits < 64) ? (1ull << validBits) - 1 : ~0ull;
+
+        uint64_t beginTicks = queueResults[scope.beginQuery * 2];
+        uint64_t endTicks = queueResults[scope.endQuery * 2];
+
+        uint64_t ticks = (endTicks - beginTicks) & mask;
+        double timeMs = double(ticks) * profiler.timestampPeriod * 1e-6;
+
+        if (profiler.traceEnabled && (profiler.trace.size() < GPU_PROFILER_TRACE_SIZE))
+        {
+            GpuTraceEvent event = { scope.name, scope.depth, scope.queue, frame.frameIndex, beginTicks, beginTicks + ticks };
+            profiler.trace.push_back(event);
+        }
+
+        GpuScopeStats& stats = getGpuScopeStats(profiler, scope.name, scope.depth);
+        stats.count++;
+        stats.lastMs = timeMs;
+        stats.totalMs += timeMs;
+        stats.minMs = std::min(stats.minMs, timeMs);
+        stats.maxMs = std::max(stats.maxMs, timeMs);
+
+        if (i == 0)
+        {
+            *frameTimeMs = timeMs;
+            resolved = true;
+        }
+    }
+
+    return resolved;
+}
+
+void beginGpuProfilerFrame(GpuProfiler& profiler, VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    GpuProfilerFrame& frame = profiler.frames[frameIndex];
+
+    profiler.currentFrame = frameIndex;
+    profiler.scopeStack.clear();
+    profiler.computeScope = UINT32_MAX;
+
+    frame.queryCounts[GPU_QUEUE_GRAPHICS] = 0;
+    frame.queryCounts[GPU_QUEUE_COMPUTE] = 0;
+    frame.scopes.clear();
+    frame.frameIndex = profiler.recordedFrames++;
+
+    if (profiler.timestampValidBits[GPU_QUEUE_GRAPHICS] == 0)
+        return;
+
+    vkCmdResetQueryPool(commandBuffer, frame.queryPools[GPU_QUEUE_GRAPHICS], 0, GPU_PROFILER_QUERY_COUNT);
+
+    GpuScope scope = { "frame", 0, GPU_QUEUE_GRAPHICS, 0, 1 };
+    frame.scopes.push_back(scope);
+    frame.queryCounts[GPU_QUEUE_GRAPHICS] = 2;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.queryPools[GPU_QUEUE_GRAPHICS], scope.beginQuery);
+}
+
+void endGpuProfilerFrame(GpuProfiler& profiler, VkCommandBuffer commandBuffer)
+{
+    GpuProfilerFrame& frame = profiler.frames[profiler.currentFrame];
+
+    assert(profiler.scopeStack.empty() && "Unbalanced GPU profiler scopes!");
+    assert((profiler.computeScope == UINT32_MAX) && "Unbalanced GPU profiler compute scopes!");
+
+    if (frame.queryCounts[GPU_QUEUE_GRAPHICS] == 0)
+        return;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPools[GPU_QUEUE_GRAPHICS], frame.scopes[0].endQuery);
+
+    frame.pending = true;
+}
+
+// NOTE: scopes are timed between bottom of pipe timestamps, i.e. from the point all previous work is done until
+// all of the scope's work is done, so sibling scopes add up to their parent instead of overlapping
+void beginGpuScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const char* name)
+{
+    GpuProfilerFrame& frame = profiler.frames[profiler.currentFrame];
+
+    uint32_t& queryCount = frame.queryCounts[GPU_QUEUE_GRAPHICS];
+
+    // NOTE: UINT32_MAX marks a scope that didn't fit, so the matching end is still balanced
+    if ((queryCount == 0) || (queryCount + 2 > GPU_PROFILER_QUERY_COUNT))
+    {
+        profiler.scopeStack.push_back(UINT32_MAX);
+        return;
+    }
+
+    GpuScope scope = {};
+    scope.name = name;
+    scope.depth = uint32_t(profiler.scopeStack.size()) + 1;
+    scope.queue = GPU_QUEUE_GRAPHICS;
+    scope.beginQuery = queryCount++;
+    scope.endQuery = queryCount++;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPools[GPU_QUEUE_GRAPHICS], scope.beginQuery);
+
+    profiler.scopeStack.push_back(uint32_t(frame.scopes.size()));
+    frame.scopes.push_back(scope);
+}
+
+void endGpuScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer)
+{
+    GpuProfilerFrame& frame = profiler.frames[profiler.currentFrame];
+
+    assert(!profiler.scopeStack.empty() && "Unbalanced GPU profiler scopes!");
+
+    uint32_t scopeIndex = profiler.scopeStack.back();
+    profiler.scopeStack.pop_back();
+
+    if (scopeIndex == UINT32_MAX)
+        return;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPools[GPU_QUEUE_GRAPHICS], frame.scopes[scopeIndex].endQuery);
+}
+
+// NOTE: a top level scope in a command buffer of the current frame that goes to the async compute queue, between
+// beginGpuProfilerFrame and endGpuProfilerFrame; the first one of a frame resets the compute query pool, since the
+// compute queue runs ahead of the graphics command buffer that resets the other one. Compute scopes don't nest.
+void beginGpuComputeScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const char* name)
+{
+    GpuProfilerFrame& frame = profiler.frames[profiler.currentFrame];
+    uint32_t& queryCount = frame.queryCounts[GPU_QUEUE_COMPUTE];
+
+    assert((profiler.computeScope == UINT32_MAX) && "Compute scopes don't nest!");
+
+    if ((profiler.timestampValidBits[GPU_QUEUE_COMPUTE] == 0) || (frame.queryCounts[GPU_QUEUE_GRAPHICS] == 0) ||
+        (queryCount + 2 > GPU_PROFILER_QUERY_COUNT))
+        return;
+
+    if (queryCount == 0)
+        vkCmdResetQueryPool(commandBuffer, frame.queryPools[GPU_QUEUE_COMPUTE], 0, GPU_PROFILER_QUERY_COUNT);
+
+    GpuScope scope = {};
+    scope.name = name;
+    scope.depth = 0;
+    scope.queue = GPU_QUEUE_COMPUTE;
+    scope.beginQuery = queryCount++;
+    scope.endQuery = queryCount++;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.queryPools[GPU_QUEUE_COMPUTE], scope.beginQuery);
+
+    profiler.computeScope = uint32_t(frame.scopes.size());
+    frame.scopes.push_back(scope);
+}
+
+void endGpuComputeScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer)
+{
+    GpuProfilerFrame& frame = profiler.frames[profiler.currentFrame];
+
+    uint32_t scopeIndex = profiler.computeScope;
+    profiler.computeScope = UINT32_MAX;
+
+    if (scopeIndex == UINT32_MAX)
+        return;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPools[GPU_QUEUE_COMPUTE], frame.scopes[scopeIndex].endQuery);
+}
+
+void printGpuProfile(const GpuProfiler& profiler)
+{
+    if (profiler.stats.empty())
+        return;
+
+    printf("GPU profile (%u frames):\n", profiler.stats[0].count);
+    printf("%-32s %8s %8s %8s (ms)\n", "", "min", "avg", "max");
+
+    for (size_t i = 0; i < profiler.stats.size(); i++)
+    {
+        const GpuScopeStats& stats = profiler.stats[i];
+
+        printf("%*s%-*s %8.3f %8.3f %8.3f\n", int(stats.depth * 2), "", int(32 - stats.depth * 2), stats.name,
+               stats.minMs, stats.totalMs / double(stats.count), stats.maxMs);
+    }
+}
+
+bool writeGpuProfile(const GpuProfiler& profiler, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "{\n  \"scopes\": [\n");
+
+    for (size_t i = 0; i < profiler.stats.size(); i++)
+    {
+        const GpuScopeStats& stats = profiler.stats[i];
+
+        fprintf(file, "    { \"name\": \"%s\", \"depth\": %u, \"count\": %u, \"minMs\": %.4f, \"avgMs\": %.4f, \"maxMs\": %.4f }%s\n",
+                stats.name, stats.depth, stats.count, stats.minMs, stats.totalMs / double(stats.count), stats.maxMs,
+                (i + 1 < profiler.stats.size()) ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+
+    return fclose(file) == 0;
+}
+
+// NOTE: the timestamps of both queues go on one timeline as they are, which is only valid where the driver uses one
+// clock for every queue; Vulkan doesn't promise that across queue families, and without it the overlap between the two
+// tracks means nothing. Times are relative to the earliest event, the GPU clock isn't correlated with the CPU trace's
+bool writeGpuTrace(const GpuProfiler& profiler, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    uint64_t baseTicks = UINT64_MAX;
+    for (size_t i = 0; i < profiler.trace.size(); i++)
+        baseTicks = std::min(baseTicks, profiler.trace[i].beginTicks);
+
+    double ticksToUs = profiler.timestampPeriod * 1e-3;
+
+    fprintf(file, "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [");
+
+    for (size_t i = 0; i < profiler.trace.size(); i++)
+    {
+        const GpuTraceEvent& event = profiler.trace[i];
+
+        fprintf(file, "\n    { \"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": { \"frame\": %llu } },",
+                event.name, uint32_t(event.queue), double(event.beginTicks - baseTicks) * ticksToUs, double(event.endTicks - event.beginTicks) * ticksToUs,
+                (unsigned long long)event.frameIndex);
+    }
+
+    const char* queueNames[GPU_QUEUE_COUNT] = { "graphics queue", "compute queue" };
+
+    for (uint32_t queue = 0; queue < GPU_QUEUE_COUNT; queue++)
+        fprintf(file, "\n    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, \"args\": { \"name\": \"%s\" } }%s",
+                queue, queueNames[queue], (queue + 1 < GPU_QUEUE_COUNT) ? "," : "");
+
+    fprintf(file, "\n  ]\n}\n");
+
+    return fclose(file) == 0;
+}
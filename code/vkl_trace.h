@@ -0,0 +1,204 @@
+#pragma once
+
+//
+// NOTE: CPU trace zones
+//
+// TRACE_ZONE("name") times the enclosing scope. When the scope ends, one complete event is written into a ring
+// buffer owned by the calling thread. That costs two clock reads and a store, and takes no locks after the first
+// zone on a thread, so it can stay enabled in release builds (define VKL_TRACE 0 to compile it out).
+// writeTrace dumps the newest events of every thread as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Zone names have to be string literals or otherwise outlive the trace.
+//
+
+#ifndef VKL_TRACE
+#define VKL_TRACE 1
+#endif
+
+#define TRACE_RING_SIZE (64 * 1024)
+
+struct TraceEvent
+{
+    const char* name;
+    uint64_t beginNs;
+    uint64_t endNs;
+};
+
+// NOTE: a ring slot; writeTrace reads slots while their thread may be overwriting them, so every field is atomic
+// (relaxed, plain loads and stores on x86 and ARM) and torn copies are detected with TraceThread::started
+struct TraceSlot
+{
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> beginNs;
+    std::atomic<uint64_t> endNs;
+};
+
+struct TraceThread
+{
+    TraceSlot events[TRACE_RING_SIZE];
+
+    // NOTE: total number of events ever written, the ring slot is count % TRACE_RING_SIZE; started is bumped before an
+    // event is written and count after, so events [count, started) may be half written
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> started;
+
+    uint32_t threadIndex;
+    char name[64];
+};
+
+struct TraceState
+{
+    std::mutex mutex;
+    std::vector<TraceThread*> threads;
+
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+static TraceState traceState;
+static thread_local TraceThread* traceThread;
+
+inline uint64_t getTraceTimeNs()
+{
+    using namespace std::chrono;
+    return uint64_t(duration_cast<nanoseconds>(steady_clock::now() - traceState.epoch).count());
+}
+
+static TraceThread* registerTraceThread()
+{
+    TraceThread* thread = new TraceThread;
+    thread->count = 0;
+    thread->started = 0;
+    thread->name[0] = 0;
+
+    std::lock_guard<std::mutex> lock(traceState.mutex);
+
+    thread->threadIndex = uint32_t(traceState.threads.size());
+    traceState.threads.push_back(thread);
+
+    return thread;
+}
+
+inline void writeTraceEvent(const char* name, uint64_t beginNs, uint64_t endNs)
+{
+    if (!traceThread)
+        traceThread = registerTraceThread();
+
+    uint64_t index = traceThread->count.load(std::memory_order_relaxed);
+
+    // NOTE: the release fence pairs with the acquire fence in writeTrace, a reader that sees any of the new fields sees
+    // started as well
+    traceThread->started.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    TraceSlot& slot = traceThread->events[index % TRACE_RING_SIZE];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.beginNs.store(beginNs, std::memory_order_relaxed);
+    slot.endNs.store(endNs, std::memory_order_relaxed);
+
+    traceThread->count.store(index + 1, std::memory_order_release);
+}
+
+void setTraceThreadName(const char* name)
+{
+    if (!traceThread)
+        traceThread = registerTraceThread();
+
+    snprintf(traceThread->name, sizeof(traceThread->name), "%s", name);
+}
+
+struct TraceZone
+{
+    const char* name;
+    uint64_t beginNs;
+
+    TraceZone(const char* zoneName) : name(zoneName), beginNs(getTraceTimeNs()) {}
+    ~TraceZone() { writeTraceEvent(name, beginNs, getTraceTimeNs()); }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if VKL_TRACE
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone_, __LINE__)(name)
+#else
+#define TRACE_ZONE(name)
+#endif
+
+static void writeTraceEventJson(FILE* file, const TraceEvent& event, uint32_t threadIndex, bool* first)
+{
+    fprintf(file, "%s\n    { \"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f }", *first ? "" : ",",
+            event.name, threadIndex, double(event.beginNs) * 1e-3, double(event.endNs - event.beginNs) * 1e-3);
+
+    *first = false;
+}
+
+// NOTE: can be called at any time from any thread; only events published before the copy starts are written, and of
+// those the ones their thread overwrote while they were copied are dropped
+bool writeTrace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [");
+
+    bool first = true;
+    std::vector<TraceEvent> events;
+
+    std::lock_guard<std::mutex> lock(traceState.mutex);
+
+    for (size_t i = 0; i < traceState.threads.size(); i++)
+    {
+        const TraceThread* thread = traceState.threads[i];
+
+        uint64_t end = thread->count.load(std::memory_order_acquire);
+        uint64_t begin = (end > TRACE_RING_SIZE) ? end - TRACE_RING_SIZE : 0;
+
+        events.clear();
+        for (uint64_t j = begin; j < end; j++)
+        {
+            const TraceSlot& slot = thread->events[j % TRACE_RING_SIZE];
+
+            TraceEvent event;
+            event.name = slot.name.load(std::memory_order_relaxed);
+            event.beginNs = slot.beginNs.load(std::memory_order_relaxed);
+            event.endNs = slot.endNs.load(std::memory_order_relaxed);
+
+            events.push_back(event);
+        }
+
+        // NOTE: the owning thread keeps writing; event j shares its slot with j + TRACE_RING_SIZE, so every event it has
+        // started since, including one that is still half written, may have torn one of the oldest copies
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t started = thread->started.load(std::memory_order_relaxed);
+
+        uint64_t overwritten = (started > begin + TRACE_RING_SIZE) ? started - begin - TRACE_RING_SIZE : 0;
+        size_t skip = size_t(std::min(overwritten, uint64_t(events.size())));
+
+        for (size_t j = skip; j < events.size(); j++)
+            writeTraceEventJson(file, events[j], thread->threadIndex, &first);
+
+        if (thread->name[0])
+        {
+            fprintf(file, "%s\n    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, \"args\": { \"name\": \"%s\" } }",
+                    first ? "" : ",", thread->threadIndex, thread->name);
+            first = false;
+        }
+    }
+
+    fprintf(file, "\n  ]\n}\n");
+
+    return fclose(file) == 0;
+}
+
+void destroyTrace()
+{
+    std::lock_guard<std::mutex> lock(traceState.mutex);
+
+    for (size_t i = 0; i < traceState.threads.size(); i++)
+        delete traceState.threads[i];
+
+    traceState.threads.clear();
+
+    // NOTE: every other thread that traced has to be gone by now
+    traceThread = 0;
+}